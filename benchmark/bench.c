@@ -0,0 +1,256 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: benchmark/bench.c
+ *
+ * Description: Executor Benchmarks
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#define _POSIX_SOURCE /* For fileno() */
+
+/* Standard C headers */
+#include <stdio.h>  /* printf(), fprintf(), tmpfile()        */
+#include <stdlib.h> /* NULL, atoi(), getenv(), qsort(), exit() */
+#include <string.h> /* strcmp(), strchr(), strrchr()          */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/time.h> /* gettimeofday()                       */
+#include <sys/wait.h> /* waitpid()                            */
+#include <unistd.h>   /* fork(), execvp(), dup2(), lseek()    */
+#include <fcntl.h>    /* open()                               */
+
+
+/*****************************************************************************
+ *
+ * Benchmarks
+ *
+ */
+
+/* Environment of executed programs */
+extern char **environ;
+
+/* Maximum number of runs of each benchmark */
+#define MAX_RUNS 100
+
+/* Benchmarks: each is a script made of one command line repeated, given on
+   the standard input of the shell, which is timed until it exits */
+static const struct bench {
+    const char *name;   /* Benchmark name                           */
+    const char *line;   /* Command line                             */
+    int         count;  /* Number of times it is repeated           */
+    double      mbytes; /* Megabytes moved by a line (throughput)  */
+} benches[] = {
+    { "startup",      "",                                         1,     0 },
+    { "fork_exec",    "/bin/true\n",                              1000,  0 },
+    { "builtin",      "cd .\n",                                   20000, 0 },
+    { "pipeline_2",   "/bin/true | /bin/true\n",                  500,   0 },
+    { "pipeline_8",   "/bin/true | /bin/true | /bin/true | /bin/true | "
+		      "/bin/true | /bin/true | /bin/true | /bin/true\n", 200, 0 },
+    { "throughput",   "head -c 268435456 /dev/zero | cat | cat "
+		      "> /dev/null\n",                            1,     256 },
+    { "and_or",       "/bin/true && /bin/false || /bin/true\n",   300,   0 },
+    { "redirections", "/bin/true < /dev/null > /dev/null "
+		      "2> /dev/null 3>&1 4>&2\n",                 1000,  0 },
+    { "background",   "/bin/true &\n",                            1000,  0 }
+};
+
+/* Number of benchmarks */
+#define BENCH_COUNT ((int) (sizeof benches / sizeof *benches))
+
+/*
+ * Write the script of a benchmark to a temporary file; return its
+ * descriptor
+ */
+static int bench_script(const struct bench *bench)
+{
+    FILE *file; /* Script file */
+    int   i;    /* Counter     */
+
+    if ((file = tmpfile()) == NULL) {
+	perror("tmpfile");
+	exit(1);
+    }
+    for (i = 0; i < bench->count; i++)
+	fputs(bench->line, file);
+    fflush(file);
+    return fileno(file);
+}
+
+/*
+ * Run `shell' on a script; return the elapsed time in seconds, or -1 if
+ * the shell cannot be run
+ */
+static double bench_run(const char *shell, int script)
+{
+    pid_t          pid;        /* Shell PID        */
+    int            status;     /* Its exit status  */
+    struct timeval start, end; /* Times            */
+    char          *argv[2];    /* Shell arguments  */
+    char          *envp[4];    /* Its environment  */
+    static char    path[4096]; /* $PATH assignment */
+    const char    *value;      /* $PATH value      */
+
+    /* A fixed environment, without startup files (like $ENV) */
+    value = getenv("PATH");
+    sprintf(path, "PATH=%.4000s", value != NULL ? value : "/usr/bin:/bin");
+    envp[0] = path;
+    envp[1] = "LC_ALL=C";
+    envp[2] = "HOME=/nonexistent";
+    envp[3] = NULL;
+    argv[0] = (char *) shell;
+    argv[1] = NULL;
+
+    lseek(script, 0, SEEK_SET);
+    gettimeofday(&start, NULL);
+    if ((pid = fork()) == 0) {
+	dup2(script, STDIN_FILENO);
+	close(script);
+	close(STDOUT_FILENO);
+	open("/dev/null", O_WRONLY);
+	if (strchr(shell, '/') != NULL)
+	    execve(shell, argv, envp);
+	else {
+	    environ = envp;
+	    execvp(shell, argv);
+	}
+	_exit(127);
+    } else if (pid == -1) {
+	perror("fork");
+	exit(1);
+    }
+    waitpid(pid, &status, 0);
+    gettimeofday(&end, NULL);
+
+    if (WIFEXITED(status) && WEXITSTATUS(status) == 127)
+	return -1;
+    return (end.tv_sec - start.tv_sec) +
+	(end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+/*
+ * Compare two times (for qsort())
+ */
+static int bench_cmp(const void *a, const void *b)
+{
+    double x = *(const double *) a, y = *(const double *) b;
+
+    return x < y ? -1 : x > y;
+}
+
+
+/*****************************************************************************
+ *
+ * Main Function
+ *
+ */
+
+/*
+ * Run every benchmark on each shell given, printing a summary on the error
+ * output and the results as JSON
+ */
+int main(int argc, char *argv[])
+{
+    int         i, j, k;         /* Counters                     */
+    int         runs = 5;        /* Runs of each benchmark       */
+    const char *output = NULL;   /* JSON file                    */
+    FILE       *json = stdout;   /* JSON stream                  */
+    int         scripts[BENCH_COUNT]; /* Benchmark scripts       */
+    double      times[MAX_RUNS]; /* Times of the runs            */
+    double      median;          /* Median time                  */
+    int         first = 1;       /* First result?                */
+    const char *name;            /* Shell name                   */
+
+    /* Parse options */
+    for (i = 1; i < argc && argv[i][0] == '-'; i++)
+	if (!strcmp(argv[i], "-r") && i + 1 < argc &&
+	    (runs = atoi(argv[i + 1])) > 0 && runs <= MAX_RUNS)
+	    i++;
+	else if (!strcmp(argv[i], "-o") && i + 1 < argc)
+	    output = argv[++i];
+	else
+	    break;
+    if (i == argc || argv[i][0] == '-') {
+	fprintf(stderr, "Usage: %s [-r runs] [-o file.json] shell...\n",
+		argv[0]);
+	return 1;
+    }
+    if (output != NULL && (json = fopen(output, "w")) == NULL) {
+	perror(output);
+	return 1;
+    }
+
+    for (j = 0; j < BENCH_COUNT; j++)
+	scripts[j] = bench_script(&benches[j]);
+
+    fprintf(json, "{\n  \"runs\": %d,\n  \"results\": [", runs);
+    for (; i < argc; i++) {
+	if ((name = strrchr(argv[i], '/')) != NULL)
+	    name++;
+	else
+	    name = argv[i];
+
+	for (j = 0; j < BENCH_COUNT; j++) {
+	    for (k = 0; k < runs; k++)
+		if ((times[k] = bench_run(argv[i], scripts[j])) < 0)
+		    break;
+	    if (k < runs) {
+		fprintf(stderr, "%s: cannot be run, skipped\n", argv[i]);
+		break;
+	    }
+	    qsort(times, runs, sizeof *times, bench_cmp);
+	    median = runs % 2 ? times[runs / 2] :
+		(times[runs / 2 - 1] + times[runs / 2]) / 2;
+
+	    fprintf(stderr, "%-6s %-13s %9.3f ms (min %9.3f ms)", name,
+		    benches[j].name, median * 1000, times[0] * 1000);
+	    if (benches[j].mbytes > 0)
+		fprintf(stderr, "  %8.1f MB/s",
+			benches[j].count * benches[j].mbytes / median);
+	    else if (benches[j].count > 1)
+		fprintf(stderr, "  %8.0f ops/s", benches[j].count / median);
+	    fputc('\n', stderr);
+
+	    fprintf(json, "%s\n    { \"shell\": \"%s\", \"bench\": \"%s\", "
+		    "\"ops\": %d, \"median_s\": %.6f, \"min_s\": %.6f, "
+		    "\"%s\": %.1f }", first ? "" : ",", name, benches[j].name,
+		    benches[j].count, median, times[0],
+		    benches[j].mbytes > 0 ? "mb_per_s" : "ops_per_s",
+		    (benches[j].mbytes > 0 ? benches[j].mbytes : 1) *
+		    benches[j].count / median);
+	    first = 0;
+	}
+    }
+    fputs("\n  ]\n}\n", json);
+
+    if (json != stdout)
+	fclose(json);
+    return 0;
+}
+
+/* End of file */
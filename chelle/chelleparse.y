@@ -62,7 +62,7 @@
 %left <copval> CONDOP
 %left <sopval> SEQOP
 %left PIPE
-%token <intval> OUTTO INFROM APPTO
+%token <intval> OUTTO INFROM APPTO DOCFROM DOCTABFROM STRFROM
 %token <rddval> REDIRDESC
 %token PARO PARF
 %token <motval> MOT
@@ -153,6 +153,7 @@ redirection
     $$->u.redirfichier->type = IN;
     $$->u.redirfichier->desc = $1;
     $$->u.redirfichier->fichier = $2;
+    $$->u.redirfichier->document = NULL;
     $$->suiv = NULL;
 }
 | OUTTO mot {
@@ -162,6 +163,7 @@ redirection
     $$->u.redirfichier->type = OUT;
     $$->u.redirfichier->desc = $1;
     $$->u.redirfichier->fichier = $2;
+    $$->u.redirfichier->document = NULL;
     $$->suiv = NULL;
 }
 | APPTO mot {
@@ -171,6 +173,37 @@ redirection
     $$->u.redirfichier->type = APP;
     $$->u.redirfichier->desc = $1;
     $$->u.redirfichier->fichier = $2;
+    $$->u.redirfichier->document = NULL;
+    $$->suiv = NULL;
+}
+| DOCFROM mot {
+    LK( $$ = malloc(sizeof(Redirection)) );
+    $$->type = FICHIER;
+    LK( $$->u.redirfichier = malloc(sizeof(RedirFichier)) );
+    $$->u.redirfichier->type = HEREDOC;
+    $$->u.redirfichier->desc = $1;
+    $$->u.redirfichier->fichier = $2;
+    $$->u.redirfichier->document = NULL;
+    $$->suiv = NULL;
+}
+| DOCTABFROM mot {
+    LK( $$ = malloc(sizeof(Redirection)) );
+    $$->type = FICHIER;
+    LK( $$->u.redirfichier = malloc(sizeof(RedirFichier)) );
+    $$->u.redirfichier->type = HEREDOCTAB;
+    $$->u.redirfichier->desc = $1;
+    $$->u.redirfichier->fichier = $2;
+    $$->u.redirfichier->document = NULL;
+    $$->suiv = NULL;
+}
+| STRFROM mot {
+    LK( $$ = malloc(sizeof(Redirection)) );
+    $$->type = FICHIER;
+    LK( $$->u.redirfichier = malloc(sizeof(RedirFichier)) );
+    $$->u.redirfichier->type = HERESTR;
+    $$->u.redirfichier->desc = $1;
+    $$->u.redirfichier->fichier = $2;
+    $$->u.redirfichier->document = NULL;
     $$->suiv = NULL;
 }
 | REDIRDESC {
@@ -23,6 +23,7 @@ static void free_redirection_list(Redirection * r)
         if ( r->type == FICHIER )
         {
             free(r->u.redirfichier->fichier);
+            free(r->u.redirfichier->document);
             free(r->u.redirfichier);
         }
         else
@@ -124,9 +125,13 @@ static void dump_redirection_fichier(RedirFichier * r, FILE * f)
     fprintf(f,"%d",r->desc);
     switch ( r->type )
     {
-        case IN:  fprintf(f,"<"); break;
+        case IN:
+        case CATIN: fprintf(f,"<"); break;
         case OUT: fprintf(f,">"); break;
         case APP: fprintf(f,">>"); break;
+        case HEREDOC: fprintf(f,"<<"); break;
+        case HEREDOCTAB: fprintf(f,"<<-"); break;
+        case HERESTR: fprintf(f,"<<<"); break;
     }
     fprintf(f,"%s\n",r->fichier);
 }
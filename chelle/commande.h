@@ -7,6 +7,16 @@
 
 #include <stdio.h>
 
+/* Profilage des allocations de Lish (voir config/common.h) */
+#ifdef HAS_ALLOC_PROFILE
+# include <common.h>
+#endif
+
+/* Marques des parties protges d'un mot (pour l'expansion) */
+#define QUOTE_SINGLE '\001' /* '...' */
+#define QUOTE_DOUBLE '\002' /* "..." */
+#define QUOTE_ESCAPE '\003' /* \c    */
+
 typedef struct mots {
     char        *mot;
     struct mots *suiv;
@@ -30,9 +40,11 @@ typedef struct redirection {
 } Redirection;
 
 typedef struct redirfichier {
-    enum { IN, OUT, APP } type;
+    /* CATIN : entre d'un `cat FICHIER |' rcrit (voir src/optimize.c) */
+    enum { IN, OUT, APP, HEREDOC, HEREDOCTAB, HERESTR, CATIN } type;
     int   desc;
-    char *fichier;
+    char *fichier;  /* Fichier, dlimiteur ou mot (here-string) */
+    char *document; /* Corps du here-document, lu aprs l'analyse */
 } RedirFichier;
 
 typedef struct redirdesc {
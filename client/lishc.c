@@ -0,0 +1,261 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: client/lishc.c
+ *
+ * Description: Client of the Server Mode (a Drop-in sh -c)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+
+#define _GNU_SOURCE /* For SCM_RIGHTS, CMSG_SPACE() */
+
+/* Standard C headers */
+#include <stdio.h>  /* fprintf()                              */
+#include <stdlib.h> /* NULL, malloc(), getenv()                */
+#include <string.h> /* strcmp(), strlen(), strcpy(), memset() */
+#include <errno.h>  /* errno                                  */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/socket.h> /* socket(), connect(), sendmsg()        */
+#include <sys/un.h>     /* struct sockaddr_un                    */
+#include <unistd.h>     /* read(), write(), getcwd(), execvp()   */
+#include <signal.h>     /* signal(), kill()                      */
+
+/* Project headers */
+#include "server.h"
+
+
+/*****************************************************************************
+ *
+ * Global Variables
+ *
+ */
+
+/* Environment, sent to the server */
+extern char **environ;
+
+/* Shell running the command, which receives the signals */
+static volatile pid_t shell = 0;
+
+/* Exit code on error, as sh */
+#define CLIENT_ERROR 2
+
+
+/*****************************************************************************
+ *
+ * Utility Functions
+ *
+ */
+
+/*
+ * Forward a signal to the process group of the shell
+ */
+static void client_signal(int sig)
+{
+    if (shell > 0)
+	kill(-shell, sig);
+}
+
+/*
+ * Connect to the server listening on `path'; return the socket, or -1
+ */
+static int client_connect(const char *path)
+{
+    struct sockaddr_un addr; /* Socket address */
+    int                sock; /* Socket         */
+
+    if (strlen(path) >= sizeof addr.sun_path ||
+	(sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1)
+	return -1;
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+    if (connect(sock, (struct sockaddr *) &addr, sizeof addr) == -1) {
+	close(sock);
+	return -1;
+    }
+    return sock;
+}
+
+/*
+ * Read exactly `len' bytes; return 0 on success
+ */
+static int client_read(int fd, void *buffer, size_t len)
+{
+    ssize_t ret; /* Bytes read */
+
+    while (len > 0)
+	if ((ret = read(fd, buffer, len)) > 0) {
+	    buffer = (char *) buffer + ret;
+	    len -= ret;
+	} else if (ret == 0 || errno != EINTR)
+	    return -1;
+    return 0;
+}
+
+/*
+ * Make a request: directory, command and environment, each ended by '\0';
+ * return it, or NULL on error
+ */
+static char *client_request(const char *command, size_t *len)
+{
+    char   cwd[4096];     /* Working directory */
+    char  *request, *end; /* Request, its end  */
+    char **env;           /* Environment entry */
+
+    if (getcwd(cwd, sizeof cwd) == NULL)
+	strcpy(cwd, "/");
+    *len = strlen(cwd) + strlen(command) + 2;
+    for (env = environ; *env != NULL; env++)
+	*len += strlen(*env) + 1;
+    if ((request = malloc(*len)) == NULL)
+	return NULL;
+
+    strcpy(request, cwd);
+    end = request + strlen(cwd) + 1;
+    strcpy(end, command);
+    end += strlen(command) + 1;
+    for (env = environ; *env != NULL; env++) {
+	strcpy(end, *env);
+	end += strlen(*env) + 1;
+    }
+    return request;
+}
+
+/*
+ * Send a request, with its length and the standard descriptors; return 0
+ * on success
+ */
+static int client_send(int sock, char *request, size_t len)
+{
+    static const int fds[SERVER_FDS] = { 0, 1, 2 };
+
+    struct msghdr   msg;    /* Message                 */
+    struct iovec    iov[2]; /* Its data: length, request */
+    struct cmsghdr *cmsg;   /* Its control data        */
+    ssize_t         ret;    /* Bytes written           */
+    size_t          sent;   /* Bytes of the request    */
+    union {
+	struct cmsghdr align;
+	char           buffer[CMSG_SPACE(SERVER_FDS * sizeof (int))];
+    } control;
+
+    memset(&msg, 0, sizeof msg);
+    iov[0].iov_base = &len;
+    iov[0].iov_len = sizeof len;
+    iov[1].iov_base = request;
+    iov[1].iov_len = len;
+    msg.msg_iov = iov;
+    msg.msg_iovlen = 2;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof control.buffer;
+    cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(SERVER_FDS * sizeof (int));
+    memcpy(CMSG_DATA(cmsg), fds, sizeof fds);
+    while ((ret = sendmsg(sock, &msg, 0)) == -1 && errno == EINTR)
+	;
+    if (ret < (ssize_t) sizeof len)
+	return -1;
+
+    /* What did not fit in the socket buffer */
+    for (sent = ret - sizeof len; sent < len; sent += ret)
+	while ((ret = write(sock, request + sent, len - sent)) == -1)
+	    if (errno != EINTR)
+		return -1;
+    return 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Main Function
+ *
+ */
+
+/*
+ * Run a command by the server given by -s or $LISH_SERVER, or by lish
+ * itself if it is not running
+ */
+int main(int argc, char *argv[])
+{
+    const char *path = getenv("LISH_SERVER"); /* Server socket      */
+    const char *command = NULL;               /* Command to run     */
+    int         i, sock;                      /* Counter, socket    */
+    int         status;                       /* Command exit status */
+    char       *args[4];                      /* Arguments of lish  */
+    char       *request;                      /* Request            */
+    size_t      len;                          /* Its length         */
+
+    for (i = 1; i < argc; i++)
+	if (!strcmp(argv[i], "-s") && i + 1 < argc)
+	    path = argv[++i];
+	else if (!strcmp(argv[i], "-c") && i + 1 < argc)
+	    command = argv[++i];
+	else
+	    break;
+    if (command == NULL || i < argc) {
+	fprintf(stderr, "Usage: %s [-s SOCKET] -c COMMAND\n"
+		"The server socket is SOCKET or $LISH_SERVER; without "
+		"server, lish is executed.\n", argv[0]);
+	return CLIENT_ERROR;
+    }
+
+    /* Without server, lish does the job */
+    if (path == NULL || (request = client_request(command, &len)) == NULL ||
+	(sock = client_connect(path)) == -1) {
+	args[0] = "lish";
+	args[1] = "-c";
+	args[2] = (char *) command;
+	args[3] = NULL;
+	execvp(args[0], args);
+	perror(args[0]);
+	return CLIENT_ERROR;
+    }
+
+    /* Send the request, and forward signals to the shell running it until
+       it exits */
+    if (client_send(sock, request, len) == -1 ||
+	client_read(sock, (pid_t *) &shell, sizeof shell) == -1) {
+	fprintf(stderr, "%s: %s: request failed\n", argv[0], path);
+	return CLIENT_ERROR;
+    }
+    signal(SIGINT,  client_signal);
+    signal(SIGQUIT, client_signal);
+    signal(SIGTERM, client_signal);
+    signal(SIGHUP,  client_signal);
+    if (client_read(sock, &status, sizeof status) == -1) {
+	fprintf(stderr, "%s: %s: connection lost\n", argv[0], path);
+	return CLIENT_ERROR;
+    }
+    return status;
+}
+
+/* End of file */
@@ -88,6 +88,27 @@ static INLINE void __mt_free(const void *const data, const char *const file,
 
 #endif /* DEBUG && !NDEBUG && HARDDEBUG */
 
+/* Allocation profiling: memory allocation functions are redirected to the
+   profiler (src/alloc.c), which attributes them to the subsystem of the
+   calling source file; system headers must be included before this one */
+#if defined(HAS_ALLOC_PROFILE) && !defined(ALLOC_INTERNAL)
+
+#include <stddef.h>
+
+void *alloc_malloc(size_t size, const char *file);
+void *alloc_calloc(size_t count, size_t size, const char *file);
+void *alloc_realloc(void *ptr, size_t size, const char *file);
+char *alloc_strdup(const char *str, const char *file);
+void  alloc_free(void *ptr);
+
+#define malloc(size)        alloc_malloc((size), __FILE__)
+#define calloc(count, size) alloc_calloc((count), (size), __FILE__)
+#define realloc(ptr, size)  alloc_realloc((ptr), (size), __FILE__)
+#define strdup(str)         alloc_strdup((str), __FILE__)
+#define free(ptr)           alloc_free(ptr)
+
+#endif /* HAS_ALLOC_PROFILE && !ALLOC_INTERNAL */
+
 #endif /* !_COMMON_H_ */
 
 /* End of file */
@@ -49,15 +49,14 @@
 
 /* Buffer sizes */
 #define MAX_COMMAND_LENGTH 256 /* Maximum command length                */
-#define MAX_COMMANDS       32  /* Maximum number of commands in history */
+#define MAX_COMMANDS       32  /* Default number of commands in history */
 
 /* History file */
 #define HISTORY_FILE ".history"
 
-/* Shared memory/semaphore keys */
+/* Shared memory key */
 #define MAKE_KEY(a, b, c, d) ((((a) & 0xFF) << 24) | (((b) & 0xFF) << 16) | \
 			      (((c) & 0xFF) << 8) | ((d) & 0xFF))
 #define SHM_KEY MAKE_KEY('L', 'i', 's', 'h')
-#define SEM_KEY (SHM_KEY + 42)
 
 #endif /* !_CONFIG_H_ */
@@ -53,6 +53,7 @@ CFLAGS    ?= -O2 -fomit-frame-pointer -pipe
 DEBUG     ?= -O0 -g -Werror -pipe
 WARN      ?= -Wall -W -ansi -pedantic
 CPPFLAGS  ?=
+#CPPFLAGS += -DHAS_ALLOC_PROFILE # Allocation profiling (`stats --alloc')
 LDFLAGS   ?= -s
 YACCFLAGS ?=
 LEXFLAGS  ?=
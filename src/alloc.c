@@ -0,0 +1,360 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/alloc.c
+ *
+ * Description: Allocation Profiler
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/* The functions of this file are the real allocator */
+#define ALLOC_INTERNAL
+
+/* Standard C headers */
+#include <stdio.h>  /* fprintf(), fputs()                      */
+#include <stdlib.h> /* NULL, malloc(), calloc(), realloc(), free() */
+#include <string.h> /* strlen(), strrchr(), strstr(), memcpy() */
+
+/* Project headers */
+#include <common.h>
+#include "alloc.h"
+
+
+/*****************************************************************************
+ *
+ * Subsystems
+ *
+ */
+
+/* Subsystems, and the source files attributed to them (the lexer also has
+   the code of the flex skeleton, output to "<stdout>") */
+static const struct {
+    const char *name;  /* Subsystem name                  */
+    const char *files; /* Source file names, space-ended  */
+} subsystems[] = {
+    { "lexer",     "chellelex.lex chellelex.c <stdout> " },
+    { "parser",    "chelleparse.y chelleparse.c commande.c " },
+    { "history",   "history.c histindex.c " },
+    { "executor",  "execcmd.c expand.c pathglob.c heredoc.c schedule.c "
+		   "limit.c " },
+    { "prompt",    "prompt.c " },
+    { "lineedit",  "lineedit.c " },
+    { "variables", "variable.c " },
+    { "pathindex", "pathindex.c " },
+    { "builtins",  "internal.c plugin.c " },
+    { "other",     "" }
+};
+
+/* Number of subsystems */
+#define SUBSYSTEM_COUNT ((int) (sizeof subsystems / sizeof *subsystems))
+
+/* Allocation statistics of each subsystem */
+static struct usage {
+    unsigned long allocs;   /* Allocations (including strdup())     */
+    unsigned long reallocs; /* Reallocations                        */
+    unsigned long frees;    /* Releases                             */
+    unsigned long bytes;    /* Bytes requested                      */
+    unsigned long live;     /* Bytes currently allocated            */
+    unsigned long peak;     /* Maximum of `live'                    */
+} usages[SUBSYSTEM_COUNT];
+
+/* Bytes currently allocated by all subsystems, and their maximum */
+static unsigned long live = 0, peak = 0;
+
+/* Subsystems of the files seen so far, by __FILE__ pointer (a string
+   literal, the same for every allocation of a source file) */
+#define FILE_MAX 64
+static struct {
+    const char *file;
+    int         subsystem;
+} files[FILE_MAX];
+static int file_count = 0;
+
+/*
+ * Get the subsystem of source file `file' (as given by __FILE__)
+ */
+static int alloc_subsystem(const char *file)
+{
+    const char *name, *found; /* Base name, where found */
+    size_t      len;          /* Its length             */
+    int         i;            /* Counter                */
+
+    for (i = 0; i < file_count; i++)
+	if (files[i].file == file)
+	    return files[i].subsystem;
+
+    name = (name = strrchr(file, '/')) != NULL ? name + 1 : file;
+    len = strlen(name);
+    for (i = 0; i < SUBSYSTEM_COUNT - 1; i++)
+	if ((found = strstr(subsystems[i].files, name)) != NULL &&
+	    (found == subsystems[i].files || found[-1] == ' ') &&
+	    found[len] == ' ')
+	    break;
+
+    if (file_count < FILE_MAX) {
+	files[file_count].file = file;
+	files[file_count++].subsystem = i;
+    }
+    return i;
+}
+
+
+/*****************************************************************************
+ *
+ * Allocated Blocks
+ *
+ */
+
+/* Allocated block, in a hash table using linear probing */
+struct block {
+    void   *ptr;       /* Block address, NULL if free slot */
+    size_t  size;      /* Its size                         */
+    int     subsystem; /* Subsystem which allocated it     */
+};
+static struct block *blocks = NULL;
+static size_t        block_size = 0, block_count = 0;
+
+/*
+ * Get the slot of block `ptr' (a free slot if it is unknown)
+ */
+static size_t alloc_slot(const void *ptr)
+{
+    size_t i; /* Slot */
+
+    i = ((size_t) ptr >> 4) * 2654435761U & (block_size - 1);
+    while (blocks[i].ptr != NULL && blocks[i].ptr != ptr)
+	i = (i + 1) & (block_size - 1);
+    return i;
+}
+
+/*
+ * Record a new block of `size' bytes allocated by `subsystem'
+ */
+static void alloc_insert(void *ptr, size_t size, int subsystem)
+{
+    struct block *old;      /* Previous table  */
+    size_t        old_size; /* Its size        */
+    size_t        i;        /* Counter         */
+    struct usage *usage;    /* Subsystem usage */
+
+    /* Keep the table at most half full */
+    if (2 * (block_count + 1) > block_size) {
+	old = blocks;
+	old_size = block_size;
+	block_size = block_size != 0 ? 2 * block_size : 1024;
+	if ((blocks = calloc(block_size, sizeof *blocks)) == NULL) {
+	    perror("allocation profiler");
+	    abort();
+	}
+	for (i = 0; i < old_size; i++)
+	    if (old[i].ptr != NULL)
+		blocks[alloc_slot(old[i].ptr)] = old[i];
+	free(old);
+    }
+
+    i = alloc_slot(ptr);
+    blocks[i].ptr = ptr;
+    blocks[i].size = size;
+    blocks[i].subsystem = subsystem;
+    block_count++;
+
+    usage = &usages[subsystem];
+    usage->bytes += size;
+    if ((usage->live += size) > usage->peak)
+	usage->peak = usage->live;
+    if ((live += size) > peak)
+	peak = live;
+}
+
+/*
+ * Forget block `ptr', getting its size; return the subsystem which
+ * allocated it, or -1 if it is unknown (allocated by a library)
+ */
+static int alloc_remove(void *ptr, size_t *size)
+{
+    size_t i, j, k;   /* Slots  */
+    int    subsystem; /* Result */
+
+    if (block_size == 0 || blocks[i = alloc_slot(ptr)].ptr == NULL)
+	return -1;
+
+    subsystem = blocks[i].subsystem;
+    *size = blocks[i].size;
+    usages[subsystem].live -= blocks[i].size;
+    live -= blocks[i].size;
+    block_count--;
+
+    /* Shift back the following blocks which cannot be found otherwise */
+    for (j = i;;) {
+	blocks[i].ptr = NULL;
+	do {
+	    j = (j + 1) & (block_size - 1);
+	    if (blocks[j].ptr == NULL)
+		return subsystem;
+	    k = ((size_t) blocks[j].ptr >> 4) * 2654435761U &
+		(block_size - 1);
+	} while (i <= j ? i < k && k <= j : i < k || k <= j);
+	blocks[i] = blocks[j];
+	i = j;
+    }
+}
+
+
+/*****************************************************************************
+ *
+ * Allocation Functions
+ *
+ */
+
+/*
+ * Profiled malloc()
+ */
+void *alloc_malloc(size_t size, const char *file)
+{
+    void *ptr;                                /* Allocated block */
+    int   subsystem = alloc_subsystem(file); /* Allocating one  */
+
+    if ((ptr = malloc(size)) != NULL) {
+	usages[subsystem].allocs++;
+	alloc_insert(ptr, size, subsystem);
+    }
+    return ptr;
+}
+
+/*
+ * Profiled calloc()
+ */
+void *alloc_calloc(size_t count, size_t size, const char *file)
+{
+    void *ptr;                                /* Allocated block */
+    int   subsystem = alloc_subsystem(file); /* Allocating one  */
+
+    if ((ptr = calloc(count, size)) != NULL) {
+	usages[subsystem].allocs++;
+	alloc_insert(ptr, count * size, subsystem);
+    }
+    return ptr;
+}
+
+/*
+ * Profiled realloc(); the block is then attributed to the subsystem
+ * reallocating it
+ */
+void *alloc_realloc(void *ptr, size_t size, const char *file)
+{
+    void  *new;                                /* Reallocated block */
+    int    subsystem = alloc_subsystem(file);  /* Reallocating one  */
+    int    old = -1;                           /* The one of `ptr'  */
+    size_t old_size;                           /* Size of `ptr'     */
+
+    if (ptr != NULL)
+	old = alloc_remove(ptr, &old_size);
+    if ((new = realloc(ptr, size)) == NULL && size != 0) {
+	/* `ptr' is left as it was */
+	if (old != -1) {
+	    alloc_insert(ptr, old_size, old);
+	    usages[old].bytes -= old_size;
+	}
+	return NULL;
+    }
+    if (new != NULL) {
+	if (ptr != NULL)
+	    usages[subsystem].reallocs++;
+	else
+	    usages[subsystem].allocs++;
+	alloc_insert(new, size, subsystem);
+    }
+    return new;
+}
+
+/*
+ * Profiled strdup()
+ */
+char *alloc_strdup(const char *str, const char *file)
+{
+    char   *copy; /* Copy of `str' */
+    size_t  size; /* Its size      */
+
+    size = strlen(str) + 1;
+    if ((copy = alloc_malloc(size, file)) != NULL)
+	memcpy(copy, str, size);
+    return copy;
+}
+
+/*
+ * Profiled free()
+ */
+void alloc_free(void *ptr)
+{
+    int    subsystem; /* Subsystem which allocated `ptr' */
+    size_t size;      /* Size of `ptr'                  */
+
+    if (ptr != NULL && (subsystem = alloc_remove(ptr, &size)) != -1)
+	usages[subsystem].frees++;
+    free(ptr);
+}
+
+
+/*****************************************************************************
+ *
+ * Report
+ *
+ */
+
+/*
+ * Print the allocations of each subsystem; bytes still allocated at exit
+ * are leaked (or freed by the system)
+ */
+void alloc_report(FILE *file)
+{
+#ifdef HAS_ALLOC_PROFILE
+    struct usage total; /* Sum of all subsystems */
+    int          i;     /* Counter               */
+
+    memset(&total, 0, sizeof total);
+    fprintf(file, "%-10s %10s %10s %10s %12s %10s %10s\n", "subsystem",
+	    "allocs", "reallocs", "frees", "bytes", "live", "peak");
+    for (i = 0; i < SUBSYSTEM_COUNT; i++) {
+	fprintf(file, "%-10s %10lu %10lu %10lu %12lu %10lu %10lu\n",
+		subsystems[i].name, usages[i].allocs, usages[i].reallocs,
+		usages[i].frees, usages[i].bytes, usages[i].live,
+		usages[i].peak);
+	total.allocs += usages[i].allocs;
+	total.reallocs += usages[i].reallocs;
+	total.frees += usages[i].frees;
+	total.bytes += usages[i].bytes;
+    }
+    fprintf(file, "%-10s %10lu %10lu %10lu %12lu %10lu %10lu\n", "total",
+	    total.allocs, total.reallocs, total.frees, total.bytes, live,
+	    peak);
+#else
+    fputs("allocation profiling is not compiled in (see HAS_ALLOC_PROFILE "
+	  "in config/flags.mk)\n", file);
+#endif
+}
+
+/* End of file */
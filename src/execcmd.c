@@ -33,13 +33,15 @@
 #define _POSIX_SOURCE /* For kill() */
 
 /* Standard C headers */
-#include <stdio.h>  /* std*, *printf(), *puts(), perror() */
-#include <stdlib.h> /* NULL, malloc(), free()             */
-#include <string.h> /* str*cpy(), str*cmp()               */
+#include <stdio.h>  /* std*, *printf(), *puts(), perror()         */
+#include <stdlib.h> /* NULL, malloc(), calloc(), realloc(), free() */
+#include <string.h> /* str*cpy(), str*cmp(), strchr()              */
+#include <errno.h>  /* errno                                       */
 
 /* Standard UN*X headers */
 #include <sys/types.h>
 #include <sys/wait.h> /* wait(), waitpid()                              */
+#include <sys/stat.h> /* fstat(), S_ISDIR()                             */
 #include <unistd.h>   /* close(), dup(), dup2(), pipe(), fork(), exec() */
 #include <fcntl.h>    /* open(), creat(), fcntl()                       */
 #include <signal.h>   /* signal(), kill()                               */
@@ -47,8 +49,18 @@
 /* Project headers */
 #include <command.h>
 #include <common.h>
-#include "main.h"
+#include "shell.h"
 #include "internal.h"
+#include "pathindex.h"
+#include "variable.h"
+#include "prompt.h"
+#include "expand.h"
+#include "heredoc.h"
+#include "schedule.h"
+#include "limit.h"
+#include "metrics.h"
+#include "jobqueue.h"
+#include "optimize.h"
 #include "execcmd.h"
 
 
@@ -58,23 +70,20 @@
  *
  */
 
-/* Currently processed command */
-command_t *current_command = NULL;
+/* Environment of executed programs */
+extern char **environ;
 
-/* Running processes */
-int    proc_count = 0;   /* Number of running pipeline processes */
-pid_t *processes = NULL; /* Array of pipeline processes          */
+/* Context of the shell itself */
+static exec_context_t shell_context = {
+    NULL, 0, NULL, 0, 0, { -1, -1, -1, -1 }, EXEC_SEQ, 0, -1, { 0 }, 0,
+    NULL, 0, 1, NULL, -1
+};
 
-/* Backup file descriptors (3), plus one used for the pipeline */
-static int backup_fd[4] = { -1, -1, -1, -1 };
+/* Current execution context */
+exec_context_t *exec_ctx = &shell_context;
 
-/* Execution mode: lets a single command, not pipelined, to be exec*()'ed
-   without forking in a background "subshell" */
-static enum { EXEC_SEQ, EXEC_BACK, EXEC_SINGLE1, EXEC_SINGLE2 } exec_mode;
-
-/* Return code */
-static int   ret_code = 0; /* The returned code                       */
-static pid_t ret_pid = -1; /* PID of the processus returning the code */
+/* Minimum room for each read of a command substitution output */
+#define CAPTURE_READ 65536
 
 
 /*****************************************************************************
@@ -91,7 +100,7 @@ static void backup_fds(void)
     int i;
 
     for (i = 0; i < 3; i++)
-	fcntl((backup_fd[i] = dup(i)), F_SETFD, FD_CLOEXEC);
+	fcntl((exec_ctx->backup_fd[i] = dup(i)), F_SETFD, FD_CLOEXEC);
 }
 
 /*
@@ -102,10 +111,10 @@ static void restore_fds(void)
     int i;
 
     for (i = 0; i < 3; i++)
-	if (backup_fd[i] != -1) {
-	    dup2(backup_fd[i], i);
-	    close(backup_fd[i]);
-	    backup_fd[i] = -1;
+	if (exec_ctx->backup_fd[i] != -1) {
+	    dup2(exec_ctx->backup_fd[i], i);
+	    close(exec_ctx->backup_fd[i]);
+	    exec_ctx->backup_fd[i] = -1;
 	}
 }
 
@@ -117,8 +126,8 @@ void close_fds(void)
     int i;
 
     for (i = 0; i < 4; i++)
-	if (backup_fd[i] != -1)
-	    close(backup_fd[i]);
+	if (exec_ctx->backup_fd[i] != -1)
+	    close(exec_ctx->backup_fd[i]);
 }
 
 /*
@@ -130,11 +139,12 @@ static int free_fd(int fd)
 
     if (fd != -1)
 	for (i = 0; i < 4; i++)
-	    if (fd == backup_fd[i]) {
+	    if (fd == exec_ctx->backup_fd[i]) {
 		if ((fd = dup(fd)) == -1)
 		    return -1;
-		close(backup_fd[i]);
-		backup_fd[i] = fd;
+		fcntl(fd, F_SETFD, FD_CLOEXEC);
+		close(exec_ctx->backup_fd[i]);
+		exec_ctx->backup_fd[i] = fd;
 		break;
 	    }
 
@@ -142,18 +152,29 @@ static int free_fd(int fd)
 }
 
 /*
- * Close descriptors created for a command (excluding backups)
+ * Close the descriptors beyond the standard ones created by redirections
+ * from `redir' up to `stop' (excluded), leaving backups and any other
+ * descriptor of the shell alone
  */
-static void clean_fds(int max)
+static void clean_fds(redirection_t *redir, redirection_t *stop)
 {
-    int i, fd;
-
-    for (fd = 3; fd <= max; fd++)
-	for (i = 0; i < 4; i++) {
-	    if (backup_fd[i] == fd)
-		break;
+    int i, fd; /* Counter, created descriptor */
+
+    for (; redir != stop; redir = redir->next) {
+	if (redir->type == RFILE)
+	    fd = redir->u.redir_file->desc;
+	else if (redir->u.redir_desc->type == DUP ||
+		 redir->u.redir_desc->type == DUPCLOSE)
+	    fd = redir->u.redir_desc->dst;
+	else
+	    continue;
+	if (fd < 3)
+	    continue;
+	for (i = 0; i < 4 && exec_ctx->backup_fd[i] != fd; i++)
+	    ;
+	if (i == 4)
 	    close(fd);
-	}
+    }
 }
 
 
@@ -179,6 +200,11 @@ static pid_t exec_simple(simple_t *simple)
     int      count;    /* Argument count         */
     char   **argv;     /* Argument table         */
     pid_t    pid = -1; /* PID of created process */
+    const char *path;  /* Executable full name   */
+    char   **envp;     /* Program environment    */
+    char    *value;    /* Expanded assignment    */
+    int      i;        /* Counter                */
+    unsigned long start; /* Fork start time      */
 
     /* Upon entry to this function, some file descriptors are open beside
        those open by the command: the backup descriptors for standard input
@@ -192,55 +218,106 @@ static pid_t exec_simple(simple_t *simple)
 
     switch (simple->type) {
     case SIMPLE:
-	/* Count the word number */
-	count = 0;
-	for (word = simple->u.words; word; word = word->next)
-	    count++;
-	if (count == 0) {
+	if (simple->u.words == NULL) {
 	    fputs("Error: empty command.\n", stderr);
 	    lish_exit(RET_ERROR);
 	}
 
-	/* Allocate memory for the `argv' array */
-	if ((argv = malloc((count + 1) * sizeof (char *))) == NULL) {
-	    fputs("Error: no more memory.\n", stderr);
-	    lish_exit(RET_ERROR);
+	/* A command made of assignments only sets shell variables */
+	for (word = simple->u.words; word; word = word->next)
+	    if (!var_assignment(word->word))
+		break;
+	if (word == NULL) {
+	    exec_ctx->ret_code = 0;
+	    for (word = simple->u.words; word; word = word->next)
+		if ((value = expand_word(word->word)) != NULL)
+		    var_assign(value, 0);
+		else
+		    exec_ctx->ret_code = RET_ERROR;
+	    prompt_invalidate(PROMPT_ENV);
+	    break;
 	}
 
-	/* Fill the `argv' array */
-	count = 0;
-	for (word = simple->u.words; word; word = word->next) {
-	    if (word->word[0] == '$') {
-		if ((argv[count] = getenv(word->word + 1)) == NULL)
-		    argv[count] = "";
-	    } else
-		argv[count] = word->word;
-	    count++;
+	/* Expand words into the `argv' array; nothing is executed if they
+	   all expand to nothing, the status being that of the last command
+	   substitution, if any */
+	exec_ctx->ret_code = 0;
+	if ((argv = expand_words(simple->u.words, &count)) == NULL) {
+	    exec_ctx->ret_code = RET_ERROR;
+	    break;
 	}
-	argv[count] = NULL;
-
-	/* Execute internal command or do the fork and execute program */
-	if ((ret_code = exec_internal(count, argv)) == -1 &&
-	    (exec_mode == EXEC_SINGLE2 || (pid = fork()) == 0)) {
-	    /* Execute program */
-	    execvp(argv[0], argv);
-	    lish_perror(argv[0]);
-	    free(argv);
-	    lish_exit(RET_ERROR);
+	if (count == 0)
+	    break;
+
+	/* A `sched' prefix sets the scheduling of this stage and the next
+	   ones of the pipeline */
+	if (!strcmp(argv[0], "sched")) {
+	    if ((i = schedule_parse(count, argv, &exec_ctx->schedule)) == -1) {
+		exec_ctx->ret_code = RET_ERROR;
+		break;
+	    }
+	    argv += i;
+	    count -= i;
 	}
 
-	free(argv);
+	/* Execute internal command or do the fork and execute program,
+	   found in the executable index (looked up before forking, so that
+	   the index is kept) or by execvp() if it is not there */
+	if ((exec_ctx->ret_code = exec_internal(count, argv)) != -1)
+	    /* Output goes to the current standard output (maybe a pipe) */
+	    fflush(stdout);
+	else {
+	    path = strchr(argv[0], '/') == NULL ?
+		pathindex_lookup(argv[0]) : NULL;
+	    if (path == NULL && strchr(argv[0], '/') == NULL)
+		METRIC_COUNT(METRIC_PATH_MISSES);
+	    envp = var_environ();
+	    if (limit_job_start() == -1) {
+		exec_ctx->ret_code = RET_ERROR;
+		break;
+	    }
+	    start = metrics_clock();
+	    if (exec_ctx->exec_mode == EXEC_SINGLE2 || (pid = fork()) == 0) {
+		schedule_apply(&exec_ctx->schedule, exec_ctx->stage);
+		limit_job_enter();
+
+		/* Execute program with exported variables */
+		if (path != NULL)
+		    execve(path, argv, envp);
+		environ = envp;
+		execvp(argv[0], argv);
+		lish_perror(argv[0]);
+		lish_exit(RET_ERROR);
+	    }
+	    if (pid != -1) {
+		metrics_observe(METRIC_SPAWN, start);
+		METRIC_COUNT(METRIC_FORKS);
+		METRIC_COUNT(METRIC_EXECS);
+	    }
+	}
 	break;
 
     case SUBSHELL:
 	/* Do the fork and execute subshell */
-	if (exec_mode == EXEC_SINGLE2 || (pid = fork()) == 0) {
+	if (limit_job_start() == -1) {
+	    exec_ctx->ret_code = RET_ERROR;
+	    break;
+	}
+	start = metrics_clock();
+	if (exec_ctx->exec_mode == EXEC_SINGLE2 || (pid = fork()) == 0) {
+	    schedule_apply(&exec_ctx->schedule, exec_ctx->stage);
+	    limit_job_enter();
+
 	    /* Close descriptors that are useless to the child */
 	    close_fds();
 
 	    /* Execute subshell sequence */
 	    lish_exit(exec_sequence(simple->u.command->sequence));
 	}
+	if (pid != -1) {
+	    metrics_observe(METRIC_SPAWN, start);
+	    METRIC_COUNT(METRIC_FORKS);
+	}
     }
 
     return pid;
@@ -253,9 +330,11 @@ static pid_t exec_redirected(redirected_t *redirected)
 {
     redirection_t *redir;             /* Current redirection              */
     redir_file_t  *redir_file;        /* File redirection                 */
+    const char    *file;              /* Expanded file name               */
     redir_desc_t  *redir_desc;        /* Descriptor redirection           */
-    int            fd = 0, maxfd = 0; /* Created file descriptor, maximum */
+    int            fd = 0;            /* Created file descriptor          */
     int            mode;              /* Descriptor access mode           */
+    struct stat    st;                /* Redirected file information      */
     pid_t          pid;               /* Created process PID              */
 
     for (redir = redirected->redirection; redir; redir = redir->next)
@@ -263,30 +342,66 @@ static pid_t exec_redirected(redirected_t *redirected)
 	case RFILE:
 	    /* File redirection */
 	    redir_file = redir->u.redir_file;
+	    if (redir_file->type == HEREDOC ||
+		redir_file->type == HEREDOCTAB)
+		file = expand_string(redir_file->document != NULL ?
+				     redir_file->document : "");
+	    else
+		file = expand_word(redir_file->file);
+	    if (file == NULL) {
+		clean_fds(redirected->redirection, redir);
+		exec_ctx->ret_code = RET_ERROR;
+		return -1;
+	    }
 
-	    /* Open file */
+	    /* Open file (or here-document) */
 	    switch (redir_file->type) {
 	    case IN:
-		fd = open(redir_file->file, O_RDONLY);
+		fd = open(file, O_RDONLY);
 		break;
 	    case OUT:
-		fd = creat(redir_file->file, 0666);
+		fd = creat(file, 0666);
 		break;
 	    case APP:
-		fd = open(redir_file->file, O_CREAT | O_WRONLY | O_APPEND,
-			  0666);
+		fd = open(file, O_CREAT | O_WRONLY | O_APPEND, 0666);
+		break;
+	    case HEREDOC:
+	    case HEREDOCTAB:
+		fd = heredoc_open(file, strlen(file), 0);
+		file = "here-document";
+		break;
+	    case HERESTR:
+		fd = heredoc_open(file, strlen(file), 1);
+		file = "here-string";
+		break;
+	    case CATIN:
+		/* Input of a rewritten `cat FILE | cmd': a file which cat
+		   could not read is reported as cat would, and the command
+		   reads nothing */
+		if ((fd = open(file, O_RDONLY)) != -1 &&
+		    fstat(fd, &st) == 0 && S_ISDIR(st.st_mode)) {
+		    close(fd);
+		    fd = -1;
+		    errno = EISDIR;
+		}
+		if (fd == -1) {
+		    fprintf(stderr, "cat: %s: %s\n", file, strerror(errno));
+		    fd = open("/dev/null", O_RDONLY);
+		}
 	    }
 
 	    /* Replace destination descriptor by this file descriptor */
-	    if (free_fd(redir_file->desc) == -1 ||
+	    if (fd == -1 || free_fd(redir_file->desc) == -1 ||
 		dup2(fd, redir_file->desc) == -1) {
-		lish_perror(redir_file->file);
-		ret_code = RET_ERROR;
+		if (fd != -1 && fd != redir_file->desc)
+		    close(fd);
+		lish_perror(file);
+		clean_fds(redirected->redirection, redir);
+		exec_ctx->ret_code = RET_ERROR;
 		return 0;
 	    }
-	    close(fd);
-	    if (redir_file->desc > maxfd)
-		maxfd = redir_file->desc;
+	    if (fd != redir_file->desc)
+		close(fd);
 	    break;
 
 	case DESCRIPTOR:
@@ -297,7 +412,8 @@ static pid_t exec_redirected(redirected_t *redirected)
 	    if ((mode = fcntl(redir_desc->src, F_GETFL)) == -1) {
 		fprintf(stderr, "%s: %d: ", exe_name, redir_desc->src);
 		perror(NULL);
-		ret_code = RET_ERROR;
+		clean_fds(redirected->redirection, redir);
+		exec_ctx->ret_code = RET_ERROR;
 		return 0;
 	    }
 
@@ -306,7 +422,8 @@ static pid_t exec_redirected(redirected_t *redirected)
 	    if (mode == (redir_desc->mode == READ ? O_WRONLY : O_RDONLY)) {
 		fprintf(stderr, "%s: %d: wrong access mode\n", exe_name,
 			redir_desc->src);
-		ret_code = RET_ERROR;
+		clean_fds(redirected->redirection, redir);
+		exec_ctx->ret_code = RET_ERROR;
 		return 0;
 	    }
 
@@ -316,7 +433,8 @@ static pid_t exec_redirected(redirected_t *redirected)
 		dup2(redir_desc->src, redir_desc->dst) == -1)) {
 		fprintf(stderr, "%s: %d: ", exe_name, redir_desc->dst);
 		perror(NULL);
-		ret_code = RET_ERROR;
+		clean_fds(redirected->redirection, redir);
+		exec_ctx->ret_code = RET_ERROR;
 		return 0;
 	    }
 
@@ -330,7 +448,7 @@ static pid_t exec_redirected(redirected_t *redirected)
     pid = exec_simple(redirected->simple);
 
     /* Clean descriptors */
-    clean_fds(maxfd);
+    clean_fds(redirected->redirection, NULL);
 
     return pid;
 }
@@ -347,36 +465,41 @@ static int exec_pipeline(pipeline_t *pipeline)
     int         fd, pipe_fd[2][2]; /* Pipeline file descriptors     */
     pipeline_t *pipe_count;        /* Used for command counting     */
 
-    if (exec_mode == EXEC_SINGLE1 && !pipeline->next)
-	exec_mode = EXEC_SINGLE2;
+    /* A job with its own cgroup is waited for, to remove the cgroup */
+    if (exec_ctx->exec_mode == EXEC_SINGLE1 && !pipeline->next &&
+	!limit_job_wanted())
+	exec_ctx->exec_mode = EXEC_SINGLE2;
 
     /* Count commands in pipeline and allocate enough memory */
     for (pipe_count = pipeline; pipe_count; pipe_count = pipe_count->next)
 	count++;
-    if ((processes = malloc(count * sizeof (pid_t))) == NULL) {
+    if ((exec_ctx->processes = malloc(count * sizeof (pid_t))) == NULL) {
 	lish_perror("error");
 	return RET_ERROR;
     }
-    proc_count = 0;
-    ret_code = RET_ERROR;
+    exec_ctx->proc_count = 0;
+    exec_ctx->ret_code = RET_ERROR;
 
     /* Save standard input and output descriptors */
     backup_fds();
 
     /* Launch each simple command after setting pipelines */
     count = 0;
+    schedule_clear(&exec_ctx->schedule);
     killed = 0;
-    signal(SIGCHLD, SIG_DFL);
+    if (exec_ctx->shell)
+	signal(SIGCHLD, SIG_DFL);
     while (pipeline) {
-	/* Replace standard input by pipeline input */
+	/* Replace standard input by pipeline input (kept as a backup, which
+	   a redirection of the previous command may have moved) */
 	if (count > 0) {
-	    if (dup2((fd = pipe_fd[(count - 1) % 2][0]), STDIN_FILENO)
-		== -1) {
+	    if (dup2((fd = exec_ctx->backup_fd[3]), STDIN_FILENO) == -1) {
 		close(fd);
 		lish_perror("cannot duplicate file descriptor");
 		lish_exit(RET_ERROR);
 	    }
 	    close(fd);
+	    exec_ctx->backup_fd[3] = -1;
 	}
 
 	if (pipeline->next) {
@@ -395,33 +518,45 @@ static int exec_pipeline(pipeline_t *pipeline)
 	    close(fd);
 
 	    /* Close the descriptor used as the input of the next command */
-	    fcntl((backup_fd[3] = pipe_fd[count % 2][0]),
+	    fcntl((exec_ctx->backup_fd[3] = pipe_fd[count % 2][0]),
 		  F_SETFD, FD_CLOEXEC);
 	} else
-	    /* Restore standard input */
-	    dup2(backup_fd[STDOUT_FILENO], STDOUT_FILENO);
+	    /* Restore standard output */
+	    dup2(exec_ctx->backup_fd[STDOUT_FILENO], STDOUT_FILENO);
+
+	/* Restore error output, which a redirection of the previous command
+	   may have changed (like `2>&1' to the pipe, which would keep the
+	   next command from ever reading end of file) */
+	if (count > 0)
+	    dup2(exec_ctx->backup_fd[STDERR_FILENO], STDERR_FILENO);
 
 	/* Execute simple command with redirections */
-	if ((ret_pid = exec_redirected(pipeline->redirected)) > 0)
-	    processes[proc_count++] = ret_pid;
-	else if (ret_pid == 0)
+	exec_ctx->stage = count;
+	METRIC_COUNT(METRIC_STAGES);
+	if ((exec_ctx->ret_pid = exec_redirected(pipeline->redirected)) > 0)
+	    exec_ctx->processes[exec_ctx->proc_count++] = exec_ctx->ret_pid;
+	else if (exec_ctx->ret_pid == 0)
 	    lish_perror(NULL);
 
-	fcntl(backup_fd[3], F_SETFD, 0);
+	fcntl(exec_ctx->backup_fd[3], F_SETFD, 0);
 	count++;
 	pipeline = pipeline->next;
     }
 
     /* Restore standard input and output descriptors */
     restore_fds();
-    backup_fd[3] = -1;
-
-    /* Wait for children to terminate and get return code of the last one */
-    while (proc_count != 0) {
-	if ((pid = waitpid(-1, &status, WUNTRACED)) == -1)
+    exec_ctx->backup_fd[3] = -1;
+
+    /* Wait for children to terminate and get return code of the last one
+       (the shell reaps background jobs meanwhile, but a host program may
+       have children of its own, not to be waited for) */
+    while (exec_ctx->proc_count != 0) {
+	if ((pid = waitpid(exec_ctx->shell ? -1 : exec_ctx->processes[0],
+			   &status, WUNTRACED)) == -1)
 	    break;
-	if (pid == ret_pid)
-	    ret_code = WIFEXITED(status) ? WEXITSTATUS(status) : RET_ERROR;
+	if (pid == exec_ctx->ret_pid)
+	    exec_ctx->ret_code = WIFEXITED(status) ? WEXITSTATUS(status) :
+		WIFSIGNALED(status) ? 128 + WTERMSIG(status) : RET_ERROR;
 	if (WIFSTOPPED(status)) {
 	    /* Put in background stopped process */
 	    kill(pid, SIGCONT);
@@ -429,18 +564,27 @@ static int exec_pipeline(pipeline_t *pipeline)
 	}
 
 	/* Check if it is a command of the current pipeline */
-	for (i = 0; i < proc_count; i++)
-	    if (processes[i] == pid)
+	for (i = 0; i < exec_ctx->proc_count; i++)
+	    if (exec_ctx->processes[i] == pid)
 		break;
-	if (i < proc_count) {
-	    while (++i < proc_count)
-		processes[i - 1] = processes[i];
-	    proc_count--;
-	} else if (!WIFSTOPPED(status))
+	if (i < exec_ctx->proc_count) {
+	    if (WIFSIGNALED(status))
+		limit_job_report(pid, status);
+	    while (++i < exec_ctx->proc_count)
+		exec_ctx->processes[i - 1] = exec_ctx->processes[i];
+	    exec_ctx->proc_count--;
+	} else if (!WIFSTOPPED(status)) {
 	    /* It isn't, so display PID and return code */
-	    printf("[%d] %d\n", pid, ret_code);
+	    printf("[%d] %d\n", pid, exec_ctx->ret_code);
+	    jobqueue_done();
+	}
     }
-    sig_chld(SIGCHLD);
+    if (exec_ctx->shell)
+	sig_chld(SIGCHLD);
+    limit_job_end();
+
+    /* Background jobs which terminated may let queued ones run */
+    jobqueue_run();
 
     /* Imitate the behaviour of bash */
     if (killed != 0) {
@@ -448,8 +592,10 @@ static int exec_pipeline(pipeline_t *pipeline)
 	killed = 0;
     }
 
-    free(processes);
-    return ret_code;
+    free(exec_ctx->processes);
+    exec_ctx->processes = NULL;
+    schedule_clear(&exec_ctx->schedule);
+    return exec_ctx->ret_code;
 }
 
 /*
@@ -459,8 +605,8 @@ static int exec_conditional(conditional_t *conditional)
 {
     int ret = 0; /* Return code */
 
-    if (exec_mode == EXEC_BACK && !conditional->next)
-	exec_mode = EXEC_SINGLE1;
+    if (exec_ctx->exec_mode == EXEC_BACK && !conditional->next)
+	exec_ctx->exec_mode = EXEC_SINGLE1;
 
     /* Execute each command if appropriate */
     while (conditional) {
@@ -468,7 +614,8 @@ static int exec_conditional(conditional_t *conditional)
 	    (conditional->cond_op == OR  && ret == 0))
 	    break;
 
-	ret = exec_pipeline(conditional->pipeline);
+	/* $? follows each pipeline */
+	ret = exec_ctx->exit_status = exec_pipeline(conditional->pipeline);
 	conditional = conditional->next;
     }
 
@@ -476,67 +623,246 @@ static int exec_conditional(conditional_t *conditional)
 }
 
 /*
- * Execute a sequence command
+ * Launch a conditional command set in the background; return 0, or
+ * RET_ERROR if it could not be launched
  */
-static int exec_sequence(sequence_t *sequence)
+static int exec_background(conditional_t *conditional)
 {
-    int   ret = 0;    /* Return code               */
     pid_t pid;        /* Created process PID       */
     int   pipe_fd[2]; /* Pipeline file descriptors */
 
+    /* Create a pipe for the commands to have en empty input */
+    if (pipe(pipe_fd) == -1) {
+	lish_perror("cannot create pipe");
+	lish_exit(RET_ERROR);
+    }
+
+    /* The job counts from now on, so that a failure frees its slot */
+    exec_ctx->jobs++;
+    fflush(stdout);
+    METRIC_COUNT(METRIC_FORKS);
+    if ((pid = fork()) == 0) {
+	/* Create a new session (useful for SIGINT/SIGQUIT) */
+	setsid();
+	close(pipe_fd[1]);
+
+	/* Replace standard input by pipe input */
+	if (dup2(pipe_fd[0], STDIN_FILENO) == -1) {
+	    lish_perror("cannot duplicate file descriptor");
+	    lish_exit(RET_ERROR);
+	}
+	close(pipe_fd[0]);
+
+	/* Execute conditional command set */
+	exec_ctx->exec_mode = EXEC_BACK;
+	lish_exit(exec_conditional(conditional));
+    }
+
+    /* Close pipe */
+    close(pipe_fd[0]);
+    close(pipe_fd[1]);
+
+    /* Print created process PID */
+    if (pid == -1) {
+	perror("Could not fork");
+	jobqueue_done();
+	return RET_ERROR;
+    }
+    printf("[%d]\n", pid);
+    return 0;
+}
+
+/*
+ * Execute a sequence command
+ */
+static int exec_sequence(sequence_t *sequence)
+{
+    int ret = 0; /* Return code */
+
     while (sequence) {
 	switch (sequence->seq_op) {
 	case SEQ:
-	    exec_mode = EXEC_SEQ;
+	    exec_ctx->exec_mode = EXEC_SEQ;
 
 	    /* Execute conditional command set */
 	    ret = exec_conditional(sequence->conditional);
 	    break;
 
 	case BACK:
-	    exec_mode = EXEC_BACK;
+	    /* Beyond the limits, the job waits its turn in the queue, which
+	       takes it from the command */
+	    if (jobqueue_start())
+		ret = exec_background(sequence->conditional);
+	    else {
+		jobqueue_add(sequence->conditional);
+		sequence->conditional = NULL;
+		ret = 0;
+	    }
+	    exec_ctx->exit_status = ret;
+	}
 
-	    /* Create a pipe for the commands to have en empty input */
-	    if (pipe(pipe_fd) == -1) {
-		lish_perror("cannot create pipe");
+	/* Next conditional command set */
+	sequence = sequence->next;
+    }
+
+    return ret;
+}
+
+/*****************************************************************************
+ *
+ * Command Substitution
+ *
+ */
+
+/*
+ * Read everything from `fd' into the capture buffer; return its length
+ */
+static size_t capture_read(int fd)
+{
+    exec_context_t *ctx = exec_ctx; /* Current context */
+    size_t          len = 0;        /* Read length     */
+    ssize_t         n;              /* Read characters */
+
+    for (;;) {
+	/* Always read in large chunks */
+	if (ctx->capture_size - len < CAPTURE_READ) {
+	    ctx->capture_size = ctx->capture_size * 2 > len + CAPTURE_READ ?
+		ctx->capture_size * 2 : len + CAPTURE_READ;
+	    if ((ctx->capture = realloc(ctx->capture, ctx->capture_size))
+		== NULL) {
+		lish_perror("fatal error");
 		lish_exit(RET_ERROR);
 	    }
+	}
 
-	    if ((pid = fork()) == 0) {
-		/* Create a new session (useful for SIGINT/SIGQUIT) */
-		setsid();
-		close(pipe_fd[1]);
+	if ((n = read(fd, ctx->capture + len, ctx->capture_size - len)) > 0)
+	    len += n;
+	else if (n == 0 || errno != EINTR)
+	    break;
+    }
 
-		/* Replace standard input by pipe input */
-		if (dup2(pipe_fd[0], STDIN_FILENO) == -1) {
-		    lish_perror("cannot duplicate file descriptor");
-		    lish_exit(RET_ERROR);
-		}
-		close(pipe_fd[0]);
+    return len;
+}
 
-		/* Execute conditional command set */
-		lish_exit(exec_conditional(sequence->conditional));
-	    }
+/*
+ * Run a single internal command without side effects on the shell in the
+ * shell process, its output going to an anonymous file (in memory on Linux)
+ */
+static const char *substitute_internal(words_t *words, size_t *len)
+{
+    char **argv;     /* Argument table           */
+    int    count;    /* Argument count           */
+    int    fd;       /* Anonymous file           */
+    int    save_fd;  /* Saved standard output    */
+
+    if ((argv = expand_words(words, &count)) == NULL)
+	return NULL;
+
+    fflush(stdout);
+    if ((fd = heredoc_file()) == -1) {
+	lish_perror("cannot create temporary file");
+	return NULL;
+    }
+    if ((save_fd = dup(STDOUT_FILENO)) == -1 ||
+	dup2(fd, STDOUT_FILENO) == -1) {
+	lish_perror("cannot duplicate file descriptor");
+	lish_exit(RET_ERROR);
+    }
 
-	    /* Close pipe */
-	    close(pipe_fd[0]);
-	    close(pipe_fd[1]);
+    exec_ctx->exit_status = exec_ctx->ret_code = exec_internal(count, argv);
+    fflush(stdout);
 
-	    /* Print created process PID */
-	    if (pid != -1) {
-		printf("[%d]\n", pid);
-		ret = 0;
-	    } else {
-		perror("Could not fork");
-		ret = RET_ERROR;
-	    }
+    dup2(save_fd, STDOUT_FILENO);
+    close(save_fd);
+    lseek(fd, 0, SEEK_SET);
+    *len = capture_read(fd);
+    close(fd);
+    return exec_ctx->capture;
+}
+
+/*
+ * Run a command substitution and return its output (valid until the next
+ * substitution), of `*len' characters, or NULL if it could not be run
+ */
+const char *exec_substitute(char *text, size_t *len)
+{
+    command_t    *command;    /* Parsed command            */
+    sequence_t   *sequence;   /* Its sequence              */
+    pipeline_t   *pipeline;   /* Its only pipeline         */
+    const char   *output;     /* Captured output           */
+    int           pipe_fd[2]; /* Pipeline file descriptors */
+    int           i, status;  /* Counter, child status     */
+    int           flags;      /* Internal command flags    */
+    pid_t         pid;        /* Created process PID       */
+
+    if ((command = exec_parse(text)) == NULL)
+	return NULL;
+    optimize_command(command, NULL);
+
+    /* A single internal command without side effects is run without
+       forking */
+    sequence = command->sequence;
+    pipeline = sequence->conditional->pipeline;
+    if (!sequence->next && sequence->seq_op == SEQ &&
+	!sequence->conditional->next && !pipeline->next &&
+	!pipeline->redirected->redirection &&
+	pipeline->redirected->simple->type == SIMPLE &&
+	(flags = internal_flags(pipeline->redirected->simple->u.words->word))
+	!= -1 && (flags & INTERNAL_PURE)) {
+	output = substitute_internal(pipeline->redirected->simple->u.words,
+				     len);
+	free_command(command);
+	return output;
+    }
+
+    /* Otherwise, it is run in a subshell writing to a pipe */
+    if (pipe(pipe_fd) == -1) {
+	lish_perror("cannot create pipe");
+	free_command(command);
+	return NULL;
+    }
+    fflush(stdout);
+    METRIC_COUNT(METRIC_FORKS);
+    if ((pid = fork()) == 0) {
+	close(pipe_fd[0]);
+	if (dup2(pipe_fd[1], STDOUT_FILENO) == -1) {
+	    lish_perror("cannot duplicate file descriptor");
+	    lish_exit(RET_ERROR);
 	}
+	close(pipe_fd[1]);
 
-	/* Next conditional command set */
-	sequence = sequence->next;
+	/* Forget the descriptors of the command being expanded */
+	close_fds();
+	for (i = 0; i < 4; i++)
+	    exec_ctx->backup_fd[i] = -1;
+
+	/* A last (or single) command is exec*()'ed without forking */
+	exec_ctx->current_command = command;
+	if (!sequence->next && sequence->seq_op == SEQ) {
+	    exec_ctx->exec_mode = EXEC_BACK;
+	    lish_exit(exec_conditional(sequence->conditional));
+	}
+	lish_exit(exec_sequence(sequence));
+    }
+    close(pipe_fd[1]);
+    free_command(command);
+    if (pid == -1) {
+	lish_perror("cannot fork");
+	close(pipe_fd[0]);
+	return NULL;
     }
 
-    return ret;
+    *len = capture_read(pipe_fd[0]);
+    close(pipe_fd[0]);
+    while (waitpid(pid, &status, 0) == -1 && errno == EINTR)
+	;
+
+    /* $? (and the status of a command without a name) is the one of the
+       substitution */
+    exec_ctx->exit_status = exec_ctx->ret_code = WIFEXITED(status) ?
+	WEXITSTATUS(status) : WIFSIGNALED(status) ?
+	128 + WTERMSIG(status) : RET_ERROR;
+    return exec_ctx->capture;
 }
 
 
@@ -546,6 +872,23 @@ static int exec_sequence(sequence_t *sequence)
  *
  */
 
+/*
+ * Parse a command line, measuring it; return NULL on syntax error
+ */
+command_t *exec_parse(char *text)
+{
+    command_t    *command; /* Parsed command */
+    unsigned long start;   /* Start time     */
+
+    start = metrics_clock();
+    command = parse_command(text);
+    metrics_observe(METRIC_PARSE, start);
+    METRIC_COUNT(METRIC_PARSES);
+    if (command == NULL)
+	METRIC_COUNT(METRIC_PARSE_ERRORS);
+    return command;
+}
+
 /*
  * Execute a full command (a sequence)
  */
@@ -553,10 +896,96 @@ int exec_command(command_t *command)
 {
     int ret; /* Return code */
 
-    current_command = command;
+    exec_ctx->current_command = command;
     ret = exec_sequence(command->sequence);
-    current_command = NULL;
-    return ret;
+    exec_ctx->current_command = NULL;
+    return (exec_ctx->exit_status = ret);
+}
+
+/*
+ * Launch a background job taken from the queue
+ */
+void exec_job(command_t *job)
+{
+    command_t *command = exec_ctx->current_command; /* Command executed */
+
+    /* The job is the command of its process */
+    exec_ctx->current_command = job;
+    exec_background(job->sequence->conditional);
+    exec_ctx->current_command = command;
+}
+
+/*
+ * Free the command substitution buffer
+ */
+void exec_free(void)
+{
+    free(exec_ctx->capture);
+    exec_ctx->capture = NULL;
+    exec_ctx->capture_size = 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Execution Contexts
+ *
+ */
+
+/*
+ * Create a context for commands run by a host program (liblish)
+ */
+exec_context_t *exec_context_new(void)
+{
+    exec_context_t *ctx; /* Created context */
+    int             i;   /* Counter         */
+
+    if ((ctx = calloc(1, sizeof (exec_context_t))) == NULL)
+	return NULL;
+    for (i = 0; i < 4; i++)
+	ctx->backup_fd[i] = -1;
+    ctx->exec_mode = EXEC_SEQ;
+    ctx->ret_pid = -1;
+    ctx->leave_pid = -1;
+    return ctx;
+}
+
+/*
+ * Forget the command of the current context left by lish_exit() returning
+ * to a host program, restoring the standard descriptors it replaced
+ */
+void exec_restore(void)
+{
+    restore_fds();
+    if (exec_ctx->backup_fd[3] != -1) {
+	close(exec_ctx->backup_fd[3]);
+	exec_ctx->backup_fd[3] = -1;
+    }
+    free(exec_ctx->processes);
+    exec_ctx->processes = NULL;
+    exec_ctx->proc_count = 0;
+    schedule_clear(&exec_ctx->schedule);
+    exec_ctx->current_command = NULL;
+}
+
+/*
+ * Make `ctx' the current context; return the previous one
+ */
+exec_context_t *exec_context_switch(exec_context_t *ctx)
+{
+    exec_context_t *previous = exec_ctx; /* Previous context */
+
+    exec_ctx = ctx;
+    return previous;
+}
+
+/*
+ * Free a context created by exec_context_new()
+ */
+void exec_context_free(exec_context_t *ctx)
+{
+    free(ctx->capture);
+    free(ctx);
 }
 
 /* End of file */
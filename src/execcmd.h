@@ -34,16 +34,53 @@
 #define _EXECCMD_H_
 
 /* Headers */
+#include <setjmp.h>
 #include <command.h>
+#include "schedule.h"
+
+/* Execution modes: lets a single command, not pipelined, to be exec*()'ed
+   without forking in a background "subshell" */
+enum exec_mode { EXEC_SEQ, EXEC_BACK, EXEC_SINGLE1, EXEC_SINGLE2 };
+
+/* Execution context: the state of the commands being run, the shell's or
+   that of an evaluation context of a host program (liblish) */
+typedef struct exec_context {
+    command_t      *current_command; /* Currently processed command        */
+    int             proc_count;      /* Number of pipeline processes       */
+    pid_t          *processes;       /* Array of pipeline processes        */
+    int             jobs;            /* Number of running background jobs  */
+    int             exit_status;     /* Exit status of the last command    */
+    int             backup_fd[4];    /* Backup standard descriptors, plus
+					one used for the pipeline          */
+    enum exec_mode  exec_mode;       /* Execution mode                     */
+    int             ret_code;        /* The returned code                  */
+    pid_t           ret_pid;         /* PID of the process returning it    */
+    struct schedule schedule;        /* Scheduling set by a `sched' prefix */
+    int             stage;           /* Stage of the pipeline launched     */
+    char           *capture;         /* Output of the last command
+					substitution                       */
+    size_t          capture_size;    /* Its allocated size                 */
+    int             shell;           /* Is it the shell's (which reaps any
+					child and handles SIGCHLD)?        */
+    jmp_buf        *leave;           /* Where `exit' returns to in a host
+					program, or NULL                   */
+    pid_t           leave_pid;       /* PID of this host program           */
+} exec_context_t;
 
 /* Variables */
-extern command_t *current_command; /* Currently processed command */
-extern int        proc_count;      /* Number of running pipeline processes */
-extern pid_t     *processes;       /* Array of pipeline processes          */
+extern exec_context_t *exec_ctx; /* Current execution context */
 
 /* Prototypes */
-void close_fds(void);
-int  exec_command(command_t *command);
+void            close_fds(void);
+command_t      *exec_parse(char *text);
+const char     *exec_substitute(char *text, size_t *len);
+int             exec_command(command_t *command);
+void            exec_job(command_t *job);
+void            exec_free(void);
+exec_context_t *exec_context_new(void);
+void            exec_restore(void);
+exec_context_t *exec_context_switch(exec_context_t *ctx);
+void            exec_context_free(exec_context_t *ctx);
 
 #endif /* !_EXECCMD_H_ */
 
@@ -0,0 +1,794 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/expand.c
+ *
+ * Description: Word Expansion
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/* Standard C headers */
+#include <stdio.h>  /* fprintf(), sprintf()                   */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free()      */
+#include <string.h> /* strlen(), strchr(), memchr(), memcpy() */
+
+/* Standard UN*X headers */
+#include <sys/types.h>
+#include <unistd.h> /* getpid()   */
+#include <pwd.h>    /* getpwnam() */
+
+/* Project headers */
+#include <command.h>
+#include <common.h>
+#include "shell.h"
+#include "variable.h"
+#include "execcmd.h"
+#include "pathglob.h"
+#include "expand.h"
+
+
+/*****************************************************************************
+ *
+ * Data Types and Variables
+ *
+ */
+
+/* Scratch buffer receiving the expanded words of a command, kept from one
+   command to the next so that it is grown only a few times per session */
+static char  *scratch = NULL;   /* Expanded text, fields separated by '\0' */
+static size_t scratch_size = 0; /* Allocated size                          */
+static size_t scratch_len = 0;  /* Used size                               */
+
+/* Fields, as offsets in the scratch buffer (which may move while growing),
+   and the argument table built from them once the expansion is done */
+static size_t *fields = NULL;   /* Field offsets           */
+static size_t  field_size = 0;  /* Allocated field count   */
+static size_t  field_count = 0; /* Used field count        */
+static char  **argv = NULL;     /* Argument table          */
+
+/* Current field */
+static size_t field_start;   /* Offset of the field in the scratch buffer */
+static int    field_set;     /* Whether it exists even if empty (quoted)  */
+static int    field_magic;   /* Whether it has unquoted wildcards         */
+static int    field_escaped; /* Whether it has `\'-quoted characters      */
+
+/* Pathname expansion of the fields: while it is on, quoted wildcards (and
+   backslashes) are stored quoted by a `\' for the pattern matching, then
+   unquoted if the field is not a pattern or matches nothing */
+static int globbing;
+
+/* Field separators and expansion error flag */
+static const char *ifs;
+static int         failed;
+
+/* Expansion state, saved while a command substitution is run in-process
+   (which expands the words of its command) */
+struct expand_state {
+    char    *scratch;
+    size_t   scratch_size, scratch_len;
+    size_t  *fields;
+    size_t   field_size, field_count;
+    char   **argv;
+    size_t   field_start;
+    int      field_set, field_magic, field_escaped, globbing, failed;
+    const char *ifs;
+};
+
+/* Minimum size of the scratch buffer */
+#define SCRATCH_MIN 256
+
+/* Default field separators */
+#define IFS_DEFAULT " \t\n"
+
+/* Whether a character can be part of a variable name */
+#define NAME_CHAR(c) ((c) == '_' || ((c) >= 'a' && (c) <= 'z') || \
+		      ((c) >= 'A' && (c) <= 'Z') || ((c) >= '0' && (c) <= '9'))
+
+/* Prototypes */
+static void expand_text(const char *text, const char *end, int quoted,
+			int split);
+
+
+/*****************************************************************************
+ *
+ * Scratch Buffer
+ *
+ */
+
+/*
+ * Make room for `len' more characters in the scratch buffer
+ */
+static void scratch_reserve(size_t len)
+{
+    size_t size; /* New size */
+
+    if (scratch_len + len <= scratch_size)
+	return;
+    for (size = scratch_size ? scratch_size : SCRATCH_MIN;
+	 size < scratch_len + len; size *= 2)
+	;
+    if ((scratch = realloc(scratch, size)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    scratch_size = size;
+}
+
+/*
+ * Append `len' characters to the current field
+ */
+static void scratch_append(const char *text, size_t len)
+{
+    scratch_reserve(len);
+    memcpy(scratch + scratch_len, text, len);
+    scratch_len += len;
+}
+
+/*
+ * Append `len' quoted characters to the current field
+ */
+static void scratch_quoted(const char *text, size_t len)
+{
+    const char *end = text + len; /* End of text */
+
+    if (!globbing) {
+	scratch_append(text, len);
+	return;
+    }
+
+    scratch_reserve(2 * len);
+    for (; text < end; text++) {
+	if (*text == '*' || *text == '?' || *text == '[' || *text == '\\') {
+	    scratch[scratch_len++] = '\\';
+	    field_escaped = 1;
+	}
+	scratch[scratch_len++] = *text;
+    }
+}
+
+/*
+ * Append an unquoted character to the current field (the room for it having
+ * been reserved, twice its size)
+ */
+static void scratch_unquoted(char chr)
+{
+    if (globbing) {
+	if (chr == '*' || chr == '?' || chr == '[')
+	    field_magic = 1;
+	else if (chr == '\\') {
+	    scratch[scratch_len++] = '\\';
+	    field_escaped = 1;
+	}
+    }
+    scratch[scratch_len++] = chr;
+}
+
+/*
+ * Record the current field and start a new one
+ */
+static void field_push(void)
+{
+    scratch_reserve(1);
+    scratch[scratch_len++] = '\0';
+
+    if (field_count == field_size) {
+	field_size = field_size ? field_size * 2 : 16;
+	if ((fields = realloc(fields, field_size * sizeof *fields)) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+    }
+    fields[field_count++] = field_start;
+
+    field_start = scratch_len;
+    field_set = field_magic = field_escaped = 0;
+}
+
+/*
+ * Record a path matching the current field as a field
+ */
+static void field_found(const char *path)
+{
+    field_start = scratch_len;
+    scratch_append(path, strlen(path));
+    field_push();
+}
+
+/*
+ * Terminate the current field, replacing it by the matching paths if it is
+ * a pattern, and start a new one
+ */
+static void field_end(void)
+{
+    char *from, *to, *end; /* Unquoting pointers */
+
+    if (field_magic) {
+	/* The pattern is compiled before the matches are appended */
+	scratch_reserve(1);
+	scratch[scratch_len] = '\0';
+	if (pathglob(scratch + field_start, field_found) > 0) {
+	    field_set = field_magic = field_escaped = 0;
+	    return;
+	}
+    }
+
+    /* Remove the quoting backslashes */
+    if (field_escaped) {
+	end = scratch + scratch_len;
+	for (from = to = scratch + field_start; from < end; from++) {
+	    if (*from == '\\' && from + 1 < end)
+		from++;
+	    *to++ = *from;
+	}
+	scratch_len = to - scratch;
+    }
+    field_push();
+}
+
+/*
+ * Append the value of an expansion, splitting it into fields at separators
+ * if it is not quoted: runs of white space separators delimit fields, and
+ * each other separator delimits one, possibly empty (`a::b' is 3 fields)
+ */
+static void field_value(const char *value, size_t len, int split)
+{
+    const char *end = value + len; /* End of value                  */
+    int         delimited = 1;     /* After a non-white separator? */
+
+    if (!split) {
+	scratch_quoted(value, len);
+	return;
+    }
+
+    for (; value < end; value++)
+	if (strchr(ifs, *value) == NULL) {
+	    scratch_reserve(2);
+	    scratch_unquoted(*value);
+	    delimited = 0;
+	} else if (scratch_len > field_start || field_set) {
+	    field_end();
+	    delimited = strchr(IFS_DEFAULT, *value) == NULL;
+	} else if (strchr(IFS_DEFAULT, *value) == NULL) {
+	    /* A separator right after another one ends an empty field */
+	    if (delimited) {
+		field_set = 1;
+		field_end();
+	    }
+	    delimited = 1;
+	}
+}
+
+
+/*
+ * Save the expansion state and start with empty buffers
+ */
+static void expand_save(struct expand_state *state)
+{
+    state->scratch = scratch;
+    state->scratch_size = scratch_size;
+    state->scratch_len = scratch_len;
+    state->fields = fields;
+    state->field_size = field_size;
+    state->field_count = field_count;
+    state->argv = argv;
+    state->field_start = field_start;
+    state->field_set = field_set;
+    state->field_magic = field_magic;
+    state->field_escaped = field_escaped;
+    state->globbing = globbing;
+    state->failed = failed;
+    state->ifs = ifs;
+
+    scratch = NULL;
+    fields = NULL;
+    argv = NULL;
+    scratch_size = scratch_len = field_size = field_count = 0;
+}
+
+/*
+ * Free the buffers used since expand_save() and restore the state
+ */
+static void expand_restore(const struct expand_state *state)
+{
+    free(scratch);
+    free(fields);
+    free(argv);
+
+    scratch = state->scratch;
+    scratch_size = state->scratch_size;
+    scratch_len = state->scratch_len;
+    fields = state->fields;
+    field_size = state->field_size;
+    field_count = state->field_count;
+    argv = state->argv;
+    field_start = state->field_start;
+    field_set = state->field_set;
+    field_magic = state->field_magic;
+    field_escaped = state->field_escaped;
+    globbing = state->globbing;
+    failed = state->failed;
+    ifs = state->ifs;
+}
+
+
+/*****************************************************************************
+ *
+ * Expansions
+ *
+ */
+
+/*
+ * Substitute the output of the command made of `len' characters of `text',
+ * without its trailing newlines
+ */
+static void expand_command(const char *text, size_t len, int quoted,
+			   int split)
+{
+    struct expand_state state;  /* Saved state        */
+    char               *command; /* Command text       */
+    const char         *output;  /* Its output         */
+    size_t              out_len; /* Its output length */
+
+    if ((command = malloc(len + 1)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    memcpy(command, text, len);
+    command[len] = '\0';
+
+    expand_save(&state);
+    output = exec_substitute(command, &out_len);
+    expand_restore(&state);
+    free(command);
+
+    if (output == NULL) {
+	failed = 1;
+	return;
+    }
+    while (out_len > 0 && output[out_len - 1] == '\n')
+	out_len--;
+    field_value(output, out_len, split && !quoted);
+}
+
+/*
+ * Find the parenthesis closing a "$(" whose contents starts at `text'
+ */
+static const char *find_paren(const char *text, const char *end)
+{
+    int depth = 1; /* Nesting depth */
+
+    for (; text < end; text++)
+	if (*text == '(')
+	    depth++;
+	else if (*text == ')' && --depth == 0)
+	    return text;
+    return NULL;
+}
+
+/*
+ * Find the brace closing a "${" whose contents starts at `text'
+ */
+static const char *find_brace(const char *text, const char *end)
+{
+    int depth = 1; /* Nesting depth */
+
+    for (; text < end; text++)
+	switch (*text) {
+	case QUOTE_SINGLE:
+	    if ((text = memchr(text + 1, QUOTE_SINGLE, end - text - 1))
+		== NULL)
+		return NULL;
+	    break;
+	case QUOTE_ESCAPE:
+	    if (text + 1 < end)
+		text++;
+	    break;
+	case '$':
+	    if (text + 1 < end && text[1] == '{') {
+		depth++;
+		text++;
+	    }
+	    break;
+	case '}':
+	    if (--depth == 0)
+		return text;
+	}
+    return NULL;
+}
+
+/*
+ * Expand `text' apart into the scratch buffer, followed by '\0', returning
+ * its offset; the scratch buffer is rewound by the caller
+ */
+static size_t expand_apart(const char *prefix, size_t len, const char *text,
+			   const char *end)
+{
+    size_t offset = scratch_len;                /* Result offset */
+    size_t start = field_start;                 /* Saved field   */
+    int    set = field_set, glob = globbing;
+
+    field_start = offset;
+    globbing = 0;
+    scratch_append(prefix, len);
+    expand_text(text, end, 1, 0);
+    scratch_reserve(1);
+    scratch[scratch_len++] = '\0';
+    field_start = start;
+    field_set = set;
+    globbing = glob;
+    return offset;
+}
+
+/*
+ * Expand the parameter starting at `text' (on a `$'); return the end of it
+ */
+static const char *expand_param(const char *text, const char *end,
+				int quoted, int split)
+{
+    const char *name, *name_end; /* Parameter name                    */
+    const char *word = NULL;     /* Word of the ${NAME<op>WORD} forms */
+    const char *close = NULL;    /* Closing brace                     */
+    const char *value;           /* Parameter value                   */
+    char        number[24];      /* Numeric parameter value           */
+    char        op = '\0';       /* Operator                          */
+    int         colon = 0;       /* Operator applies to empty values  */
+    int         length = 0;      /* ${#NAME} form                     */
+    size_t      offset;          /* Apart expansion                   */
+
+    /* Command substitution */
+    if (text + 1 < end && text[1] == '(') {
+	if ((close = find_paren(text + 2, end)) == NULL) {
+	    scratch_append("$", 1);
+	    return text + 1;
+	}
+	expand_command(text + 2, close - text - 2, quoted, split);
+	return close + 1;
+    }
+
+    /* Find the name */
+    name = ++text;
+    if (text < end && *text == '{') {
+	if ((close = find_brace(++text, end)) == NULL) {
+	    fprintf(stderr, "%s: bad substitution\n", exe_name);
+	    failed = 1;
+	    return end;
+	}
+	if (*text == '#' && text + 1 < close && text[1] != '}') {
+	    length = 1;
+	    text++;
+	}
+	name = text;
+    }
+    if (text < end && (*text == '?' || *text == '$' || *text == '0'))
+	text++;
+    else
+	while (text < end && NAME_CHAR(*text) &&
+	       (text != name || *text < '0' || *text > '9'))
+	    text++;
+    name_end = text;
+
+    /* Not a parameter: keep the `$' */
+    if (name == name_end) {
+	if (close == NULL) {
+	    scratch_append("$", 1);
+	    return name;
+	}
+	fprintf(stderr, "%s: bad substitution\n", exe_name);
+	failed = 1;
+	return close + 1;
+    }
+
+    /* Get the operator */
+    if (close != NULL && text < close) {
+	if (*text == ':') {
+	    colon = 1;
+	    text++;
+	}
+	if (length || text == close || strchr("-=+?", *text) == NULL) {
+	    fprintf(stderr, "%s: bad substitution\n", exe_name);
+	    failed = 1;
+	    return close + 1;
+	}
+	op = *text;
+	word = text + 1;
+    }
+
+    /* Get the value */
+    switch (*name) {
+    case '?':
+	sprintf(number, "%d", exec_ctx->exit_status);
+	value = number;
+	break;
+    case '$':
+	sprintf(number, "%ld", (long) getpid());
+	value = number;
+	break;
+    case '0':
+	value = exe_name;
+	break;
+    default:
+	value = var_getn(name, name_end - name);
+    }
+    text = close != NULL ? close + 1 : name_end;
+
+    /* Apply the operator */
+    switch (op) {
+    case '-':
+	if (value == NULL || (colon && *value == '\0')) {
+	    expand_text(word, close, quoted, split);
+	    return text;
+	}
+	break;
+    case '=':
+	if (value == NULL || (colon && *value == '\0')) {
+	    if (*name < 'A') {
+		fprintf(stderr, "%s: $%.*s: cannot assign\n", exe_name,
+			(int) (name_end - name), name);
+		failed = 1;
+		return text;
+	    }
+	    offset = expand_apart(name, name_end - name + 1, word, close);
+	    scratch[offset + (name_end - name)] = '=';
+	    var_assign(scratch + offset, 0);
+	    scratch_len = offset;
+	    value = var_getn(name, name_end - name);
+	}
+	break;
+    case '+':
+	if (value != NULL && (!colon || *value != '\0'))
+	    expand_text(word, close, quoted, split);
+	return text;
+    case '?':
+	if (value == NULL || (colon && *value == '\0')) {
+	    offset = expand_apart(name, name_end - name, word, close);
+	    fprintf(stderr, "%s: %.*s: %s\n", exe_name,
+		    (int) (name_end - name), name,
+		    word == close ? "parameter null or not set" :
+		    scratch + offset + (name_end - name));
+	    scratch_len = offset;
+	    failed = 1;
+	    return text;
+	}
+    }
+
+    /* Append the value (or its length) */
+    if (length) {
+	sprintf(number, "%lu",
+		(unsigned long) (value != NULL ? strlen(value) : 0));
+	scratch_append(number, strlen(number));
+    } else if (value != NULL)
+	field_value(value, strlen(value), split && !quoted);
+    return text;
+}
+
+/*
+ * Expand a leading tilde at `text' into a home directory; return the end
+ * of the expanded part, or `text' if there is none
+ */
+static const char *expand_tilde(const char *text, const char *end)
+{
+    const char    *user = text + 1; /* User name        */
+    const char    *home;            /* Home directory   */
+    struct passwd *pw;              /* User information */
+    char           name[64];        /* Copied user name */
+
+    for (text = user; text < end && *text != '/'; text++)
+	if (*text == QUOTE_SINGLE || *text == QUOTE_DOUBLE ||
+	    *text == QUOTE_ESCAPE || *text == '$')
+	    return user - 1;
+
+    if (text == user)
+	home = var_get("HOME");
+    else if ((size_t) (text - user) < sizeof name) {
+	memcpy(name, user, text - user);
+	name[text - user] = '\0';
+	home = (pw = getpwnam(name)) != NULL ? pw->pw_dir : NULL;
+    } else
+	home = NULL;
+
+    if (home == NULL)
+	return user - 1;
+    scratch_quoted(home, strlen(home));
+    return text;
+}
+
+/*
+ * Expand a text into the current field, starting as double-quoted if
+ * `quoted' is set, and splitting unquoted expansions if `split' is set
+ */
+static void expand_text(const char *text, const char *end, int quoted,
+			int split)
+{
+    const char *run; /* Run of literal characters */
+
+    while (text < end && !failed)
+	switch (*text) {
+	case QUOTE_SINGLE:
+	    /* Literal text */
+	    if ((run = memchr(text + 1, QUOTE_SINGLE, end - text - 1))
+		== NULL)
+		run = end;
+	    scratch_quoted(text + 1, run - text - 1);
+	    field_set = 1;
+	    text = run < end ? run + 1 : end;
+	    break;
+
+	case QUOTE_DOUBLE:
+	    quoted = !quoted;
+	    field_set = 1;
+	    text++;
+	    break;
+
+	case QUOTE_ESCAPE:
+	    /* Literal character */
+	    if (++text < end)
+		scratch_quoted(text++, 1);
+	    break;
+
+	case '$':
+	    text = expand_param(text, end, quoted, split);
+	    break;
+
+	case '`':
+	    /* Command substitution */
+	    if ((run = memchr(text + 1, '`', end - text - 1)) == NULL) {
+		scratch_append(text++, 1);
+		break;
+	    }
+	    expand_command(text + 1, run - text - 1, quoted, split);
+	    text = run + 1;
+	    break;
+
+	default:
+	    /* Copy literal characters up to the next special one at once */
+	    for (run = text; run < end && *run != '$' && *run != '`' &&
+		     *run != QUOTE_SINGLE && *run != QUOTE_DOUBLE &&
+		     *run != QUOTE_ESCAPE; run++)
+		;
+	    if (quoted)
+		scratch_quoted(text, run - text);
+	    else
+		for (scratch_reserve(2 * (run - text)); text < run; text++)
+		    scratch_unquoted(*text);
+	    text = run;
+	}
+}
+
+/*
+ * Expand a whole word into the current field (a tilde being expanded at its
+ * start or, for an unsplit assignment, at the start of the value)
+ */
+static void expand_one(const char *word, int split)
+{
+    const char *end = word + strlen(word); /* End of word */
+    size_t      len;                       /* Name length */
+
+    if (!split && (len = var_assignment(word)) != 0 && word[len + 1] == '~') {
+	scratch_append(word, len + 1);
+	word += len + 1;
+    }
+    if (*word == '~')
+	word = expand_tilde(word, end);
+    expand_text(word, end, 0, split);
+}
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Expand the words of a simple command into an argument table, storing the
+ * argument count in `count'; return NULL if an expansion failed
+ * The table is valid until the next expansion.
+ */
+char **expand_words(words_t *words, int *count)
+{
+    size_t i; /* Counter */
+
+    scratch_len = field_count = 0;
+    field_start = 0;
+    field_set = field_magic = field_escaped = failed = 0;
+    globbing = 1;
+    if ((ifs = var_get("IFS")) == NULL)
+	ifs = IFS_DEFAULT;
+
+    for (; words != NULL && !failed; words = words->next) {
+	expand_one(words->word, 1);
+	if (scratch_len > field_start || field_set)
+	    field_end();
+    }
+    if (failed)
+	return NULL;
+
+    /* Build the argument table */
+    if ((argv = realloc(argv, (field_count + 1) * sizeof *argv)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    for (i = 0; i < field_count; i++)
+	argv[i] = scratch + fields[i];
+    argv[i] = NULL;
+
+    *count = (int) field_count;
+    return argv;
+}
+
+/*
+ * Expand a word without field splitting (redirection file, assignment);
+ * return NULL if an expansion failed
+ * The result is valid until the next expansion.
+ */
+char *expand_word(const char *word)
+{
+    scratch_len = field_count = 0;
+    field_start = 0;
+    field_set = failed = 0;
+    globbing = 0;
+
+    expand_one(word, 0);
+    scratch_reserve(1);
+    scratch[scratch_len++] = '\0';
+    return failed ? NULL : scratch;
+}
+
+/*
+ * Expand parameters and command substitutions in a text (a here-document
+ * body) without field splitting; return NULL if an expansion failed
+ * The result is valid until the next expansion.
+ */
+char *expand_string(const char *text)
+{
+    scratch_len = field_count = 0;
+    field_start = 0;
+    field_set = failed = 0;
+    globbing = 0;
+
+    expand_text(text, text + strlen(text), 0, 0);
+    scratch_reserve(1);
+    scratch[scratch_len] = '\0';
+    return failed ? NULL : scratch;
+}
+
+/*
+ * Free the scratch buffer
+ */
+void expand_free(void)
+{
+    free(scratch);
+    free(fields);
+    free(argv);
+    scratch = NULL;
+    fields = NULL;
+    argv = NULL;
+    scratch_size = field_size = 0;
+    pathglob_free();
+}
+
+/* End of file */
@@ -0,0 +1,308 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/heredoc.c
+ *
+ * Description: Here-Documents
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#define _GNU_SOURCE /* For syscall() */
+
+/* Standard C headers */
+#include <stdio.h>  /* fprintf(), tmpfile()                        */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free()           */
+#include <string.h> /* strlen(), strcmp(), strchr(), memcpy()      */
+#include <errno.h>  /* errno                                       */
+#include <limits.h> /* PIPE_BUF                                    */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <unistd.h> /* write(), lseek(), pipe(), dup(), close() */
+#ifdef __linux__
+# include <sys/syscall.h> /* syscall(), SYS_memfd_create */
+#endif
+
+/* Project headers */
+#include <command.h>
+#include <common.h>
+#include "shell.h"
+#include "variable.h"
+#include "lineedit.h"
+#include "prompt.h"
+#include "heredoc.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* Maximum length of a here-document line read at once */
+#define LINE_SIZE 4096
+
+/* Default continuation prompt */
+#define PS2_DEFAULT "> "
+
+/* Close-on-exec flag of memfd_create() (the descriptor is dup2()'ed onto
+   its final number, which clears the flag there) */
+#ifndef MFD_CLOEXEC
+# define MFD_CLOEXEC 1U
+#endif
+
+
+/*****************************************************************************
+ *
+ * Reading Here-Documents
+ *
+ */
+
+/*
+ * Read the lines of the here-document of `redir_file' up to its delimiter,
+ * removing leading tabs for `<<-'; the body of a here-document whose
+ * delimiter is quoted is enclosed in single quote marks to be left
+ * unexpanded, otherwise a backslash quotes `$', ``' and `\' and joins lines
+ * when it ends one; return 0 if the end of input came first
+ */
+static int heredoc_body(redir_file_t *redir_file)
+{
+    char        line[LINE_SIZE];    /* Read line             */
+    char       *delim, *body;       /* Delimiter, body       */
+    const char *text, *end;         /* Line text and end     */
+    const char *prompt;             /* Continuation prompt   */
+    size_t      len, body_len = 0;  /* Lengths               */
+    size_t      body_size = 256;    /* Allocated body size   */
+    int         quoted = 0;         /* Quoted delimiter?     */
+    int         start = 1;          /* At a line start?      */
+    int         joined = 0;         /* Continued line?       */
+    char       *from, *to;          /* Unquoting pointers    */
+
+    /* Remove quote marks from the delimiter */
+    if ((delim = malloc(strlen(redir_file->file) + 1)) == NULL ||
+	(body = malloc(body_size)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    for (from = redir_file->file, to = delim; *from != '\0'; from++)
+	if (*from == QUOTE_SINGLE || *from == QUOTE_DOUBLE ||
+	    *from == QUOTE_ESCAPE)
+	    quoted = 1;
+	else
+	    *to++ = *from;
+    *to = '\0';
+    if (quoted)
+	body[body_len++] = QUOTE_SINGLE;
+
+    if ((prompt = var_get("PS2")) == NULL)
+	prompt = PS2_DEFAULT;
+    for (;;) {
+	if (start)
+	    display_continuation(prompt);
+	if (lineedit_gets(line, sizeof line) == NULL) {
+	    fprintf(stderr, "%s: here-document delimited by end of input "
+		    "(wanted `%s')\n", exe_name, delim);
+	    break;
+	}
+
+	/* Compare whole lines with the delimiter (a line continuing the
+	   previous one is not a line of its own) */
+	text = line;
+	if (start && !joined && redir_file->type == HEREDOCTAB)
+	    while (*text == '\t')
+		text++;
+	len = strlen(text);
+	if (start && !joined && len > 0 && text[len - 1] == '\n' &&
+	    len - 1 == strlen(delim) && !strncmp(text, delim, len - 1))
+	    break;
+	start = len > 0 && text[len - 1] == '\n';
+
+	/* Append the line, marking escaped characters for expand_string() */
+	if (body_len + 2 * len + 2 > body_size) {
+	    while (body_len + 2 * len + 2 > body_size)
+		body_size *= 2;
+	    if ((body = realloc(body, body_size)) == NULL) {
+		lish_perror("fatal error");
+		lish_exit(RET_ERROR);
+	    }
+	}
+	joined = 0;
+	for (end = text + len; text < end; text++)
+	    if (quoted || *text != '\\' || text + 1 == end)
+		body[body_len++] = *text;
+	    else if (text[1] == '\n') {
+		text++;
+		joined = 1;
+	    } else if (text[1] == '$' || text[1] == '`' || text[1] == '\\') {
+		body[body_len++] = QUOTE_ESCAPE;
+		body[body_len++] = *++text;
+	    } else
+		body[body_len++] = *text;
+    }
+
+    if (quoted)
+	body[body_len++] = QUOTE_SINGLE;
+    body[body_len] = '\0';
+    redir_file->document = body;
+    free(delim);
+    return start;
+}
+
+/*
+ * Read the here-documents of a redirected command, in order
+ */
+static int heredoc_redirected(redirected_t *redirected)
+{
+    redirection_t *redir; /* Current redirection */
+
+    if (redirected->simple->type == SUBSHELL &&
+	!heredoc_read(redirected->simple->u.command))
+	return 0;
+    for (redir = redirected->redirection; redir; redir = redir->next)
+	if (redir->type == RFILE &&
+	    (redir->u.redir_file->type == HEREDOC ||
+	     redir->u.redir_file->type == HEREDOCTAB) &&
+	    redir->u.redir_file->document == NULL &&
+	    !heredoc_body(redir->u.redir_file))
+	    return 0;
+    return 1;
+}
+
+/*
+ * Read the bodies of the here-documents of a parsed command line from the
+ * following input lines, in order; return 0 if the end of input came first
+ */
+int heredoc_read(command_t *command)
+{
+    sequence_t    *sequence;    /* Current sequence    */
+    conditional_t *conditional; /* Current conditional */
+    pipeline_t    *pipeline;    /* Current pipeline    */
+
+    for (sequence = command->sequence; sequence; sequence = sequence->next)
+	for (conditional = sequence->conditional; conditional;
+	     conditional = conditional->next)
+	    for (pipeline = conditional->pipeline; pipeline;
+		 pipeline = pipeline->next)
+		if (!heredoc_redirected(pipeline->redirected))
+		    return 0;
+    return 1;
+}
+
+
+/*****************************************************************************
+ *
+ * Delivering Here-Documents
+ *
+ */
+
+/*
+ * Write `len' characters of `text' to `fd'; return 0 on success
+ */
+static int heredoc_write(int fd, const char *text, size_t len)
+{
+    ssize_t n; /* Written characters */
+
+    while (len > 0)
+	if ((n = write(fd, text, len)) > 0) {
+	    text += n;
+	    len -= n;
+	} else if (n == -1 && errno != EINTR)
+	    return -1;
+    return 0;
+}
+
+/*
+ * Get a descriptor on an empty anonymous file, open for reading and
+ * writing, or -1 on error: a memory file on Linux (when `memory_only' is
+ * set, only it is tried), else a temporary file
+ */
+static int heredoc_anonymous(int memory_only)
+{
+    int   fd;   /* Descriptor     */
+    FILE *file; /* Temporary file */
+
+#ifdef SYS_memfd_create
+    if ((fd = syscall(SYS_memfd_create, "lish", MFD_CLOEXEC)) != -1 ||
+	memory_only)
+	return fd;
+#else
+    if (memory_only)
+	return -1;
+#endif
+
+    if ((file = tmpfile()) == NULL)
+	return -1;
+    fd = dup(fileno(file));
+    fclose(file);
+    return fd;
+}
+
+/*
+ * Get a descriptor on an empty anonymous file, where output can be stored
+ * and read back, or -1 on error
+ */
+int heredoc_file(void)
+{
+    return heredoc_anonymous(0);
+}
+
+/*
+ * Get a descriptor reading `len' characters of `text' (followed by a newline
+ * if `newline' is set), or -1 on error
+ * The text is put in an anonymous memory file on Linux: it is seekable, does
+ * not touch the disk and needs no writer process.  Elsewhere (or if it is
+ * not supported), a small text is written into a pipe, which it fits in,
+ * and a larger one into a temporary file.
+ */
+int heredoc_open(const char *text, size_t len, int newline)
+{
+    int fd, pipe_fd[2]; /* Descriptors */
+
+    if ((fd = heredoc_anonymous(1)) == -1 && len + 1 <= PIPE_BUF) {
+	if (pipe(pipe_fd) == -1)
+	    return -1;
+	if (heredoc_write(pipe_fd[1], text, len) ||
+	    (newline && heredoc_write(pipe_fd[1], "\n", 1))) {
+	    close(pipe_fd[0]);
+	    pipe_fd[0] = -1;
+	}
+	close(pipe_fd[1]);
+	return pipe_fd[0];
+    }
+
+    if (fd == -1 && (fd = heredoc_anonymous(0)) == -1)
+	return -1;
+    if (heredoc_write(fd, text, len) ||
+	(newline && heredoc_write(fd, "\n", 1)) ||
+	lseek(fd, 0, SEEK_SET) != 0) {
+	close(fd);
+	return -1;
+    }
+    return fd;
+}
+
+/* End of file */
@@ -0,0 +1,47 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/heredoc.h
+ *
+ * Description: Here-Documents
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _HEREDOC_H_
+#define _HEREDOC_H_
+
+/* Headers */
+#include <stddef.h> /* size_t */
+#include <command.h>
+
+/* Prototypes */
+int heredoc_read(command_t *command);
+int heredoc_open(const char *text, size_t len, int newline);
+int heredoc_file(void);
+
+#endif /* !_HEREDOC_H_ */
+
+/* End of file */
@@ -0,0 +1,432 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/histindex.c
+ *
+ * Description: History Search Index
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#define _GNU_SOURCE /* For memrchr() */
+
+/* Standard C headers */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free()           */
+#include <string.h> /* strlen(), strcmp(), strncmp(), memchr(), ... */
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "histindex.h"
+
+
+/*****************************************************************************
+ *
+ * Data Types and Variables
+ *
+ */
+
+/* Distinct command, in a treap ordered by text; each node also knows the
+   most recent command of its subtree, so that prefix queries need no scan */
+struct node {
+    struct node  *left, *right; /* Children                              */
+    struct node  *top;          /* Most recent command in the subtree    */
+    unsigned long n;            /* Number of its most recent occurrence  */
+    unsigned int  prio;         /* Random heap priority                  */
+    char          text[1];      /* Command text (allocated with the node) */
+};
+
+/* Root of the treap */
+static struct node *root = NULL;
+
+/* Every occurrence in command order, texts being packed in a single arena
+   (separated by '\0') so that searches are a few memchr() calls */
+static char          *arena = NULL;   /* Command texts                  */
+static size_t         arena_len = 0;  /* Used arena length              */
+static size_t         arena_size = 0; /* Allocated arena length         */
+static unsigned long *numbers = NULL; /* Occurrence command numbers     */
+static size_t        *offsets = NULL; /* Occurrence offsets in arena    */
+static size_t         count = 0;      /* Number of occurrences          */
+static size_t         size = 0;       /* Allocated number of occurrences */
+static size_t         live = 0;       /* First occurrence still present */
+
+/* Compact the arena when at least this many occurrences are dead */
+#define COMPACT_MIN 1024
+
+
+/*****************************************************************************
+ *
+ * Treap Helpers
+ *
+ */
+
+/*
+ * Return the most recent of two commands (either may be NULL)
+ */
+static struct node *newer(struct node *a, struct node *b)
+{
+    if (a == NULL)
+	return b;
+    if (b == NULL)
+	return a;
+    return a->n > b->n ? a : b;
+}
+
+/*
+ * Update the most recent command of a subtree
+ */
+static void node_update(struct node *node)
+{
+    node->top = node;
+    if (node->left != NULL)
+	node->top = newer(node->top, node->left->top);
+    if (node->right != NULL)
+	node->top = newer(node->top, node->right->top);
+}
+
+/*
+ * Rotate a subtree to the right (left child becomes root)
+ */
+static struct node *rotate_right(struct node *node)
+{
+    struct node *left = node->left; /* New subtree root */
+
+    node->left = left->right;
+    left->right = node;
+    node_update(node);
+    node_update(left);
+    return left;
+}
+
+/*
+ * Rotate a subtree to the left (right child becomes root)
+ */
+static struct node *rotate_left(struct node *node)
+{
+    struct node *right = node->right; /* New subtree root */
+
+    node->right = right->left;
+    right->left = node;
+    node_update(node);
+    node_update(right);
+    return right;
+}
+
+/*
+ * Insert a command occurrence into a subtree and return its new root
+ */
+static struct node *node_insert(struct node *node, const char *cmd,
+				unsigned long n)
+{
+    int cmp;                      /* Comparison result  */
+    static unsigned int seed = 1; /* Priority generator */
+
+    /* Create a new node */
+    if (node == NULL) {
+	if ((node = malloc(sizeof *node + strlen(cmd))) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+	strcpy(node->text, cmd);
+	node->left = node->right = NULL;
+	node->top = node;
+	node->n = n;
+	seed = seed * 1103515245 + 12345;
+	node->prio = seed >> 8;
+	return node;
+    }
+
+    /* Update an existing command or insert in the right subtree */
+    if ((cmp = strcmp(cmd, node->text)) == 0)
+	node->n = n;
+    else if (cmp < 0) {
+	node->left = node_insert(node->left, cmd, n);
+	if (node->left->prio > node->prio)
+	    return rotate_right(node);
+    } else {
+	node->right = node_insert(node->right, cmd, n);
+	if (node->right->prio > node->prio)
+	    return rotate_left(node);
+    }
+
+    node_update(node);
+    return node;
+}
+
+/*
+ * Free a subtree
+ */
+static void node_free(struct node *node)
+{
+    if (node != NULL) {
+	node_free(node->left);
+	node_free(node->right);
+	free(node);
+    }
+}
+
+
+/*****************************************************************************
+ *
+ * Occurrence Arena
+ *
+ */
+
+/*
+ * Forget occurrences which are not in history anymore, compacting the arena
+ * and rebuilding the treap once enough of them are dead
+ */
+static void index_expire(unsigned long first)
+{
+    size_t i, shift; /* Counter, arena shift */
+
+    while (live < count && numbers[live] < first)
+	live++;
+    if (live < COMPACT_MIN || live < count / 2)
+	return;
+
+    /* Move live occurrences to the beginning */
+    shift = live < count ? offsets[live] : arena_len;
+    memmove(arena, arena + shift, arena_len - shift);
+    arena_len -= shift;
+    for (i = live; i < count; i++) {
+	numbers[i - live] = numbers[i];
+	offsets[i - live] = offsets[i] - shift;
+    }
+    count -= live;
+    live = 0;
+
+    /* Rebuild the treap with live commands only */
+    node_free(root);
+    root = NULL;
+    for (i = 0; i < count; i++)
+	root = node_insert(root, arena + offsets[i], numbers[i]);
+}
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Index command number `n' (numbers must be given in increasing order)
+ */
+void histindex_add(unsigned long n, const char *cmd)
+{
+    size_t len = strlen(cmd) + 1; /* Text length, with terminator */
+
+    /* Grow arrays and arena if needed */
+    if (count == size) {
+	size = size ? size * 2 : 64;
+	if ((numbers = realloc(numbers, size * sizeof *numbers)) == NULL ||
+	    (offsets = realloc(offsets, size * sizeof *offsets)) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+    }
+    if (arena_len + len > arena_size) {
+	while (arena_len + len > arena_size)
+	    arena_size = arena_size ? arena_size * 2 : 4096;
+	if ((arena = realloc(arena, arena_size)) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+    }
+
+    /* Append occurrence and update treap */
+    numbers[count] = n;
+    offsets[count++] = arena_len;
+    memcpy(arena + arena_len, cmd, len);
+    arena_len += len;
+    root = node_insert(root, cmd, n);
+}
+
+/*
+ * Find the most recent command beginning by `prefix' whose number is at
+ * least `first', or return NULL
+ */
+const char *histindex_prefix(const char *prefix, unsigned long first)
+{
+    int          cmp;                       /* Comparison result    */
+    size_t       len = strlen(prefix);      /* Prefix length        */
+    struct node *node, *found = NULL, *sub; /* Current, best, child */
+
+    index_expire(first);
+
+    /* Find the subtree root where the matching range splits */
+    node = root;
+    while (node != NULL && (cmp = strncmp(node->text, prefix, len)) != 0)
+	node = cmp < 0 ? node->right : node->left;
+
+    if (node != NULL) {
+	found = node;
+
+	/* Left part: right subtrees of nodes which are in range */
+	for (sub = node->left; sub != NULL; )
+	    if (strncmp(sub->text, prefix, len) < 0)
+		sub = sub->right;
+	    else {
+		found = newer(found, newer(sub, sub->right ?
+					   sub->right->top : NULL));
+		sub = sub->left;
+	    }
+
+	/* Right part: left subtrees of nodes which are in range */
+	for (sub = node->right; sub != NULL; )
+	    if (strncmp(sub->text, prefix, len) > 0)
+		sub = sub->left;
+	    else {
+		found = newer(found, newer(sub, sub->left ?
+					   sub->left->top : NULL));
+		sub = sub->right;
+	    }
+    }
+
+    return found != NULL && found->n >= first ? found->text : NULL;
+}
+
+/*
+ * Call `found' for each command containing `pattern' (or its characters in
+ * order if `fuzzy' is set) whose number is at least `first', oldest first
+ */
+void histindex_scan(const char *pattern, int fuzzy, unsigned long first,
+		    void (*found)(unsigned long n, const char *cmd))
+{
+    size_t      i, len = strlen(pattern); /* Counter, pattern length */
+    const char *pos, *end, *hit, *chr;    /* Scan positions          */
+
+    index_expire(first);
+    if (live == count)
+	return;
+
+    if (fuzzy) {
+	/* Look for each pattern character in turn, within each command */
+	for (i = live; i < count; i++) {
+	    pos = arena + offsets[i];
+	    end = i + 1 < count ? arena + offsets[i + 1] : arena + arena_len;
+	    for (chr = pattern; *chr != '\0' &&
+		     (pos = memchr(pos, *chr, end - pos)) != NULL; chr++)
+		pos++;
+	    if (*chr == '\0')
+		found(numbers[i], arena + offsets[i]);
+	}
+    } else if (len == 0) {
+	for (i = live; i < count; i++)
+	    found(numbers[i], arena + offsets[i]);
+    } else {
+	/* Scan the whole arena at once for the first pattern character;
+	   matches cannot span two commands since `pattern' has no '\0' */
+	i = live;
+	pos = arena + offsets[live];
+	end = arena + arena_len;
+	while ((hit = memchr(pos, pattern[0], end - pos)) != NULL) {
+	    if ((size_t) (end - hit) < len || memcmp(hit, pattern, len)) {
+		pos = hit + 1;
+		continue;
+	    }
+
+	    /* Report the command containing the match, then skip it */
+	    while (i + 1 < count && arena + offsets[i + 1] <= hit)
+		i++;
+	    found(numbers[i], arena + offsets[i]);
+	    if (++i == count)
+		break;
+	    pos = arena + offsets[i];
+	}
+    }
+}
+
+/*
+ * Find the most recent command containing `pattern' whose number is at least
+ * `first' and less than `before', storing its number in `n'; return NULL if
+ * there is none
+ */
+const char *histindex_rfind(const char *pattern, unsigned long before,
+			    unsigned long first, unsigned long *n)
+{
+    size_t      lo, hi, mid, len = strlen(pattern); /* Bounds, length */
+    const char *start, *pos, *hit;                  /* Scan positions */
+
+    index_expire(first);
+
+    /* Occurrences before `before' are [live, hi) */
+    lo = live;
+    hi = count;
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (numbers[mid] < before)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    if (hi == live)
+	return NULL;
+
+    /* Scan the arena backwards for the first pattern character */
+    start = arena + offsets[live];
+    pos = hi < count ? arena + offsets[hi] : arena + arena_len;
+    if (len == 0)
+	hit = pos - 1;
+    else
+	for (;;) {
+	    if ((hit = memrchr(start, pattern[0], pos - start)) == NULL)
+		return NULL;
+	    if (!strncmp(hit, pattern, len))
+		break;
+	    pos = hit;
+	}
+
+    /* Find the occurrence containing the match */
+    lo = live;
+    while (hi - lo > 1) {
+	mid = lo + (hi - lo) / 2;
+	if (arena + offsets[mid] <= hit)
+	    lo = mid;
+	else
+	    hi = mid;
+    }
+    *n = numbers[lo];
+    return arena + offsets[lo];
+}
+
+/*
+ * Free the index
+ */
+void histindex_free(void)
+{
+    node_free(root);
+    root = NULL;
+    free(arena);
+    free(numbers);
+    free(offsets);
+    arena = NULL;
+    numbers = NULL;
+    offsets = NULL;
+    arena_len = arena_size = count = size = live = 0;
+}
+
+/* End of file */
@@ -0,0 +1,49 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/histindex.h
+ *
+ * Description: History Search Index (Header)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#ifndef _HISTINDEX_H_
+#define _HISTINDEX_H_
+
+/* Prototypes */
+void        histindex_add(unsigned long n, const char *cmd);
+const char *histindex_prefix(const char *prefix, unsigned long first);
+void        histindex_scan(const char *pattern, int fuzzy,
+			   unsigned long first,
+			   void (*found)(unsigned long n, const char *cmd));
+const char *histindex_rfind(const char *pattern, unsigned long before,
+			    unsigned long first, unsigned long *n);
+void        histindex_free(void);
+
+#endif /* !_HISTINDEX_H_ */
+
+/* End of file */
@@ -30,8 +30,10 @@
  */
 
 
-#define _SVID_SOURCE /* For SHM/semaphore */
-#define _BSD_SOURCE  /* For snprintf()    */
+
+#define _SVID_SOURCE /* For SHM, semaphores */
+#define _BSD_SOURCE  /* For snprintf()      */
+#define _GNU_SOURCE  /* For memrchr()       */
 
 /* Standard C headers */
 #include <stdlib.h>
@@ -42,13 +44,27 @@
 /* Standard UN*X headers */
 #include <sys/types.h>
 #include <sys/ipc.h>
-#include <sys/shm.h> /* shmget(), shmctl(), shmat(), shmdt() */
-#include <sys/sem.h> /* semget(), semctl(), semop()          */
-#include <unistd.h>  /* getuid()                             */
+#include <sys/shm.h>  /* shmget(), shmctl(), shmat(), shmdt() */
+#include <sys/sem.h>  /* semget(), semctl(), semop()          */
+#include <sys/wait.h> /* wait()                               */
+#include <sys/time.h> /* gettimeofday()                       */
+#include <sys/stat.h> /* fstat()                              */
+#include <sys/mman.h> /* mmap(), munmap()                     */
+#include <fcntl.h>    /* open()                               */
+#include <unistd.h>   /* getuid(), fork(), usleep(), read()   */
+#include <sched.h>    /* sched_yield()                        */
+#include <signal.h>   /* kill()                               */
+
+#ifdef HAS_ZLIB
+# include <zlib.h>    /* gzopen(), gzgets(), gzputs(), gzclose() */
+#endif
 
 /* Project headers */
 #include <common.h>
-#include "main.h"
+#include "shell.h"
+#include "histindex.h"
+#include "variable.h"
+#include "metrics.h"
 #include "history.h"
 
 
@@ -58,116 +74,531 @@
  *
  */
 
-/* Reads can share access but write must have exclusive access */
-#define READ_SEM  0 /* History reading semaphore */
-#define WRITE_SEM 1 /* History writing semaphore */
+/* Atomic operations on shared memory (GCC builtins, full barriers) */
+#ifndef __GNUC__
+# error "Lock-free history requires GCC atomic builtins"
+#endif
+#define ATOMIC_ADD(ptr, val)      __sync_fetch_and_add((ptr), (val))
+#define ATOMIC_CAS(ptr, old, new) __sync_bool_compare_and_swap((ptr), (old), \
+								(new))
+#define BARRIER()                 __sync_synchronize()
+
+/* Entry sequence word: 0 if empty, 2n + 1 while command n is being written
+   and 2n + 2 once command n is stored */
+#define SEQ_WRITING(n) (2 * (n) + 1)
+#define SEQ_STORED(n)  (2 * (n) + 2)
+
+/* Shared memory state: new (zero-filled), being loaded or ready to use */
+#define STATE_EMPTY   0
+#define STATE_LOADING 1
+#define STATE_READY   2
+
+/* Flag of an occurrence text which is a line of the history file (the
+   rest being its offset), read from the file on use */
+#define TEXT_FILE (~(~0UL >> 1))
+
+/* Working directory of an occurrence which has none (loaded from file) */
+#define TEXT_NONE (~0UL)
+
+/* Number of commands printed in each `history --stats' ranking */
+#define STATS_TOP 10
+
+/* Maximum number of index slots examined when looking for a duplicate */
+#define PROBE_MAX 32
+
+/* Largest $HISTSIZE honoured, smallest one falling back to when the shared
+   memory cannot be created */
+#define HISTORY_MAX 1000000
+#define HISTORY_MIN 32
+
+/* Text arena bytes per command (texts being shared, this is well above the
+   usual distinct text), and its minimum size */
+#define HISTORY_TEXT_BYTES 64
+#define HISTORY_ARENA_MIN  65536
+
+/* Number of times a slot being written is waited for before checking that
+   its writer is still alive, and before giving up on a writer which died
+   before recording its PID (waits are then about 1 ms long) */
+#define SPIN_MAX 1000
+
+/* Number of appends done by each writer in history_bench() */
+#define BENCH_COUNT 100000
+
+/* History file access, compressed if zlib is available (reading plain
+   files too) */
+#ifdef HAS_ZLIB
+typedef gzFile hfile_t;
+# define HFILE_OPEN(name, mode) gzopen((name), (mode))
+# define HFILE_GETS(buf, len, f) gzgets((f), (buf), (len))
+# define HFILE_PUTS(str, f)     gzputs((f), (str))
+# define HFILE_WRITE(buf, len, f) gzwrite((f), (buf), (len))
+# define HFILE_CLOSE(f)         gzclose(f)
+# define HFILE_WRITE_MODE       "wb6"
+#else
+typedef FILE *hfile_t;
+# define HFILE_OPEN(name, mode) fopen((name), (mode))
+# define HFILE_GETS(buf, len, f) fgets((buf), (len), (f))
+# define HFILE_PUTS(str, f)     fputs((str), (f))
+# define HFILE_WRITE(buf, len, f) fwrite((buf), 1, (len), (f))
+# define HFILE_CLOSE(f)         fclose(f)
+# define HFILE_WRITE_MODE       "w"
+#endif
 
 /* If the command is executed from history (to not include it twice) */
 int was_old_command = 0;
 
-/* SHM and semaphore identifiers */
-static int shm = -1, sem = -1;
+/* SHM identifier, could it not be attached? */
+static int shm = -1;
+static int shm_failed = 0;
+
+/* Search index of this process: in use?, next command number to add */
+static int           index_used = 0;
+static unsigned long indexed = 0;
+
+/* History file mapped by this process (or failed to map), its length */
+static const char *file_map = NULL;
+static int         file_failed = 0;
+static size_t      file_len;
+
+/* Command number base used while listing search results */
+static unsigned long found_base;
+
+/* Statistics of a command text, gathered by history_stats() */
+struct history_stat {
+    unsigned long count;   /* Number of occurrences              */
+    unsigned long timed;   /* Occurrences with execution details */
+    unsigned long fails;   /* Occurrences with non-zero status   */
+    long          slowest; /* Longest duration, in ms            */
+    unsigned long last;    /* Newest occurrence (to get text)    */
+    unsigned long slow;    /* Slowest occurrence (to get dir.)   */
+};
+
+/* Occurrence details copied by history_stats() */
+struct history_occurrence {
+    unsigned long text;     /* Text of the command      */
+    unsigned int  hash;     /* Its hash                 */
+    unsigned long n;        /* Command number           */
+    time_t        start;    /* Execution details        */
+    long          duration;
+    int           status;
+};
 
-/* History structure, stored in shared memory */
-static struct {
-    char commands[MAX_COMMANDS][MAX_COMMAND_LENGTH];
-    int last, oldest, offset;
+/* Statistics being sorted by history_stats() */
+static const struct history_stat *sorted_stats;
+
+/* Shared memory header, followed by `capacity' command occurrences, the
+   dedup index of their texts (`slots' positions) and the text arena
+   (`arena_size' bytes); identical commands and directories share the same
+   text */
+static struct history_header {
+    volatile int           state;       /* Shared memory state (see above) */
+    volatile pid_t         loader;      /* PID of the loading process     */
+    unsigned long          capacity;    /* Number of occurrences ($HISTSIZE) */
+    unsigned long          slots;       /* Number of dedup index slots     */
+    unsigned long          arena_size;  /* Size of the text arena          */
+    volatile unsigned long next;        /* Next command number to hand out */
+    volatile unsigned long base;        /* Number of the first user command */
+    volatile unsigned long arena_next;  /* Position of the next text       */
+    unsigned long          file_lines;  /* Commands loaded from file       */
+    int                    file_mapped; /* Are they read from the file?    */
+    unsigned long          file_start;  /* Offset of the first one         */
+    dev_t                  file_dev;    /* Identity of the loaded file     */
+    ino_t                  file_ino;
+    unsigned long          file_size;
+    time_t                 file_mtime;
 } *history = NULL;
 
+/* Command occurrence, stored in shared memory */
+static struct history_entry {
+    volatile unsigned long seq;  /* Sequence word (see above) */
+    volatile unsigned long text; /* Text of the command, or
+				    line of the history file  */
+    unsigned long cwd;           /* Text of the working
+				    directory, or TEXT_NONE   */
+    time_t        start;         /* Start time, 0 if unknown  */
+    long          duration;      /* Wall duration, in ms      */
+    int           status;        /* Exit status               */
+    int           session;       /* PID of the entering shell */
+    volatile pid_t writer;       /* PID of the process writing
+				    it, 0 if unknown          */
+} *entries = NULL;
+
+/* Command text, stored in the arena and followed by its characters; texts
+   are appended at increasing positions, the arena being used as a ring, so
+   that a text is overwritten once `arena_size' more bytes are appended */
+struct history_text {
+    volatile unsigned long pos;  /* Its position, once written */
+    unsigned int           hash; /* Hash of the text           */
+    unsigned int           len;  /* Its length                 */
+};
+
+/* Dedup index (position + 1 of a text, 0 if unused) and text arena */
+static volatile unsigned long *slots = NULL;
+static char                   *arena = NULL;
+
 
 /*****************************************************************************
  *
- * Data Types
+ * Shared Memory Layout
  *
  */
 
-/* Define a type that souldn't be defined, but usualy is, except in glibc */
-#ifdef _SEM_SEMUN_UNDEFINED
-/* Parameter used within semctl() */
-union semun {
-    int                 val;   /* Value for SETVAL             */
-    struct semid_ds    *buf;   /* Buffer for IPC_STAT, IPC_SET */
-    unsigned short int *array; /* Array for GETALL, SETALL     */
-};
-#endif /* _SEM_SEMUN_UNDEFINED */
+/*
+ * Get the size of the text arena for `capacity' commands
+ */
+static unsigned long history_arena_size(unsigned long capacity)
+{
+    unsigned long size = capacity * HISTORY_TEXT_BYTES; /* Result */
+
+    return size > HISTORY_ARENA_MIN ? size : HISTORY_ARENA_MIN;
+}
+
+/*
+ * Get the number of bytes needed to store `capacity' commands
+ */
+static size_t history_size(unsigned long capacity)
+{
+    return sizeof *history + capacity * sizeof *entries +
+	2 * capacity * sizeof *slots + history_arena_size(capacity);
+}
+
+/*
+ * Get the number of commands to keep in history, from $HISTSIZE
+ */
+static unsigned long history_capacity(void)
+{
+    const char *value = var_get("HISTSIZE"); /* Variable value */
+    long        capacity;                   /* Parsed value   */
+
+    if (value == NULL || (capacity = atol(value)) <= 0)
+	capacity = MAX_COMMANDS;
+    else if (capacity > HISTORY_MAX)
+	capacity = HISTORY_MAX;
+    return capacity;
+}
+
+/*
+ * Locate occurrences, index and arena after the header of attached shared
+ * memory
+ */
+static void history_layout(void)
+{
+    entries = (struct history_entry *) (history + 1);
+    slots = (volatile unsigned long *) (entries + history->capacity);
+    arena = (char *) (slots + history->slots);
+}
+
+/*
+ * Set up a segment of `size' bytes (zero-filled) for use as history
+ */
+static void history_format(size_t size)
+{
+    unsigned long capacity; /* Number of commands */
+
+    /* Find the largest capacity fitting in the segment */
+    capacity = (size - sizeof *history) /
+	(sizeof *entries + 2 * sizeof *slots + HISTORY_TEXT_BYTES);
+    while (history_size(capacity + 1) <= size)
+	capacity++;
+    while (capacity > 1 && history_size(capacity) > size)
+	capacity--;
+
+    history->capacity = capacity;
+    history->slots = 2 * capacity;
+    history->arena_size = history_arena_size(capacity);
+    history_layout();
+}
 
 
 /*****************************************************************************
  *
- * Shared Memory Semaphore Helpers
+ * Lock-Free Text Access
  *
  */
 
 /*
- * Lock the history for reading
+ * Check whether the process `pid', which was writing a slot, died
  */
-static void history_read_lock(void)
+static int history_dead(pid_t pid)
 {
-    /* Wait for write to be zero, then increment read */
-    struct sembuf ops[2];
+    return pid != 0 && kill(pid, 0) == -1 && errno == ESRCH;
+}
 
-    ops[0].sem_num = WRITE_SEM;
-    ops[0].sem_op  = 0;
-    ops[0].sem_flg = 0;
+/*
+ * Hash a command (FNV-1a)
+ */
+static unsigned int history_hash(const char *cmd)
+{
+    unsigned int hash = 2166136261U; /* Result */
 
-    ops[1].sem_num = READ_SEM;
-    ops[1].sem_op  = 1;
-    ops[1].sem_flg = SEM_UNDO;
+    while (*cmd != '\0')
+	hash = (hash ^ (unsigned char) *cmd++) * 16777619U;
+    return hash;
+}
 
-    semop(sem, ops, 2);
+/*
+ * Get the text header at position `pos' of the arena
+ */
+static struct history_text *history_text(unsigned long pos)
+{
+    return (struct history_text *) (arena + pos % history->arena_size);
 }
 
 /*
- * Unlock the history after reading
+ * Check whether the text at `pos' is in the newer half of the arena, so
+ * that it is kept for at least half the arena more
  */
-static void history_read_unlock(void)
+static int history_text_recent(unsigned long pos)
 {
-    /* Decrement read */
-    struct sembuf op;
+    return history->arena_next - pos <= history->arena_size / 2;
+}
 
-    op.sem_num = READ_SEM;
-    op.sem_op  = -1;
-    op.sem_flg = SEM_UNDO;
+/*
+ * Copy the text at `pos' into `buffer'; return 0 if it is not written yet
+ * (or never will be, its writer having died) or was overwritten
+ */
+static int history_text_copy(unsigned long pos, char *buffer)
+{
+    struct history_text *text = history_text(pos); /* Text header */
+    size_t               len;                      /* Its length  */
+
+    if (text->pos != pos)
+	return 0;
+    BARRIER();
+    len = text->len;
+    if (len > MAX_COMMAND_LENGTH - 1 || pos % history->arena_size +
+	sizeof *text + len > history->arena_size)
+	return 0;
+    memcpy(buffer, text + 1, len);
+    buffer[len] = '\0';
+    BARRIER();
+
+    /* Its bytes are reused only once the arena wrapped around it */
+    return history->arena_next - pos <= history->arena_size;
+}
 
-    semop(sem, &op, 1);
+/*
+ * Append a text to the arena; return its position
+ */
+static unsigned long history_append(const char *cmd, unsigned int hash,
+				    size_t len)
+{
+    struct history_text *text;    /* Text header        */
+    unsigned long        pos;     /* Its position       */
+    size_t               size;    /* Bytes it takes     */
+
+    /* Reserve room, aligned, never wrapping around the end of the arena
+       (a reservation which would is left unused) */
+    size = (sizeof *text + len + 1 + sizeof (unsigned long) - 1) &
+	~(sizeof (unsigned long) - 1);
+    do
+	pos = ATOMIC_ADD(&history->arena_next, size);
+    while (pos % history->arena_size + size > history->arena_size);
+
+    /* Write the text, then publish it */
+    text = history_text(pos);
+    text->hash = hash;
+    text->len = len;
+    memcpy(text + 1, cmd, len);
+    ((char *) (text + 1))[len] = '\0';
+    BARRIER();
+    text->pos = pos;
+    return pos;
 }
 
 /*
- * Lock the history for writing
+ * Get the position of a text holding `cmd', sharing a recent one if the
+ * same command is already known
  */
-static void history_write_lock(void)
+static unsigned long history_intern(const char *cmd)
 {
-    /* Wait for read and write to be zero, then increment write */
-    struct sembuf ops[3];
+    unsigned int         hash;              /* Command hash           */
+    unsigned long        i, slot, value;    /* Counter, index slot    */
+    unsigned long        pos;               /* Text position          */
+    unsigned long        free_value = 0;    /* Slot to use if needed  */
+    long                 free_slot = -1;
+    size_t               len;               /* Command length         */
+    struct history_text *text;              /* Current text           */
+    char                 buffer[MAX_COMMAND_LENGTH]; /* Its copy      */
+
+    /* Look for the command along its probe sequence, noting a free slot
+       (unused, or whose text is too old to be shared) */
+    len = strlen(cmd);
+    if (len > MAX_COMMAND_LENGTH - 1)
+	len = MAX_COMMAND_LENGTH - 1;
+    hash = history_hash(cmd);
+    for (i = 0; i < PROBE_MAX; i++) {
+	slot = (hash + i) % history->slots;
+	if ((value = slots[slot]) == 0 || !history_text_recent(value - 1)) {
+	    if (free_slot == -1) {
+		free_slot = slot;
+		free_value = value;
+	    }
+	    if (value == 0)
+		break;
+	    continue;
+	}
 
-    ops[0].sem_num = READ_SEM;
-    ops[0].sem_op  = 0;
-    ops[0].sem_flg = 0;
+	text = history_text((pos = value - 1));
+	if (text->hash == hash && text->len == len &&
+	    history_text_copy(pos, buffer) && !strncmp(buffer, cmd, len) &&
+	    history_text_recent(pos))
+	    return pos;
+    }
 
-    ops[1].sem_num = WRITE_SEM;
-    ops[1].sem_op  = 0;
-    ops[1].sem_flg = 0;
+    /* Append it and index it (losing a race only makes a duplicate) */
+    pos = history_append(cmd, hash, len);
+    if (free_slot != -1)
+	ATOMIC_CAS(&slots[free_slot], free_value, pos + 1);
+    return pos;
+}
 
-    ops[2].sem_num = WRITE_SEM;
-    ops[2].sem_op  = 1;
-    ops[2].sem_flg = SEM_UNDO;
 
-    semop(sem, ops, 3);
+/*****************************************************************************
+ *
+ * Lock-Free Entry Access
+ *
+ */
+
+/*
+ * Store command number `n' in its slot, along with its execution details
+ * if known (`info' may be NULL); a newer command owning the slot wins
+ */
+static void history_store(unsigned long n, const char *cmd,
+			  const struct history_info *info)
+{
+    struct history_entry *entry;          /* Occurrence slot          */
+    unsigned long         seq, pos, dir;  /* Sequence word, texts     */
+    pid_t                 writer;         /* Writer being waited for  */
+    int                   spins = 0;      /* Waits for it             */
+
+    pos = history_intern(cmd);
+    dir = info != NULL && info->cwd != NULL ? history_intern(info->cwd) :
+	TEXT_NONE;
+    entry = &entries[n % history->capacity];
+
+    /* Claim the slot, waiting for an older writer which is still copying;
+       if it died meanwhile, the slot is taken over */
+    for (;;) {
+	if ((seq = entry->seq) >= SEQ_WRITING(n))
+	    return;
+	if (!(seq & 1)) {
+	    if (ATOMIC_CAS(&entry->seq, seq, SEQ_WRITING(n)))
+		break;
+	    continue;
+	}
+
+	METRIC_COUNT(METRIC_HISTORY_WAITS);
+	if (++spins < SPIN_MAX) {
+	    sched_yield();
+	    continue;
+	}
+	writer = entry->writer;
+	if ((history_dead(writer) || (writer == 0 && spins >= 2 * SPIN_MAX))
+	    && ATOMIC_CAS(&entry->seq, seq, SEQ_WRITING(n)))
+	    break;
+	usleep(1000);
+    }
+    entry->writer = getpid();
+
+    /* Write the command, then publish it */
+    entry->text = pos;
+    entry->cwd = dir;
+    if (info != NULL) {
+	entry->start = info->start;
+	entry->duration = info->duration;
+	entry->status = info->status;
+	entry->session = getpid();
+    } else {
+	entry->start = 0;
+	entry->duration = 0;
+	entry->status = 0;
+	entry->session = 0;
+    }
+    entry->writer = 0;
+    BARRIER();
+    entry->seq = SEQ_STORED(n);
 }
 
+/* Prototypes */
+static int history_file_line(unsigned long offset, char *buffer);
+
 /*
- * Unkock the history after writing
+ * Copy command number `n' into `buffer'; return 0 if it is not available
  */
-static void history_write_unlock(void)
+static int history_fetch(unsigned long n, char *buffer)
 {
-    /* Decrement write */
-    struct sembuf op;
+    struct history_entry *entry = &entries[n % history->capacity];
+    unsigned long         seq, slot;      /* Sequence word, text */
 
-    op.sem_num = WRITE_SEM;
-    op.sem_op  = -1;
-    op.sem_flg = SEM_UNDO;
+    /* Retry as long as a writer replaced the entry while copying it (its
+       text is checked not to have been overwritten in the arena) */
+    do {
+	if ((seq = entry->seq) != SEQ_STORED(n))
+	    return 0;
+	BARRIER();
+	if ((slot = entry->text) & TEXT_FILE) {
+	    if (!history_file_line(slot & ~TEXT_FILE, buffer))
+		return 0;
+	} else if (!history_text_copy(slot, buffer))
+	    return 0;
+	BARRIER();
+    } while (entry->seq != seq);
+
+    buffer[MAX_COMMAND_LENGTH - 1] = '\0';
+    return 1;
+}
+
+/*
+ * Get the number of the oldest command still present in history
+ */
+static unsigned long history_first(unsigned long next)
+{
+    unsigned long base = history->base; /* First user command */
 
-    semop(sem, &op, 1);
+    if (next > history->capacity && next - history->capacity > base)
+	return next - history->capacity;
+    return base;
+}
+
+/*
+ * Reset history contents
+ */
+static void history_reset(void)
+{
+    memset(entries, 0, history->capacity * sizeof *entries);
+    memset((void *) slots, 0, history->slots * sizeof *slots);
+    history->next = 0;
+    history->base = 0;
+    history->arena_next = 0;
+    history->file_lines = 0;
+    history->file_mapped = 0;
+}
+
+/*
+ * Bring the search index of this process up to date with shared memory
+ */
+static void history_index(void)
+{
+    unsigned long next = history->next;  /* Next command number */
+    struct history_entry *entry;         /* Entry to index      */
+    char  buffer[MAX_COMMAND_LENGTH];    /* Command buffer      */
+
+    index_used = 1;
+    if (indexed < history_first(next))
+	indexed = history_first(next);
+
+    /* Stop at the first command still being written, skip overwritten ones */
+    for (; indexed < next; indexed++)
+	if (history_fetch(indexed, buffer))
+	    histindex_add(indexed, buffer);
+	else {
+	    entry = &entries[indexed % history->capacity];
+	    if (entry->seq < SEQ_WRITING(indexed) ||
+		(entry->seq == SEQ_WRITING(indexed) &&
+		 !history_dead(entry->writer)))
+		break;
+	}
 }
 
 
@@ -182,10 +613,11 @@ static void history_write_unlock(void)
  */
 static char *get_history_file(void)
 {
-    char *ret = NULL, *home; /* Result, home directory name */
+    char       *ret = NULL; /* Result              */
+    const char *home;       /* Home directory name */
 
     /* Construct history filename */
-    if ((home = getenv("HOME")) != NULL)
+    if ((home = var_get("HOME")) != NULL)
 	if ((ret = malloc(strlen(home) + strlen(HISTORY_FILE) + 2)) != NULL)
 	    sprintf(ret, "%s/" HISTORY_FILE, home);
 
@@ -193,62 +625,289 @@ static char *get_history_file(void)
 }
 
 /*
- * Load history from a file
+ * Map the history file loaded by the first process; return 0 if it is not
+ * available anymore
+ */
+static int history_map(void)
+{
+    int          fd;    /* File descriptor   */
+    char        *fname; /* Filename          */
+    struct stat  st;    /* File information  */
+    void        *map;   /* Mapped file       */
+
+    if (file_map != NULL)
+	return 1;
+    if (file_failed || (fname = get_history_file()) == NULL)
+	return 0;
+
+    /* Map the file only if it is still the one which was loaded */
+    map = MAP_FAILED;
+    if ((fd = open(fname, O_RDONLY)) != -1) {
+	if (fstat(fd, &st) == 0 && st.st_dev == history->file_dev &&
+	    st.st_ino == history->file_ino &&
+	    (unsigned long) st.st_size == history->file_size &&
+	    st.st_mtime == history->file_mtime && st.st_size > 0)
+	    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+    }
+    free(fname);
+
+    if (map == MAP_FAILED) {
+	file_failed = 1;
+	return 0;
+    }
+    file_map = map;
+    file_len = st.st_size;
+    return 1;
+}
+
+/*
+ * Copy the line at `offset' of the history file into `buffer', truncating
+ * it if needed; return 0 if the file is not available
+ */
+static int history_file_line(unsigned long offset, char *buffer)
+{
+    const char *line, *end; /* Line start and end */
+    size_t      len;        /* Line length        */
+
+    if (!history_map() || offset >= history->file_size)
+	return 0;
+
+    line = file_map + offset;
+    end = memchr(line, '\n', history->file_size - offset);
+    len = end != NULL ? (size_t) (end - line) :
+	history->file_size - offset;
+    if (len > MAX_COMMAND_LENGTH - 2)
+	len = MAX_COMMAND_LENGTH - 2;
+    memcpy(buffer, line, len);
+    buffer[len] = '\n';
+    buffer[len + 1] = '\0';
+    return 1;
+}
+
+/*
+ * Read a line from a history file, truncating it if needed
+ */
+static char *history_gets(char *buffer, hfile_t fd)
+{
+    char tail[MAX_COMMAND_LENGTH];      /* Rest of a long line */
+    size_t len;                         /* Line length         */
+
+    if (HFILE_GETS(buffer, MAX_COMMAND_LENGTH, fd) == NULL)
+	return NULL;
+
+    /* Skip the rest of a long line */
+    if ((len = strlen(buffer)) == MAX_COMMAND_LENGTH - 1 &&
+	buffer[len - 1] != '\n') {
+	buffer[len - 1] = '\n';
+	while (HFILE_GETS(tail, sizeof tail, fd) != NULL &&
+	       tail[strlen(tail) - 1] != '\n')
+	    ;
+    }
+    return buffer;
+}
+
+/*
+ * Load history from a file: only the newest lines are located (scanning the
+ * mapped file backwards), and their text is read on first use
  */
 static void history_load(void)
 {
-    int   next;  /* Next command in history */
-    char *fname; /* Filename                */
-    FILE *fd;    /* File descriptor         */
-
-    /* Read commands from file */
-    if ((fname = get_history_file()) != NULL) {
-	if ((fd = fopen(fname, "r")) != NULL) {
-	    while (fgets(history->commands[(next = (history->last + 1) %
-					    MAX_COMMANDS)], MAX_COMMANDS, fd)
-		   != NULL) {
-		history->last = next;
-
-		/* Update indexes */
-		if (history->last == history->oldest) {
-		    history->oldest = (history->oldest + 1) % MAX_COMMANDS;
-		    history->offset++;
-		} else if (history->oldest == -1)
-		    history->oldest = 0;
-	    }
-	    fclose(fd);
-	}
+    int          fd;                         /* File descriptor     */
+    char        *fname;                      /* Filename            */
+    struct stat  st;                         /* File information    */
+    const char  *nl;                         /* Line break          */
+    size_t       pos;                        /* Scan position       */
+    unsigned long i, count, tmp;             /* Counters, swap      */
+#ifdef HAS_ZLIB
+    unsigned char magic[2];                  /* File magic number   */
+#endif
+
+    if ((fname = get_history_file()) == NULL)
+	return;
+    if ((fd = open(fname, O_RDONLY)) == -1 || fstat(fd, &st) == -1 ||
+	st.st_size == 0) {
+	if (fd != -1)
+	    close(fd);
+	free(fname);
+	return;
+    }
 
+#ifdef HAS_ZLIB
+    /* Compressed files are read sequentially */
+    if (read(fd, magic, 2) == 2 && magic[0] == 0x1F && magic[1] == 0x8B) {
+	hfile_t hfd;                        /* Compressed file */
+	char    buffer[MAX_COMMAND_LENGTH]; /* Line buffer     */
+
+	close(fd);
+	if ((hfd = HFILE_OPEN(fname, "r")) != NULL) {
+	    while (history_gets(buffer, hfd) != NULL)
+		history_store(history->next++, buffer, NULL);
+	    HFILE_CLOSE(hfd);
+	}
+	history->file_lines = history->next;
 	free(fname);
+	return;
+    }
+#endif /* HAS_ZLIB */
+
+    /* Record the file identity so that every process can map it */
+    history->file_dev = st.st_dev;
+    history->file_ino = st.st_ino;
+    history->file_size = (unsigned long) st.st_size;
+    history->file_mtime = st.st_mtime;
+    close(fd);
+    free(fname);
+    if (!history_map())
+	return;
+
+    /* Locate the newest non-empty lines, newest first */
+    count = 0;
+    pos = history->file_size;
+    while (pos > 0 && count < history->capacity) {
+	if (file_map[pos - 1] == '\n')
+	    pos--;
+	nl = memrchr(file_map, '\n', pos);
+	i = nl != NULL ? (unsigned long) (nl - file_map) + 1 : 0;
+	if (i < pos)
+	    entries[count++].text = TEXT_FILE | i;
+	pos = i;
+    }
+
+    /* Store them as commands, oldest first */
+    for (i = 0; i < count / 2; i++) {
+	tmp = entries[i].text;
+	entries[i].text = entries[count - 1 - i].text;
+	entries[count - 1 - i].text = tmp;
     }
+    for (i = 0; i < count; i++) {
+	entries[i].cwd = TEXT_NONE;
+	entries[i].seq = SEQ_STORED(i);
+    }
+    history->next = history->file_lines = count;
+    history->file_mapped = 1;
+    history->file_start = count ? entries[0].text & ~TEXT_FILE :
+	history->file_size;
 }
 
 /*
- * Store history from to a file
+ * Get the maximum number of lines in the history file, from $HISTFILESIZE
  */
-static void history_save(void)
+static unsigned long history_file_size(void)
+{
+    const char *value = var_get("HISTFILESIZE"); /* Variable value */
+    long        size;                           /* Parsed value   */
+
+    if (value == NULL || (size = atol(value)) <= 0)
+	size = history->capacity;
+    return size;
+}
+
+/*
+ * Write up to `max' lines of the previous file which are older than command
+ * `first' (line n was loaded as command n)
+ */
+static void history_save_older(hfile_t fd, unsigned long first,
+			       unsigned long max)
 {
-    int i, limit; /* Counter, index limit */
-    char *fname;  /* Filename             */
-    FILE *fd;     /* File descriptor      */
-
-    /* Write commands to file */
-    if ((fname = get_history_file()) != NULL) {
-	if ((fd = fopen(fname, "w")) != NULL) {
-	    limit = (history->last + 1) % MAX_COMMANDS;
-	    i = history->oldest;
-
-	    /* Write command or stop if empty */
-	    if (i != -1 && history->commands[i][0] != '\0')
-		do {
-		    fputs(history->commands[i], fd);
-		    i = (i + 1) % MAX_COMMANDS;
-		} while (i != limit);
-	    fclose(fd);
+    unsigned long n, older, skip;        /* Line counts    */
+    size_t        start, end;            /* Region to copy */
+    const char   *nl;                    /* Line break     */
+    hfile_t       old;                   /* Previous file  */
+    char          buffer[MAX_COMMAND_LENGTH];
+    char         *fname;                 /* Filename       */
+
+    if (max == 0)
+	return;
+
+    if (history->file_mapped) {
+	if (!history_map())
+	    return;
+
+	/* End of older lines: start of command `first', if loaded */
+	end = history->file_start;
+	if (first >= history->file_lines)
+	    end = history->file_size;
+	else
+	    for (n = 0; n < first && end < history->file_size; ) {
+		/* Empty lines were not loaded */
+		nl = memchr(file_map + end, '\n', history->file_size - end);
+		if (nl != file_map + end)
+		    n++;
+		end = nl != NULL ? (size_t) (nl - file_map) + 1 :
+		    history->file_size;
+	    }
+
+	/* Keep the last `max' lines before it */
+	start = end;
+	for (n = 0; n < max && start > 0; n++) {
+	    nl = memrchr(file_map, '\n', start - 1);
+	    start = nl != NULL ? (size_t) (nl - file_map) + 1 : 0;
 	}
+	if (start < end) {
+	    HFILE_WRITE(file_map + start, end - start, fd);
+	    if (file_map[end - 1] != '\n')
+		HFILE_PUTS("\n", fd);
+	}
+	return;
+    }
+
+    /* Compressed file: copy lines sequentially */
+    older = first < history->file_lines ? first : history->file_lines;
+    skip = older > max ? older - max : 0;
+    if ((fname = get_history_file()) == NULL)
+	return;
+    if ((old = HFILE_OPEN(fname, "r")) != NULL) {
+	for (n = 0; n < older && history_gets(buffer, old) != NULL; n++)
+	    if (n >= skip)
+		HFILE_PUTS(buffer, fd);
+	HFILE_CLOSE(old);
+    }
+    free(fname);
+}
 
+/*
+ * Store history from to a file, keeping lines from the previous file which
+ * are older than history contents (up to $HISTFILESIZE lines in total)
+ */
+static void history_save(void)
+{
+    unsigned long n, next, first, max; /* Command numbers, maximum  */
+    char   *fname, *tmpname;           /* Filename, temporary one   */
+    hfile_t fd;                        /* File descriptor           */
+    char    buffer[MAX_COMMAND_LENGTH]; /* Command buffer            */
+
+    if ((fname = get_history_file()) == NULL)
+	return;
+    if ((tmpname = malloc(strlen(fname) + 2)) == NULL) {
 	free(fname);
+	return;
+    }
+    sprintf(tmpname, "%s~", fname);
+
+    /* Commands to write */
+    max = history_file_size();
+    next = history->next;
+    first = history_first(next);
+    if (next - first > max)
+	first = next - max;
+
+    /* Write commands to a temporary file, then replace the history file;
+       older lines are not kept if history was cleared */
+    if ((fd = HFILE_OPEN(tmpname, HFILE_WRITE_MODE)) != NULL) {
+	if (history->base == 0)
+	    history_save_older(fd, first, max - (next - first));
+	for (n = first; n < next; n++)
+	    if (history_fetch(n, buffer))
+		HFILE_PUTS(buffer, fd);
+	if (HFILE_CLOSE(fd) == 0)
+	    rename(tmpname, fname);
+	else
+	    remove(tmpname);
     }
+
+    free(tmpname);
+    free(fname);
 }
 
 
@@ -259,51 +918,70 @@ static void history_save(void)
  */
 
 /*
- * Initialize history upon program starting
+ * Attach history shared memory, loading the history file if this is the
+ * first session
  */
-void history_init(void)
+static void history_attach(void)
 {
-    int             i, uid = getuid(); /* Counter, user ID          */
-    struct shmid_ds shmds;             /* SHM description structure */
-    union semun     val;               /* Value for semctl()        */
-
-    /* Open or create shared memory */
-    if ((shm = shmget(SHM_KEY + uid, sizeof *history, IPC_CREAT | 0600))
-	== -1 || (history = shmat(shm, NULL, 0)) == NULL ||
+    int             uid = getuid(); /* User ID                   */
+    pid_t           loader;         /* Loading process           */
+    struct shmid_ds shmds;          /* SHM description structure */
+    unsigned long   capacity;       /* Number of commands        */
+
+    /* Open shared memory, or create it with room for $HISTSIZE commands,
+       or as many as the system allows */
+    capacity = history_capacity();
+    while ((shm = shmget(SHM_KEY + uid, 0, 0600)) == -1 && errno == ENOENT)
+	if ((shm = shmget(SHM_KEY + uid, history_size(capacity),
+			  IPC_CREAT | IPC_EXCL | 0600)) != -1 ||
+	    (errno != EEXIST && (capacity /= 2) < HISTORY_MIN))
+	    break;
+    if (shm == -1 || (history = shmat(shm, NULL, 0)) == (void *) -1 ||
 	shmctl(shm, IPC_STAT, &shmds) == -1) {
-	lish_perror("SHM fatal error");
-	lish_exit(RET_ERROR);
+	history = NULL;
+	shm = -1;
+	shm_failed = 1;
+	lish_perror("SHM error (history disabled)");
+	return;
     }
 
-    /* Use or create semaphores */
-    val.val = 0;
-    if ((sem = semget(SEM_KEY + uid, 2, IPC_CREAT | IPC_EXCL | 0600)) != -1) {
-	/* First process */
-	if (semctl(sem, READ_SEM,  SETVAL, val) == -1 ||
-	    semctl(sem, WRITE_SEM, SETVAL, val) == -1) {
-	    lish_perror("semaphore fatal error");
-	    lish_exit(RET_ERROR);
+    /* The first process to record its PID loads history, others wait for
+       it to be ready; if the loader died, one of them takes over */
+    if (ATOMIC_CAS(&history->loader, 0, getpid())) {
+	history->state = STATE_LOADING;
+	history_format(shmds.shm_segsz);
+    } else
+	for (;;) {
+	    if (history->state == STATE_READY) {
+		history_layout();
+		return;
+	    }
+	    if (history_dead((loader = history->loader)) &&
+		ATOMIC_CAS(&history->loader, loader, getpid())) {
+		history_format(shmds.shm_segsz);
+		history_reset();
+		break;
+	    }
+	    METRIC_COUNT(METRIC_HISTORY_WAITS);
+	    usleep(1000);
 	}
-    } else if ((sem = semget(SEM_KEY + uid, 2, IPC_CREAT | 0600)) == -1) {
-	/* Other processe(s) already running */
-	lish_perror("semaphore fatal error");
-	lish_exit(RET_ERROR);
-    }
 
-    if (shmds.shm_nattch == 1) {
-	/* First process to use this SHM */
-	history_write_lock();
-
-	/* Load history */
-	for (i = 0; i < MAX_COMMANDS; i++)
-	    history->commands[i][0] = 0;
-	history->last = -1 % MAX_COMMANDS;
-	history->oldest = -1;
-	history->offset = 0;
-	history_load();
+    /* Load history */
+    history_load();
+    BARRIER();
+    history->state = STATE_READY;
+}
 
-	history_write_unlock();
-    }
+/*
+ * Attach history at its first use, so that shells which do not use it do
+ * not pay for the shared memory and the history file; return 0 if it is not
+ * available
+ */
+static int history_use(void)
+{
+    if (history == NULL && !shm_failed)
+	history_attach();
+    return history != NULL;
 }
 
 /*
@@ -321,7 +999,6 @@ void history_exit(void)
 	    lish_abort();
 	}
 
-	history_read_lock();
 	if (shmds.shm_nattch == 1) {
 	    /* Last process to use this SHM */
 
@@ -330,15 +1007,7 @@ void history_exit(void)
 
 	    /* Save history */
 	    history_save();
-
-	    /* Destroy semaphore */
-	    if (sem != -1 && semctl(sem, 0, IPC_RMID) == -1) {
-		lish_perror("semaphore fatal error");
-		sem = -1;
-		lish_abort();
-	    }
-	} else
-	    history_read_unlock();
+	}
 
 	/* Detach shared memory */
 	if (shmdt(history) == -1) {
@@ -346,6 +1015,25 @@ void history_exit(void)
 	    history = NULL;
 	    lish_abort();
 	}
+	history = NULL;
+    }
+
+    if (file_map != NULL) {
+	munmap((void *) file_map, file_len);
+	file_map = NULL;
+    }
+    histindex_free();
+}
+
+/*
+ * Detach history from a helper process which does not use it, so that it
+ * never counts as the last process using history
+ */
+void history_detach(void)
+{
+    if (history != NULL) {
+	shmdt(history);
+	history = NULL;
     }
 }
 
@@ -366,7 +1054,8 @@ void history_exit(void)
  */
 char *history_last(void)
 {
-    char *buffer; /* String buffer */
+    unsigned long n, next, first; /* Command numbers */
+    char *buffer;                 /* String buffer   */
 
     /* Allocate memory for command */
     if ((buffer = malloc(MAX_COMMAND_LENGTH)) == NULL) {
@@ -374,17 +1063,26 @@ char *history_last(void)
 	lish_exit(RET_ERROR);
     }
 
-    was_old_command = 1;
-    history_read_lock();
-
-    /* Copy command from shared memory or print error message */
-    if (history->commands[history->last][0] != '\0')
-	strcpy(buffer, history->commands[history->last]);
-    else
+    if (!history_use()) {
 	snprintf(buffer, MAX_COMMAND_LENGTH,
-		 ECHO_CMD("%s: no command entered yet"), exe_name);
+		 ECHO_CMD("%s: history is not available"), exe_name);
+	return buffer;
+    }
+
+    was_old_command = 1;
 
-    history_read_unlock();
+    /* Copy the last stored command (skipping ones still being written, and
+       trying again if all were replaced meanwhile) or print error message */
+    do {
+	n = next = history->next;
+	first = history_first(n);
+	while (n-- > first)
+	    if (history_fetch(n, buffer))
+		return buffer;
+    } while (history->next != next);
+
+    snprintf(buffer, MAX_COMMAND_LENGTH,
+	     ECHO_CMD("%s: no command entered yet"), exe_name);
     return buffer;
 }
 
@@ -393,8 +1091,8 @@ char *history_last(void)
  */
 char *history_number(int i)
 {
-    int   pos;    /* Position in history */
-    char *buffer; /* String buffer       */
+    unsigned long n, next; /* Command number, next command */
+    char *buffer;          /* String buffer                */
 
     /* Allocate memory for command */
     if ((buffer = malloc(MAX_COMMAND_LENGTH)) == NULL) {
@@ -402,19 +1100,22 @@ char *history_number(int i)
 	lish_exit(RET_ERROR);
     }
 
+    if (!history_use()) {
+	snprintf(buffer, MAX_COMMAND_LENGTH,
+		 ECHO_CMD("%s: history is not available"), exe_name);
+	return buffer;
+    }
+
     was_old_command = 1;
-    history_read_lock();
 
     /* Copy command from shared memory or print error message */
-    pos = (history->oldest - history->offset + i) % MAX_COMMANDS;
-    if (i >= history->offset && i < history->offset + MAX_COMMANDS &&
-	history->commands[pos][0] != '\0')
-	strcpy(buffer, history->commands[pos]);
-    else
+    next = history->next;
+    n = history->base + i;
+    if (i < 0 || n < history_first(next) || n >= next ||
+	!history_fetch(n, buffer))
 	snprintf(buffer, MAX_COMMAND_LENGTH,
 		 ECHO_CMD("%s: %d: no such history index"), exe_name, i);
 
-    history_read_unlock();
     return buffer;
 }
 
@@ -423,8 +1124,8 @@ char *history_number(int i)
  */
 char *history_string(const char *str)
 {
-    int i, len, oldest; /* Counter, `str' length, oldest command */
-    char *buffer;       /* String buffer                         */
+    const char *cmd;    /* Found command */
+    char       *buffer; /* String buffer */
 
     /* Allocate memory */
     if ((buffer = malloc(MAX_COMMAND_LENGTH)) == NULL) {
@@ -432,56 +1133,44 @@ char *history_string(const char *str)
 	lish_exit(RET_ERROR);
     }
 
-    was_old_command = 1;
-    history_read_lock();
-
-    /* Initialize variables */
-    len = strlen(str);
-    buffer[0] = '\0';
-    oldest = (history->last + 1) % MAX_COMMANDS;
-
-    /* Search the command throughout history */
-    i = history->last;
-    do {
-	if (history->commands[i][0] != '\0') {
-	    if (!strncmp(history->commands[i], str, len)) {
-		strcpy(buffer, history->commands[i]);
-		break;
-	    }
-	} else
-	    break;
-	i = (i - 1) % MAX_COMMANDS;
-    } while (i != history->last);
+    if (!history_use()) {
+	snprintf(buffer, MAX_COMMAND_LENGTH,
+		 ECHO_CMD("%s: history is not available"), exe_name);
+	return buffer;
+    }
 
-    /* Print error message if not found */
-    if (buffer[0] == '\0')
-	sprintf(buffer, ECHO_CMD("%s: %s: no command beginning with that in "
-				 "history"), exe_name, str);
+    was_old_command = 1;
 
-    history_read_unlock();
+    /* Search the command in the index */
+    history_index();
+    if ((cmd = histindex_prefix(str, history_first(history->next)))
+	!= NULL)
+	strcpy(buffer, cmd);
+    else
+	/* Print error message if not found */
+	snprintf(buffer, MAX_COMMAND_LENGTH,
+		 ECHO_CMD("%s: %s: no command beginning with that in "
+			  "history"), exe_name, str);
     return buffer;
 }
 
 /*
- * Add a command to history
+ * Add a command to history, with its execution details if known (`info' may
+ * be NULL)
  */
-void history_add(const char *cmd)
+void history_add(const char *cmd, const struct history_info *info)
 {
-    history_write_lock();
+    unsigned long n; /* Command number */
 
-    /* Add command */
-    history->last = (history->last + 1) % MAX_COMMANDS;
-    strncpy(history->commands[history->last], cmd, MAX_COMMAND_LENGTH - 1);
-    history->commands[history->last][MAX_COMMAND_LENGTH - 1] = '\0';
+    if (!history_use())
+	return;
 
-    /* Update indexes */
-    if (history->last == history->oldest) {
-	history->oldest = (history->oldest + 1) % MAX_COMMANDS;
-	history->offset++;
-    } else if (history->oldest == -1)
-	history->oldest = 0;
+    /* Reserve a command number, then store the command in its slot */
+    history_store((n = ATOMIC_ADD(&history->next, 1)), cmd, info);
 
-    history_write_unlock();
+    /* Keep the search index up to date if it is in use */
+    if (index_used && indexed == n)
+	history_index();
 }
 
 /*
@@ -489,24 +1178,88 @@ void history_add(const char *cmd)
  */
 void history_list(void)
 {
-    int i, num, limit; /* Counter, user command number, index limit */
+    unsigned long n, next, base;     /* Command number, next, first user */
+    char  buffer[MAX_COMMAND_LENGTH]; /* Command buffer                   */
 
     was_old_command = 1;
-    history_read_lock();
+    if (!history_use())
+	return;
+
+    /* Print each command still present */
+    next = history->next;
+    base = history->base;
+    for (n = history_first(next); n < next; n++)
+	if (history_fetch(n, buffer))
+	    printf("[%2lu] %s", n - base, buffer);
+}
 
-    /* Find oldest command */
-    limit = (history->last + 1) % MAX_COMMANDS;
-    i = history->oldest;
+/*
+ * Print a search result
+ */
+static void history_found(unsigned long n, const char *cmd)
+{
+    printf("[%2lu] %s", n - found_base, cmd);
+}
 
-    /* Print each command, stopping upon history end */
-    num = history->offset;
-    if (i != -1 && history->commands[i][0] != '\0')
-	do {
-	    printf("[%2d] %s", num++, history->commands[i]);
-	    i = (i + 1) % MAX_COMMANDS;
-	} while (i != limit);
+/*
+ * Print commands containing `pattern' (or its characters in order, if
+ * `fuzzy' is set)
+ */
+void history_search(const char *pattern, int fuzzy)
+{
+    was_old_command = 1;
+    if (!history_use())
+	return;
+
+    history_index();
+    found_base = history->base;
+    histindex_scan(pattern, fuzzy, history_first(history->next),
+		   history_found);
+}
+
+/*
+ * Get the number of the next command to be entered (commands available for
+ * recall are numbered from history_oldest() to it)
+ */
+unsigned long history_next(void)
+{
+    return history_use() ? history->next : 0;
+}
+
+/*
+ * Get the number of the oldest command available for recall
+ */
+unsigned long history_oldest(void)
+{
+    return history_use() ? history_first(history->next) : 0;
+}
+
+/*
+ * Copy command number `n' into `buffer' (MAX_COMMAND_LENGTH bytes) without
+ * counting it as executed from history; return 0 if it is not available
+ */
+int history_get(unsigned long n, char *buffer)
+{
+    return n >= history_oldest() && n < history_next() &&
+	history_fetch(n, buffer);
+}
 
-    history_read_unlock();
+/*
+ * Find the most recent command containing `pattern' numbered before `*n',
+ * copying it into `buffer' and its number into `*n'; return 0 if none
+ */
+int history_rfind(const char *pattern, unsigned long *n, char *buffer)
+{
+    const char *cmd; /* Found command */
+
+    if (!history_use())
+	return 0;
+    history_index();
+    if ((cmd = histindex_rfind(pattern, *n, history_oldest(), n)) == NULL)
+	return 0;
+    strncpy(buffer, cmd, MAX_COMMAND_LENGTH - 1);
+    buffer[MAX_COMMAND_LENGTH - 1] = '\0';
+    return 1;
 }
 
 /*
@@ -514,19 +1267,325 @@ void history_list(void)
  */
 void history_clear(void)
 {
-    int i; /* Counter */
+    was_old_command = 1;
+    if (history_use())
+	/* Hide every command already entered */
+	history->base = history->next;
+}
+
+
+/*
+ * Comparison function grouping occurrences by hash and text, oldest first
+ */
+static int history_cmp_text(const void *a, const void *b)
+{
+    const struct history_occurrence *x = a, *y = b;
+
+    if (x->hash != y->hash)
+	return x->hash < y->hash ? -1 : 1;
+    if (x->text != y->text)
+	return x->text < y->text ? -1 : 1;
+    return x->n < y->n ? -1 : x->n > y->n ? 1 : 0;
+}
+
+/*
+ * Comparison functions used to rank command texts
+ */
+static int history_cmp_slowest(const void *a, const void *b)
+{
+    long x = sorted_stats[*(const unsigned long *) a].slowest;
+    long y = sorted_stats[*(const unsigned long *) b].slowest;
+
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int history_cmp_count(const void *a, const void *b)
+{
+    unsigned long x = sorted_stats[*(const unsigned long *) a].count;
+    unsigned long y = sorted_stats[*(const unsigned long *) b].count;
+
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+static int history_cmp_fails(const void *a, const void *b)
+{
+    unsigned long x = sorted_stats[*(const unsigned long *) a].fails;
+    unsigned long y = sorted_stats[*(const unsigned long *) b].fails;
+
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/*
+ * Copy the working directory of command number `n' into `buffer'; return 0
+ * if it is not available
+ */
+static int history_fetch_cwd(unsigned long n, char *buffer)
+{
+    struct history_entry *entry = &entries[n % history->capacity];
+    unsigned long         seq, dir;       /* Sequence word, text */
+
+    do {
+	if ((seq = entry->seq) != SEQ_STORED(n))
+	    return 0;
+	BARRIER();
+	if ((dir = entry->cwd) == TEXT_NONE)
+	    return 0;
+	if (!history_text_copy(dir, buffer))
+	    return 0;
+	BARRIER();
+    } while (entry->seq != seq);
+    return 1;
+}
+
+/*
+ * Print command number `n' without its line break, after `prefix'
+ */
+static void history_stats_print(unsigned long n, const char *prefix)
+{
+    char buffer[MAX_COMMAND_LENGTH]; /* Command buffer */
+
+    if (history_fetch(n, buffer)) {
+	buffer[strcspn(buffer, "\n")] = '\0';
+	printf("  %s  %s\n", prefix, buffer);
+    }
+}
+
+/*
+ * Print the slowest, most frequent and most failing commands; occurrences
+ * are gathered by text, texts with the same hash being compared only where
+ * the same command was stored twice
+ */
+void history_stats(void)
+{
+    struct history_occurrence *occs, *occ; /* Present occurrences      */
+    struct history_stat  *stats, *stat;    /* Statistics by text       */
+    struct history_entry *entry;           /* Current occurrence       */
+    unsigned long        *order;           /* Texts being ranked       */
+    unsigned long         n, next, first;  /* Command numbers          */
+    unsigned long         i, count, texts; /* Counters                 */
+    unsigned long         seq;             /* Sequence word            */
+    char  prefix[32], dir[MAX_COMMAND_LENGTH]; /* Output buffers       */
+    char  text[MAX_COMMAND_LENGTH], last[MAX_COMMAND_LENGTH]; /* Texts */
+
+    if (!history_use())
+	return;
 
     was_old_command = 1;
-    history_write_lock();
 
-    /* Reset fields */
-    for (i = 0; i < MAX_COMMANDS; i++)
-	history->commands[i][0] = 0;
-    history->last = -1 % MAX_COMMANDS;
-    history->oldest = -1;
-    history->offset = 0;
+    /* Everything is sized by the number of commands present */
+    next = history->next;
+    first = history_first(next);
+    count = next - first > 0 ? next - first : 1;
+    if ((occs = malloc(count * sizeof *occs)) == NULL ||
+	(stats = calloc(count, sizeof *stats)) == NULL ||
+	(order = malloc(count * sizeof *order)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+
+    /* Copy occurrence details (lines of the history file cannot be
+       gathered without reading them, and have no details) */
+    count = 0;
+    for (n = first; n < next; n++) {
+	entry = &entries[n % history->capacity];
+	occ = &occs[count];
+	do {
+	    if ((seq = entry->seq) != SEQ_STORED(n))
+		break;
+	    BARRIER();
+	    occ->text = entry->text;
+	    occ->start = entry->start;
+	    occ->duration = entry->duration;
+	    occ->status = entry->status;
+	    BARRIER();
+	} while (entry->seq != seq);
+	if (seq == SEQ_STORED(n) && !(occ->text & TEXT_FILE) &&
+	    history_text_copy(occ->text, text)) {
+	    occ->hash = history_hash(text);
+	    occ->n = n;
+	    count++;
+	}
+    }
+
+    /* Gather them by text */
+    qsort(occs, count, sizeof *occs, history_cmp_text);
+    for (texts = i = 0; i < count; i++) {
+	occ = &occs[i];
+	if (i == 0 || occ->text != occs[i - 1].text) {
+	    if (!history_text_copy(occ->text, text))
+		*text = '\0';
+	    if (i == 0 || occ->hash != occs[i - 1].hash ||
+		strcmp(text, last) != 0)
+		texts++;
+	    strcpy(last, text);
+	}
+	stat = &stats[texts - 1];
+	stat->count++;
+	stat->last = occ->n;
+	if (occ->start == 0)
+	    continue;
+	stat->timed++;
+	if (occ->status != 0)
+	    stat->fails++;
+	if (stat->timed == 1 || occ->duration >= stat->slowest) {
+	    stat->slowest = occ->duration;
+	    stat->slow = occ->n;
+	}
+    }
+    free(occs);
+    sorted_stats = stats;
+
+    /* Slowest commands */
+    for (count = i = 0; i < texts; i++)
+	if (stats[i].timed > 0)
+	    order[count++] = i;
+    qsort(order, count, sizeof *order, history_cmp_slowest);
+    puts("Slowest commands:");
+    for (i = 0; i < count && i < STATS_TOP; i++) {
+	stat = &stats[order[i]];
+	sprintf(prefix, "%7ld.%03ld s", stat->slowest / 1000,
+		stat->slowest % 1000);
+	history_stats_print(stat->slow, prefix);
+	if (history_fetch_cwd(stat->slow, dir))
+	    printf("  %13s  (in %s)\n", "", dir);
+    }
+
+    /* Most frequent commands */
+    for (count = i = 0; i < texts; i++)
+	if (stats[i].count > 0)
+	    order[count++] = i;
+    qsort(order, count, sizeof *order, history_cmp_count);
+    puts("Most frequent commands:");
+    for (i = 0; i < count && i < STATS_TOP; i++) {
+	sprintf(prefix, "%13lu", stats[order[i]].count);
+	history_stats_print(stats[order[i]].last, prefix);
+    }
 
-    history_write_unlock();
+    /* Most failing commands */
+    for (count = i = 0; i < texts; i++)
+	if (stats[i].fails > 0)
+	    order[count++] = i;
+    qsort(order, count, sizeof *order, history_cmp_fails);
+    puts("Most failing commands:");
+    for (i = 0; i < count && i < STATS_TOP; i++) {
+	stat = &stats[order[i]];
+	sprintf(prefix, "%7lu / %3lu", stat->fails, stat->timed);
+	history_stats_print(stat->last, prefix);
+    }
+
+    free(order);
+    free(stats);
+}
+
+
+/*****************************************************************************
+ *
+ * Contention Benchmark
+ *
+ */
+
+/*
+ * Append a command as the semaphore scheme which preceded lock-free history
+ * did: all readers and writers excluded while writing, undone on crash
+ */
+static void history_bench_locked(int sem, const char *cmd)
+{
+    struct sembuf ops[3]; /* Semaphore operations */
+
+    /* Wait for read and write to be zero, then increment write */
+    ops[0].sem_num = 0;
+    ops[0].sem_op  = 0;
+    ops[0].sem_flg = 0;
+    ops[1].sem_num = 1;
+    ops[1].sem_op  = 0;
+    ops[1].sem_flg = 0;
+    ops[2].sem_num = 1;
+    ops[2].sem_op  = 1;
+    ops[2].sem_flg = SEM_UNDO;
+    semop(sem, ops, 3);
+
+    history_store(history->next++, cmd, NULL);
+
+    /* Decrement write */
+    ops[0].sem_num = 1;
+    ops[0].sem_op  = -1;
+    ops[0].sem_flg = SEM_UNDO;
+    semop(sem, ops, 1);
+}
+
+/*
+ * Let `writers' processes append commands concurrently, serialized by the
+ * semaphore set `sem' if it is not -1; return the elapsed time, in seconds
+ */
+static double history_bench_run(int writers, int sem)
+{
+    int            i, j;       /* Counters            */
+    pid_t          pid;        /* Created process PID */
+    struct timeval start, end; /* Start and end times */
+    char           buffer[64]; /* Command buffer      */
+
+    history_reset();
+    gettimeofday(&start, NULL);
+    for (i = 0; i < writers; i++)
+	if ((pid = fork()) == 0) {
+	    for (j = 0; j < BENCH_COUNT; j++) {
+		sprintf(buffer, "bench %d %d\n", i, j);
+		if (sem != -1)
+		    history_bench_locked(sem, buffer);
+		else
+		    history_add(buffer, NULL);
+	    }
+	    _exit(0);
+	} else if (pid == -1)
+	    lish_perror("could not fork");
+    while (wait(NULL) > 0)
+	;
+    gettimeofday(&end, NULL);
+
+    return (end.tv_sec - start.tv_sec) +
+	(end.tv_usec - start.tv_usec) / 1000000.0;
+}
+
+/*
+ * Measure concurrent appends by `writers' processes on a private history,
+ * lock-free and serialized by a semaphore for comparison
+ */
+void history_bench(int writers)
+{
+    int    sem;              /* Semaphore set of the baseline   */
+    size_t size;             /* Shared memory size              */
+    double locked, elapsed;  /* Elapsed times, in seconds       */
+
+    /* Use a private segment so that the user history is left untouched */
+    size = history_size(history_capacity());
+    if ((shm = shmget(IPC_PRIVATE, size, IPC_CREAT | 0600)) == -1 ||
+	(history = shmat(shm, NULL, 0)) == (void *) -1 ||
+	(sem = semget(IPC_PRIVATE, 2, IPC_CREAT | 0600)) == -1) {
+	if (shm != -1)
+	    shmctl(shm, IPC_RMID, NULL);
+	history = NULL;
+	lish_perror("SHM fatal error");
+	lish_exit(RET_ERROR);
+    }
+    shmctl(shm, IPC_RMID, NULL);
+    history_format(size);
+    history->state = STATE_READY;
+
+    /* Semaphore baseline, then lock-free appends */
+    locked = history_bench_run(writers, sem);
+    semctl(sem, 0, IPC_RMID);
+    elapsed = history_bench_run(writers, -1);
+
+    /* Print results */
+    printf("history: %d writers, %lu appends: semaphore %.3f s "
+	   "(%.0f appends/s), lock-free %.3f s (%.0f appends/s)\n",
+	   writers, history->next, locked,
+	   locked > 0 ? history->next / locked : 0.0, elapsed,
+	   elapsed > 0 ? history->next / elapsed : 0.0);
+
+    shmdt(history);
+    history = NULL;
+    shm = -1;
 }
 
 /* End of file */
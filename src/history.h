@@ -33,18 +33,36 @@
 #ifndef _HISTORY_H_
 #define _HISTORY_H_
 
+/* Headers */
+#include <time.h> /* time_t */
+
+/* Execution details of a command, stored along with it */
+struct history_info {
+    time_t      start;    /* Start time                  */
+    long        duration; /* Wall duration, in ms        */
+    int         status;   /* Exit status                 */
+    const char *cwd;      /* Working directory it ran in */
+};
+
 /* Extern variables */
 extern int was_old_command;
 
 /* Prototypes */
-void  history_init(void);
 void  history_exit(void);
+void  history_detach(void);
 char *history_last(void);
 char *history_number(int i);
 char *history_string(const char *str);
-void  history_add(const char *cmd);
+void  history_add(const char *cmd, const struct history_info *info);
 void  history_list(void);
+void  history_search(const char *pattern, int fuzzy);
 void  history_clear(void);
+unsigned long history_next(void);
+unsigned long history_oldest(void);
+int   history_get(unsigned long n, char *buffer);
+int   history_rfind(const char *pattern, unsigned long *n, char *buffer);
+void  history_stats(void);
+void  history_bench(int writers);
 
 #endif /* !_HISTORY_H_ */
 
@@ -31,12 +31,11 @@
 
 
 #define _POSIX_SOURCE /* For kill() */
-#define _BSD_SOURCE   /* For setenv() */
 
 /* Standard C headers */
-#include <stdlib.h>  /* NULL, getenv(), setenv(), strtol() */
+#include <stdlib.h>  /* NULL, strtol(), malloc(), free() */
 #include <stdio.h>   /* stderr, fprintf(), perror() */
-#include <string.h>  /* strcmp(), strchr() */
+#include <string.h>  /* strcmp(), strncmp(), strchr(), strcpy() */
 #include <strings.h> /* strcasecmp() */
 
 /* Standard Unix headers */
@@ -45,8 +44,16 @@
 #include <signal.h> /* SIG*, kill() */
 
 /* Project headers */
-#include "main.h"
+#include "shell.h"
 #include "history.h"
+#include "prompt.h"
+#include "variable.h"
+#include "plugin.h"
+#include "limit.h"
+#include "jobqueue.h"
+#include "optimize.h"
+#include "metrics.h"
+#include "alloc.h"
 #include "internal.h"
 
 
@@ -155,7 +162,7 @@ static int internal_cd(int argc, char *argv[])
     /* If no argument is given, cd to home */
     if (argc == 2)
 	dir = argv[1];
-    else if ((dir = getenv("HOME")) == NULL) {
+    else if ((dir = (char *) var_get("HOME")) == NULL) {
 	fprintf(stderr, "%s: cd: $HOME not set\n", exe_name);
 	return 2;
     }
@@ -244,56 +251,96 @@ static int internal_exit(int argc, char *argv[])
 }
 
 /*
- * Internal command: `export' (set an environment variable)
+ * Internal command: `export' (set and/or export variables, or list exported
+ * ones)
  */
 static int internal_export(int argc, char *argv[])
 {
-    int i, ret = 0; /* Counter, return code   */
-    char *equal;    /* Location of equal sign */
+    int i, ret = 0; /* Counter, return code */
 
     if (argc == 1) {
-	fprintf(stderr, "%s: export: syntax error: export key1=value1 "
-		"[key2=value2...]\n", exe_name);
-	return RET_ERROR;
+	var_list(VAR_EXPORT);
+	return 0;
     }
 
-    /* Set each argument */
+    /* Set and export each variable, or only export it */
     for (i = 1; i < argc; i++) {
-	if ((equal = strchr(argv[i], '=')) == NULL) {
-	    fprintf(stderr, "%s: export: %s: syntax must be key=value",
-		    exe_name, argv[i]);
-	    ret = i;
+	if (var_assign(argv[i], VAR_EXPORT))
+	    continue;
+	if (strchr(argv[i], '=') == NULL && argv[i][0] != '\0') {
+	    var_export(argv[i]);
 	    continue;
 	}
-
-	/* Export the environment variable */
-	*equal = '\0';
-	if (setenv(argv[i], equal + 1, 1) == -1) {
-	    fprintf(stderr, "%s: export: ", exe_name);
-	    perror(argv[i]);
-	    ret = i;
-	}
-	*equal = '=';
+	fprintf(stderr, "%s: export: %s: syntax must be key=value or key\n",
+		exe_name, argv[i]);
+	ret = i;
     }
 
+    /* $PS1 or $HOME may have changed */
+    prompt_invalidate(PROMPT_ENV);
     return ret;
 }
 
 /*
- * Internal command: `history' (print command history)
+ * Internal command: `set' (list variables, or change settings, like
+ * `set maxjobs=N maxload=L optimize=catfile,subshell')
  */
-static int internal_history(int argc, char *argv[] UNUSED)
+static int internal_set(int argc, char *argv[])
 {
-    if (argc != 1 && (argc != 2 || strcmp(argv[1], "-c"))) {
-	fprintf(stderr, "%s: history: syntax error: history [-c]\n",
-		exe_name);
-	return 1;
+    int i, status, ret = 0; /* Counter, setting status, return code */
+
+    if (argc == 1) {
+	var_list(0);
+	return 0;
+    }
+
+    /* Optimizer and background job settings */
+    for (i = 1; i < argc; i++) {
+	if ((status = optimize_set(argv[i])) == -1 &&
+	    (status = jobqueue_set(argv[i])) == -1)
+	    fprintf(stderr, "%s: set: %s: unknown setting\n", exe_name,
+		    argv[i]);
+	if (status != 0)
+	    ret = 1;
     }
+    return ret;
+}
 
+/*
+ * Internal command: `unset' (remove variables)
+ */
+static int internal_unset(int argc, char *argv[])
+{
+    int i; /* Counter */
+
+    for (i = 1; i < argc; i++)
+	var_unset(argv[i]);
+    prompt_invalidate(PROMPT_ENV);
+    return 0;
+}
+
+/*
+ * Internal command: `history' (print, search, clear or summarize command
+ * history)
+ */
+static int internal_history(int argc, char *argv[])
+{
     if (argc == 1)
 	history_list();
-    else
+    else if (argc == 2 && !strcmp(argv[1], "-c"))
 	history_clear();
+    else if (argc == 2 && !strcmp(argv[1], "--stats"))
+	history_stats();
+    else if (argc == 3 && !strcmp(argv[1], "-s"))
+	history_search(argv[2], 0);
+    else if (argc == 3 && !strcmp(argv[1], "-f"))
+	history_search(argv[2], 1);
+    else {
+	fprintf(stderr, "%s: history: syntax error: history [-c | --stats | "
+		"-s pattern | -f pattern]\n", exe_name);
+	return 1;
+    }
+
     return 0;
 }
 
@@ -389,20 +436,162 @@ static int internal_kill(int argc, char *argv[])
     return ret;
 }
 
+/*
+ * Internal command: `ulimit' (print or set resource limits of the shell and
+ * its children)
+ */
+static int internal_ulimit(int argc, char *argv[])
+{
+    int         i;            /* Counter                      */
+    const char *opt;          /* Current option letter        */
+    int         which = 0;    /* LIMIT_SOFT and/or LIMIT_HARD */
+    int         option = 'f'; /* Resource option, or 'a'      */
+
+    /* Parse options, like `-S -n' or `-Hn' */
+    for (i = 1; i < argc && argv[i][0] == '-' && argv[i][1] != '\0'; i++)
+	for (opt = argv[i] + 1; *opt != '\0'; opt++)
+	    if (*opt == 'S')
+		which |= LIMIT_SOFT;
+	    else if (*opt == 'H')
+		which |= LIMIT_HARD;
+	    else
+		option = *opt;
+
+    if (i == argc)
+	return limit_show(option, which == LIMIT_HARD ? LIMIT_HARD :
+			  LIMIT_SOFT);
+    if (i + 1 == argc && option != 'a')
+	return limit_set(option, argv[i], which != 0 ? which :
+			 LIMIT_SOFT | LIMIT_HARD);
+
+    fprintf(stderr, "%s: ulimit: syntax error: ulimit [-S | -H] "
+	    "[-a | -{c|d|f|l|m|n|s|t|u|v} [limit | unlimited]]\n", exe_name);
+    return 1;
+}
+
+/*
+ * Internal command: `stats' (print runtime counters and latencies, or
+ * allocations by subsystem)
+ */
+static int internal_stats(int argc, char *argv[])
+{
+    if (argc == 1)
+	metrics_print(0);
+    else if (argc == 2 && !strcmp(argv[1], "--openmetrics"))
+	metrics_print(1);
+    else if (argc == 2 && !strcmp(argv[1], "--alloc"))
+	alloc_report(stdout);
+    else {
+	fprintf(stderr, "%s: stats: syntax error: stats [--openmetrics | "
+		"--alloc]\n", exe_name);
+	return 1;
+    }
+    return 0;
+}
+
+/*
+ * Internal command: `enable' (load builtins from a shared object, remove
+ * loaded ones or list all)
+ */
+static int internal_enable(int argc, char *argv[])
+{
+    int i, ret = 0; /* Counter, return code */
+
+    if (argc == 1) {
+	internal_list();
+	return 0;
+    }
+    if (argc >= 3 && !strcmp(argv[1], "-f"))
+	return plugin_load(argv[2], argc - 3, argv + 3);
+    if (argc >= 3 && !strcmp(argv[1], "-d")) {
+	for (i = 2; i < argc; i++)
+	    if (internal_remove(argv[i]) == -1) {
+		fprintf(stderr, "%s: enable: %s: not a loaded builtin\n",
+			exe_name, argv[i]);
+		ret = 1;
+	    }
+	return ret;
+    }
+
+    fprintf(stderr, "%s: enable: syntax error: enable [-f file [name...] | "
+	    "-d name...]\n", exe_name);
+    return 1;
+}
+
+/* Internal command, chained in a hash table bucket */
+struct internal {
+    struct internal *next;                         /* Next in bucket */
+    const char      *name;                         /* Command name   */
+    int            (*function)(int argc, char *argv[]);
+    int              flags;                        /* INTERNAL_*     */
+};
+
 /* Internal command table */
-static const struct {
-    const char *name;
-    int       (*function)(int argc, char *argv[]);
-} internals[] = {
-    { "cd",      internal_cd      },
-    { "echo",    internal_echo    },
-    { "exec",    internal_exec    },
-    { "exit",    internal_exit    },
-    { "export",  internal_export  },
-    { "history", internal_history },
-    { "kill",    internal_kill    }
+static struct internal internals[] = {
+    { NULL, "cd",      internal_cd,      0             },
+    { NULL, "echo",    internal_echo,    INTERNAL_PURE },
+    { NULL, "enable",  internal_enable,  0             },
+    { NULL, "exec",    internal_exec,    0             },
+    { NULL, "exit",    internal_exit,    0             },
+    { NULL, "export",  internal_export,  0             },
+    { NULL, "history", internal_history, INTERNAL_PURE },
+    { NULL, "kill",    internal_kill,    INTERNAL_PURE },
+    { NULL, "set",     internal_set,     0             },
+    { NULL, "stats",   internal_stats,   INTERNAL_PURE },
+    { NULL, "ulimit",  internal_ulimit,  0             },
+    { NULL, "unset",   internal_unset,   0             }
 };
 
+/* Hash table of internal commands (those of the table, then the ones added
+   by plugins), filled at the first lookup */
+#define INTERNAL_BUCKETS 128
+static struct internal *buckets[INTERNAL_BUCKETS];
+static int              hashed = 0;
+
+
+/*****************************************************************************
+ *
+ * Internal Command Lookup
+ *
+ */
+
+/*
+ * Hash a command name (FNV-1a)
+ */
+static unsigned int internal_hash(const char *name)
+{
+    unsigned int hash = 2166136261U; /* Result */
+
+    while (*name != '\0')
+	hash = (hash ^ (unsigned char) *name++) * 16777619U;
+    return hash % INTERNAL_BUCKETS;
+}
+
+/*
+ * Find the link to internal command `name' in its bucket (the link after
+ * which it would be if it is unknown)
+ */
+static struct internal **internal_link(const char *name)
+{
+    struct internal **link;  /* Link to current command */
+    size_t            i;     /* Counter                 */
+
+    if (!hashed) {
+	for (i = 0; i < sizeof internals / sizeof *internals; i++) {
+	    link = &buckets[internal_hash(internals[i].name)];
+	    internals[i].next = *link;
+	    *link = &internals[i];
+	}
+	hashed = 1;
+    }
+
+    for (link = &buckets[internal_hash(name)]; *link != NULL;
+	 link = &(*link)->next)
+	if (!strcmp((*link)->name, name))
+	    break;
+    return link;
+}
+
 
 /*****************************************************************************
  *
@@ -410,17 +599,133 @@ static const struct {
  *
  */
 
+/*
+ * Call `found' for each internal command beginning by `prefix'
+ */
+void internal_complete(const char *prefix, void (*found)(const char *name))
+{
+    struct internal *internal; /* Current command */
+    int              i;        /* Counter         */
+
+    internal_link("");
+    for (i = 0; i < INTERNAL_BUCKETS; i++)
+	for (internal = buckets[i]; internal; internal = internal->next)
+	    if (!strncmp(internal->name, prefix, strlen(prefix)))
+		found(internal->name);
+}
+
+/*
+ * Print the enabled internal commands
+ */
+void internal_list(void)
+{
+    struct internal *internal; /* Current command */
+    int              i;        /* Counter         */
+
+    internal_link("");
+    for (i = 0; i < INTERNAL_BUCKETS; i++)
+	for (internal = buckets[i]; internal; internal = internal->next)
+	    printf("enable %s\n", internal->name);
+}
+
+/*
+ * Print the names of the internal commands of the table (those of lish
+ * itself), separated by commas
+ */
+void internal_names(void)
+{
+    size_t i; /* Counter */
+
+    for (i = 0; i < sizeof internals / sizeof *internals; i++)
+	printf(i > 0 ? ", %s" : "%s", internals[i].name);
+}
+
+/*
+ * Add internal command `name' (replacing a known one); return 0
+ */
+int internal_add(const char *name, int (*function)(int argc, char *argv[]),
+		 int flags)
+{
+    struct internal **link = internal_link(name); /* Its link    */
+    struct internal  *internal;                   /* New command */
+    char             *copy;                       /* Its name    */
+
+    if ((internal = malloc(sizeof *internal)) == NULL ||
+	(copy = malloc(strlen(name) + 1)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    internal->name = strcpy(copy, name);
+    internal->function = function;
+    internal->flags = flags | INTERNAL_ADDED;
+
+    /* A replaced command is kept behind the new one if it is static */
+    if (*link != NULL && ((*link)->flags & INTERNAL_ADDED)) {
+	internal->next = (*link)->next;
+	free((char *) (*link)->name);
+	free(*link);
+    } else
+	internal->next = *link;
+    *link = internal;
+    return 0;
+}
+
+/*
+ * Remove added internal command `name' (uncovering the static one it may
+ * have replaced); return -1 if there is none
+ */
+int internal_remove(const char *name)
+{
+    struct internal **link = internal_link(name); /* Its link */
+    struct internal  *internal = *link;           /* Command  */
+
+    if (internal == NULL || !(internal->flags & INTERNAL_ADDED))
+	return -1;
+    *link = internal->next;
+    free((char *) internal->name);
+    free(internal);
+    return 0;
+}
+
+/*
+ * Remove every added internal command
+ */
+void internal_free(void)
+{
+    struct internal **link, *internal; /* Link to command, command */
+    int               i;               /* Counter                  */
+
+    for (i = 0; i < INTERNAL_BUCKETS; i++)
+	for (link = &buckets[i]; (internal = *link) != NULL; )
+	    if (internal->flags & INTERNAL_ADDED) {
+		*link = internal->next;
+		free((char *) internal->name);
+		free(internal);
+	    } else
+		link = &internal->next;
+}
+
+/*
+ * Get the INTERNAL_* flags of internal command `name', or -1 if it is not one
+ */
+int internal_flags(const char *name)
+{
+    struct internal *internal = *internal_link(name); /* Command */
+
+    return internal != NULL ? internal->flags : -1;
+}
+
 /*
  * Execute an internal command and return error code or -1 if not found
  */
-int exec_internal(char argc, char *argv[])
+int exec_internal(int argc, char *argv[])
 {
-    int i; /* Counter */
+    struct internal *internal; /* Command */
 
-    if (argc > 0)
-	for (i = 0; i < (int) (sizeof internals / sizeof *internals); i++)
-	    if (!strcmp(argv[0], internals[i].name))
-		return internals[i].function(argc, argv);
+    if (argc > 0 && (internal = *internal_link(argv[0])) != NULL) {
+	METRIC_COUNT(METRIC_BUILTINS);
+	return internal->function(argc, argv);
+    }
 
     return -1;
 }
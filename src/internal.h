@@ -33,8 +33,22 @@
 #ifndef _INTERNAL_H_
 #define _INTERNAL_H_
 
+/* Internal command flags */
+#define INTERNAL_PURE   1 /* Leaves the shell state alone (can run
+			     in-process where a subshell is expected) */
+#define INTERNAL_ADDED  2 /* Added at run time (by a plugin)       */
+
 /* Prototypes */
-int exec_internal(char argc, char *argv[]);
+void internal_list(void);
+void internal_names(void);
+int  internal_add(const char *name, int (*function)(int argc, char *argv[]),
+		  int flags);
+int  internal_remove(const char *name);
+void internal_free(void);
+int  internal_flags(const char *name);
+int  exec_internal(int argc, char *argv[]);
+void internal_complete(const char *prefix,
+		       void (*found)(const char *name));
 
 #endif /* !_INTERNAL_H_ */
 
@@ -0,0 +1,484 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/jobqueue.c
+ *
+ * Description: Background Job Queue and GNU make Jobserver Client
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+
+#define _GNU_SOURCE /* For O_CLOEXEC */
+
+/* Standard C headers */
+#include <stdio.h>  /* printf(), fprintf(), fopen(), fscanf()  */
+#include <stdlib.h> /* NULL, malloc(), free(), strtol(), strtod() */
+#include <string.h> /* strncmp(), strchr(), strstr(), strcspn() */
+#include <errno.h>  /* errno                                   */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/stat.h> /* fstat(), S_ISFIFO()                   */
+#include <sys/wait.h> /* waitpid(), WIFSTOPPED(), ...          */
+#include <unistd.h>   /* read(), write(), close(), getpid()    */
+#include <fcntl.h>    /* open(), fcntl()                       */
+#include <signal.h>   /* signal(), kill()                      */
+#include <sys/time.h> /* select(), fd_set                      */
+
+/* Project headers */
+#include <common.h>
+#include <command.h>
+#include "shell.h"
+#include "variable.h"
+#include "execcmd.h"
+#include "jobqueue.h"
+
+
+/*****************************************************************************
+ *
+ * Global Variables
+ *
+ */
+
+/* A job waiting to be launched */
+struct job {
+    command_t  *command; /* The job, as a command of its own */
+    struct job *next;    /* Next job in the queue            */
+};
+
+/* Run queue (first in, first out) */
+static struct job *queue_head = NULL;
+static struct job *queue_tail = NULL;
+
+/* Settings (0: no limit) */
+static int    max_jobs = 0;  /* Maximum number of running jobs   */
+static double max_load = 0;  /* Load average under which they start */
+
+/* GNU make jobserver */
+static int jobserver_read = -1;  /* Descriptor tokens are taken from   */
+static int jobserver_write = -1; /* Descriptor they are given back to  */
+static int jobserver_known = 0;  /* Has $MAKEFLAGS been looked at?     */
+static int tokens = 0;           /* Tokens held (one per job but one)  */
+static char token = '+';         /* Token to give back                 */
+
+/* Process owning the queue and the tokens: a forked subshell starts with
+   none, and with no jobs */
+static pid_t owner = 0;
+
+/* Is the shell waiting for input, when queued jobs may be launched? */
+static volatile int idle = 0;
+
+/* Pipe written by the SIGCHLD handler to wake up the shell waiting for
+   input, so that it launches queued jobs itself */
+static int wakeup[2] = { -1, -1 };
+
+
+/*****************************************************************************
+ *
+ * GNU make Jobserver
+ *
+ */
+
+/*
+ * Open the descriptors of the jobserver given by $MAKEFLAGS, if any
+ */
+static void jobserver_open(void)
+{
+    const char *flags, *auth, *found = NULL; /* $MAKEFLAGS, option */
+    char        path[4096];                  /* FIFO path          */
+    struct stat st;                          /* File status        */
+    size_t      len;                         /* Path length        */
+    char       *end;                         /* End of a number    */
+    long        in, out;                     /* Pipe descriptors   */
+
+    jobserver_known = 1;
+    if ((flags = var_get("MAKEFLAGS")) == NULL)
+	return;
+
+    /* The last option wins; GNU make before 4.2 names it --jobserver-fds */
+    for (auth = flags; (auth = strstr(auth, "--jobserver-")) != NULL; auth++)
+	if (!strncmp(auth + 12, "auth=", 5))
+	    found = auth + 17;
+	else if (!strncmp(auth + 12, "fds=", 4))
+	    found = auth + 16;
+    if (found == NULL)
+	return;
+
+    if (!strncmp(found, "fifo:", 5)) {
+	/* GNU make 4.4 and later: a named pipe */
+	if ((len = strcspn(found + 5, " ")) >= sizeof path)
+	    return;
+	memcpy(path, found + 5, len);
+	path[len] = '\0';
+	if ((jobserver_read = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC))
+	    != -1)
+	    jobserver_write = open(path, O_WRONLY | O_CLOEXEC);
+    } else {
+	/* Inherited pipe descriptors, which make may have closed (for
+	   commands not run by a recursive make); the read end is opened
+	   again in non-blocking mode, not to block make by changing it */
+	in = strtol(found, &end, 10);
+	if (*end != ',')
+	    return;
+	out = strtol(end + 1, &end, 10);
+	if (fstat(in, &st) == -1 || !S_ISFIFO(st.st_mode) ||
+	    fcntl(out, F_GETFD) == -1)
+	    return;
+	sprintf(path, "/proc/self/fd/%ld", in);
+	if ((jobserver_read = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC))
+	    != -1 && (jobserver_write = dup(out)) != -1)
+	    fcntl(jobserver_write, F_SETFD, FD_CLOEXEC);
+    }
+
+    if (jobserver_write == -1 && jobserver_read != -1) {
+	close(jobserver_read);
+	jobserver_read = -1;
+    }
+}
+
+/*
+ * Take a token from the jobserver; return 0 if none is free
+ */
+static int jobserver_take(void)
+{
+    ssize_t ret; /* Bytes read */
+
+    while ((ret = read(jobserver_read, &token, 1)) == -1 && errno == EINTR)
+	;
+    if (ret != 1)
+	return 0;
+    tokens++;
+    return 1;
+}
+
+/*
+ * Give a token back to the jobserver
+ */
+static void jobserver_give(void)
+{
+    while (write(jobserver_write, &token, 1) == -1 && errno == EINTR)
+	;
+    tokens--;
+}
+
+
+/*****************************************************************************
+ *
+ * Job Slots
+ *
+ */
+
+/*
+ * Forget the queue and the jobs of the parent shell in a forked subshell
+ */
+static void jobqueue_own(void)
+{
+    pid_t pid = getpid(); /* Current process */
+
+    if (owner == pid)
+	return;
+    if (owner != 0) {
+	queue_head = queue_tail = NULL;
+	exec_ctx->jobs = 0;
+	tokens = 0;
+	if (wakeup[0] != -1) {
+	    close(wakeup[0]);
+	    close(wakeup[1]);
+	    wakeup[0] = wakeup[1] = -1;
+	}
+    }
+    owner = pid;
+}
+
+/*
+ * Get the 1-minute load average; return -1 if unknown
+ */
+static double jobqueue_load(void)
+{
+    FILE  *file;     /* /proc/loadavg */
+    double load = -1; /* Load average  */
+
+    if ((file = fopen("/proc/loadavg", "r")) != NULL) {
+	if (fscanf(file, "%lf", &load) != 1)
+	    load = -1;
+	fclose(file);
+    }
+    return load;
+}
+
+/*
+ * Take a slot for a new job; return 0 if it has to wait.  The first job
+ * always gets one, so that the queue cannot stall.
+ */
+static int jobqueue_slot(void)
+{
+    if (!jobserver_known)
+	jobserver_open();
+    if (exec_ctx->jobs == 0)
+	return 1;
+    if (max_jobs > 0 && exec_ctx->jobs >= max_jobs)
+	return 0;
+    if (max_load > 0 && jobqueue_load() >= max_load)
+	return 0;
+
+    /* The shell holds a token for the first job; the others need one */
+    if (jobserver_read != -1 && !jobserver_take())
+	return 0;
+    return 1;
+}
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Change a setting given as `name=value', or print it given as `name';
+ * return 0 on success, 1 on error, or -1 if it is not a job setting
+ */
+int jobqueue_set(const char *setting)
+{
+    const char *value; /* Value in `setting'    */
+    size_t      len;   /* Length of the name    */
+    char       *end;   /* End of the value      */
+    long        jobs_value;
+    double      load_value;
+
+    len = (value = strchr(setting, '=')) != NULL ?
+	(size_t) (value++ - setting) : strlen(setting);
+
+    if (len == 7 && !strncmp(setting, "maxjobs", 7)) {
+	if (value == NULL)
+	    printf("maxjobs=%d\n", max_jobs);
+	else if ((jobs_value = strtol(value, &end, 10)) >= 0 &&
+		 *end == '\0' && end != value)
+	    max_jobs = (int) jobs_value;
+	else
+	    goto invalid;
+    } else if (len == 7 && !strncmp(setting, "maxload", 7)) {
+	if (value == NULL)
+	    printf("maxload=%g\n", max_load);
+	else if ((load_value = strtod(value, &end)) >= 0 && *end == '\0' &&
+		 end != value)
+	    max_load = load_value;
+	else
+	    goto invalid;
+    } else
+	return -1;
+
+    /* A higher limit may let queued jobs run */
+    jobqueue_run();
+    return 0;
+
+invalid:
+    fprintf(stderr, "%s: set: %s: invalid value\n", exe_name, setting);
+    return 1;
+}
+
+/*
+ * Take a slot to launch a background job now; return 0 if it has to be
+ * queued, jobs queued before it going first
+ */
+int jobqueue_start(void)
+{
+    jobqueue_own();
+    jobqueue_run();
+    return queue_head == NULL && jobqueue_slot();
+}
+
+/*
+ * Queue a background job, which becomes owned by the queue
+ */
+void jobqueue_add(conditional_t *conditional)
+{
+    struct job *job; /* New job */
+
+    if ((job = malloc(sizeof (struct job))) == NULL ||
+	(job->command = malloc(sizeof (command_t))) == NULL ||
+	(job->command->sequence = malloc(sizeof (sequence_t))) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    job->command->sequence->conditional = conditional;
+    job->command->sequence->seq_op = BACK;
+    job->command->sequence->next = NULL;
+    job->next = NULL;
+
+    /* Jobs are launched while waiting for input once woken up */
+    if (wakeup[0] == -1 && pipe(wakeup) == 0) {
+	fcntl(wakeup[0], F_SETFL, O_NONBLOCK);
+	fcntl(wakeup[1], F_SETFL, O_NONBLOCK);
+	fcntl(wakeup[0], F_SETFD, FD_CLOEXEC);
+	fcntl(wakeup[1], F_SETFD, FD_CLOEXEC);
+    }
+
+    if (queue_tail != NULL)
+	queue_tail->next = job;
+    else
+	queue_head = job;
+    queue_tail = job;
+}
+
+/*
+ * Launch queued jobs while slots are free
+ */
+void jobqueue_run(void)
+{
+    struct job *job; /* Launched job */
+
+    jobqueue_own();
+    while ((job = queue_head) != NULL && jobqueue_slot()) {
+	if ((queue_head = job->next) == NULL)
+	    queue_tail = NULL;
+	exec_job(job->command);
+	free_command(job->command);
+	free(job);
+    }
+}
+
+/*
+ * A background job terminated: free its slot
+ */
+void jobqueue_done(void)
+{
+    jobqueue_own();
+    if (exec_ctx->jobs > 0)
+	exec_ctx->jobs--;
+    if (tokens > 0 && exec_ctx->jobs <= tokens)
+	jobserver_give();
+}
+
+/*
+ * Tell whether the shell is waiting for input, when queued jobs may be
+ * launched as slots are freed
+ */
+void jobqueue_idle(int waiting)
+{
+    if ((idle = waiting))
+	jobqueue_run();
+}
+
+/*
+ * Wake up the shell if it is waiting for input and jobs are queued (called
+ * by the SIGCHLD handler, which must not launch them itself)
+ */
+void jobqueue_poll(void)
+{
+    if (idle && queue_head != NULL && wakeup[1] != -1)
+	write(wakeup[1], "", 1);
+}
+
+/*
+ * Wait for input on `fd' while jobs are queued, launching them when the
+ * SIGCHLD handler wakes the shell up; return 1 if some were launched (the
+ * caller waiting again), 0 once input is available
+ */
+int jobqueue_wait(int fd)
+{
+    fd_set set;         /* Watched descriptors */
+    int    ret;         /* select() result     */
+    char   buffer[16];  /* Wake-up bytes       */
+
+    jobqueue_own();
+    if (!idle || queue_head == NULL || wakeup[0] == -1)
+	return 0;
+
+    do {
+	FD_ZERO(&set);
+	FD_SET(fd, &set);
+	FD_SET(wakeup[0], &set);
+    } while ((ret = select((fd > wakeup[0] ? fd : wakeup[0]) + 1, &set,
+			   NULL, NULL, NULL)) == -1 && errno == EINTR);
+    if (ret == -1 || !FD_ISSET(wakeup[0], &set))
+	return 0;
+
+    while (read(wakeup[0], buffer, sizeof buffer) > 0)
+	;
+    jobqueue_run();
+    return 1;
+}
+
+/*
+ * Launch all queued jobs before exiting, waiting for running ones to free
+ * their slot, and for the ones holding jobserver tokens to give them back
+ */
+void jobqueue_drain(void)
+{
+    int   status; /* Return code            */
+    pid_t pid;    /* Terminated process PID */
+
+    jobqueue_own();
+    if (queue_head == NULL && tokens == 0)
+	return;
+
+    signal(SIGCHLD, SIG_DFL);
+    while (queue_head != NULL || tokens > 0) {
+	jobqueue_run();
+	if ((pid = waitpid(-1, &status, WUNTRACED)) == -1) {
+	    if (errno == EINTR)
+		continue;
+	    /* No children left: nothing is running anymore */
+	    while (tokens > 0)
+		jobserver_give();
+	    exec_ctx->jobs = 0;
+	    continue;
+	}
+	if (WIFSTOPPED(status))
+	    kill(pid, SIGCONT);
+	else {
+	    printf("[%d] %d\n", pid,
+		   WIFEXITED(status) ? WEXITSTATUS(status) : RET_ERROR);
+	    jobqueue_done();
+	}
+    }
+    signal(SIGCHLD, sig_chld);
+}
+
+/*
+ * Free the queue (queued jobs are dropped)
+ */
+void jobqueue_free(void)
+{
+    struct job *job; /* Freed job */
+
+    jobqueue_own();
+    while ((job = queue_head) != NULL) {
+	queue_head = job->next;
+	free_command(job->command);
+	free(job);
+    }
+    queue_tail = NULL;
+    if (wakeup[0] != -1) {
+	close(wakeup[0]);
+	close(wakeup[1]);
+	wakeup[0] = wakeup[1] = -1;
+    }
+}
+
+/* End of file */
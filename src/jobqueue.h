@@ -0,0 +1,53 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/jobqueue.h
+ *
+ * Description: Background Job Queue and GNU make Jobserver Client
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _JOBQUEUE_H_
+#define _JOBQUEUE_H_
+
+/* Headers */
+#include <command.h>
+
+/* Prototypes */
+int  jobqueue_set(const char *setting);
+int  jobqueue_start(void);
+void jobqueue_add(conditional_t *conditional);
+void jobqueue_run(void);
+void jobqueue_done(void);
+void jobqueue_idle(int waiting);
+void jobqueue_poll(void);
+int  jobqueue_wait(int fd);
+void jobqueue_drain(void);
+void jobqueue_free(void);
+
+#endif /* !_JOBQUEUE_H_ */
+
+/* End of file */
@@ -0,0 +1,427 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/limit.c
+ *
+ * Description: Resource Limits of Jobs
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#define _GNU_SOURCE /* For getrlimit(), RLIMIT_NPROC, O_CLOEXEC */
+
+/* Standard C headers */
+#include <stdio.h>  /* printf(), sprintf(), fprintf()       */
+#include <stdlib.h> /* NULL, malloc(), free(), strtoul()    */
+#include <string.h> /* strcmp(), strlen(), strstr()         */
+#include <errno.h>  /* errno                                */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h> /* getrlimit(), setrlimit()              */
+#include <sys/stat.h>     /* mkdir()                               */
+#include <sys/wait.h>     /* WTERMSIG()                            */
+#include <unistd.h>       /* read(), write(), close(), rmdir()     */
+#include <fcntl.h>        /* open()                                */
+#include <signal.h>       /* SIGXCPU, SIGXFSZ, SIGKILL             */
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "variable.h"
+#include "limit.h"
+
+
+/*****************************************************************************
+ *
+ * Process Resource Limits
+ *
+ */
+
+/* Resources, by their `ulimit' option */
+static const struct {
+    char        option; /* Option letter                */
+    int         resource;
+    rlim_t      unit;   /* Bytes (or else) per unit     */
+    const char *name;   /* Description, with its unit   */
+} resources[] = {
+    { 'c', RLIMIT_CORE,    1024, "core file size (KiB)"        },
+    { 'd', RLIMIT_DATA,    1024, "data segment size (KiB)"     },
+    { 'f', RLIMIT_FSIZE,   512,  "file size (512-byte blocks)" },
+#ifdef RLIMIT_MEMLOCK
+    { 'l', RLIMIT_MEMLOCK, 1024, "locked memory (KiB)"         },
+#endif
+#ifdef RLIMIT_RSS
+    { 'm', RLIMIT_RSS,     1024, "resident set size (KiB)"     },
+#endif
+    { 'n', RLIMIT_NOFILE,  1,    "open files"                  },
+    { 's', RLIMIT_STACK,   1024, "stack size (KiB)"            },
+    { 't', RLIMIT_CPU,     1,    "CPU time (seconds)"          },
+#ifdef RLIMIT_NPROC
+    { 'u', RLIMIT_NPROC,   1,    "processes"                   },
+#endif
+    { 'v', RLIMIT_AS,      1024, "virtual memory (KiB)"        }
+};
+
+/* Number of resources */
+#define RESOURCE_COUNT ((int) (sizeof resources / sizeof *resources))
+
+/*
+ * Find a resource by its option letter
+ */
+static int limit_find(int option)
+{
+    int i; /* Counter */
+
+    for (i = 0; i < RESOURCE_COUNT; i++)
+	if (resources[i].option == option)
+	    return i;
+    fprintf(stderr, "%s: ulimit: -%c: unknown resource\n", exe_name, option);
+    return -1;
+}
+
+/*
+ * Print a limit value
+ */
+static void limit_print(int i, rlim_t value)
+{
+    if (value == RLIM_INFINITY)
+	puts("unlimited");
+    else
+	printf("%lu\n", (unsigned long) (value / resources[i].unit));
+}
+
+/*
+ * Print the soft or hard limit (`which') of the resource of `option', or of
+ * all of them if it is 'a'; return 0 on success
+ */
+int limit_show(int option, int which)
+{
+    struct rlimit limit; /* Limit   */
+    int           i;     /* Counter */
+
+    if (option == 'a')
+	i = 0;
+    else if ((i = limit_find(option)) == -1)
+	return 1;
+
+    for (; i < RESOURCE_COUNT; i++) {
+	if (getrlimit(resources[i].resource, &limit) == -1) {
+	    lish_perror("ulimit");
+	    return 3;
+	}
+	if (option == 'a')
+	    printf("-%c: %-28s ", resources[i].option, resources[i].name);
+	limit_print(i, which == LIMIT_HARD ? limit.rlim_max : limit.rlim_cur);
+	if (option != 'a')
+	    break;
+    }
+
+    return 0;
+}
+
+/*
+ * Set the soft and/or hard limit (`which') of the resource of `option' to
+ * `value' (a number of units or "unlimited"); return 0 on success
+ */
+int limit_set(int option, const char *value, int which)
+{
+    struct rlimit limit; /* Current limits */
+    rlim_t        n;     /* New limit      */
+    char         *end;   /* End of number  */
+    int           i;     /* Resource index */
+
+    if ((i = limit_find(option)) == -1)
+	return 1;
+
+    if (!strcmp(value, "unlimited"))
+	n = RLIM_INFINITY;
+    else {
+	n = (rlim_t) strtoul(value, &end, 10);
+	if (*value < '0' || *value > '9' || *end != '\0') {
+	    fprintf(stderr, "%s: ulimit: %s: invalid limit\n", exe_name,
+		    value);
+	    return 2;
+	}
+	n *= resources[i].unit;
+    }
+
+    if (getrlimit(resources[i].resource, &limit) == -1) {
+	lish_perror("ulimit");
+	return 3;
+    }
+    if (which & LIMIT_SOFT)
+	limit.rlim_cur = n;
+    if (which & LIMIT_HARD)
+	limit.rlim_max = n;
+    if (setrlimit(resources[i].resource, &limit) == -1) {
+	fprintf(stderr, "%s: ulimit: -%c: ", exe_name, option);
+	perror(NULL);
+	return 3;
+    }
+
+    return 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Control Groups of Jobs
+ *
+ */
+
+/* Limits of a job's cgroup (v2), set by shell variables of the same name
+   as the file they are written to, under $CGROUP */
+static const struct {
+    const char *variable;   /* Shell variable        */
+    const char *file;       /* Cgroup interface file */
+    const char *controller; /* Controller to enable  */
+} cgroup_limits[] = {
+    { "CGROUP_MEMORY_MAX", "memory.max", "+memory" },
+    { "CGROUP_CPU_MAX",    "cpu.max",    "+cpu"    },
+    { "CGROUP_PIDS_MAX",   "pids.max",   "+pids"   }
+};
+
+/* Number of limits */
+#define CGROUP_LIMIT_COUNT \
+    ((int) (sizeof cgroup_limits / sizeof *cgroup_limits))
+
+/* Cgroup of the current job */
+static char *job_dir = NULL; /* Directory, if any                    */
+static int   job_procs = -1; /* Its cgroup.procs, kept for children  */
+static int   jobs_made = 0;  /* Number of cgroups created, for names */
+static int   job_inside = 0; /* Whether this process is in a job     */
+
+/*
+ * Build the path of a file of the job cgroup (freed by the caller)
+ */
+static char *cgroup_path(const char *dir, const char *file)
+{
+    char *path; /* Result */
+
+    if ((path = malloc(strlen(dir) + strlen(file) + 2)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    sprintf(path, "%s/%s", dir, file);
+    return path;
+}
+
+/*
+ * Write `value' to a cgroup file; return 0 on success, or -1 with errno set
+ */
+static int cgroup_write(const char *dir, const char *file, const char *value)
+{
+    char *path;      /* File path   */
+    int   fd;        /* Descriptor  */
+    int   error = 0; /* Saved errno */
+
+    path = cgroup_path(dir, file);
+    if ((fd = open(path, O_WRONLY)) == -1)
+	error = errno;
+    else {
+	if (write(fd, value, strlen(value)) == -1)
+	    error = errno;
+	close(fd);
+    }
+    free(path);
+
+    errno = error;
+    return error != 0 ? -1 : 0;
+}
+
+/*
+ * Read the counter `key' of a cgroup events file (0 if unknown)
+ */
+static unsigned long cgroup_event(const char *file, const char *key)
+{
+    char       *path;     /* File path    */
+    char        buf[256]; /* File content */
+    ssize_t     size;     /* Content size */
+    int         fd;       /* Descriptor   */
+    const char *p;        /* Key position */
+    size_t      len;      /* Key length   */
+
+    path = cgroup_path(job_dir, file);
+    fd = open(path, O_RDONLY);
+    free(path);
+    if (fd == -1)
+	return 0;
+    size = read(fd, buf, sizeof buf - 1);
+    close(fd);
+    if (size <= 0)
+	return 0;
+    buf[size] = '\0';
+
+    /* Lines are "key value" */
+    len = strlen(key);
+    for (p = buf; (p = strstr(p, key)) != NULL; p += len)
+	if ((p == buf || p[-1] == '\n') && p[len] == ' ')
+	    return strtoul(p + len + 1, NULL, 10);
+    return 0;
+}
+
+/*
+ * Whether jobs are to be placed in their own cgroup
+ */
+int limit_job_wanted(void)
+{
+    int i; /* Counter */
+
+    if (job_inside || var_get("CGROUP") == NULL)
+	return 0;
+    for (i = 0; i < CGROUP_LIMIT_COUNT; i++)
+	if (var_get(cgroup_limits[i].variable) != NULL)
+	    return 1;
+    return 0;
+}
+
+/*
+ * Create the cgroup of the current job under $CGROUP (a delegated cgroup v2
+ * directory) with the limits set by $CGROUP_*_MAX, if any and if not done
+ * yet; return 0 on success, -1 if the limits cannot be enforced
+ */
+int limit_job_start(void)
+{
+    const char *parent, *value; /* $CGROUP, limit value      */
+    char        name[64];       /* Job cgroup name           */
+    char       *path;           /* cgroup.procs path         */
+    int         i;              /* Counter                   */
+
+    if (job_dir != NULL || !limit_job_wanted())
+	return 0;
+    parent = var_get("CGROUP");
+
+    /* Enable the needed controllers for children of $CGROUP; this fails if
+       they already are, or if they are not delegated, which writing the
+       limits tells */
+    for (i = 0; i < CGROUP_LIMIT_COUNT; i++)
+	if (var_get(cgroup_limits[i].variable) != NULL)
+	    cgroup_write(parent, "cgroup.subtree_control",
+			 cgroup_limits[i].controller);
+
+    sprintf(name, "lish-%ld-%d", (long) getpid(), ++jobs_made);
+    job_dir = cgroup_path(parent, name);
+    if (mkdir(job_dir, 0755) == -1) {
+	fprintf(stderr, "%s: %s: ", exe_name, job_dir);
+	perror(NULL);
+	free(job_dir);
+	job_dir = NULL;
+	return -1;
+    }
+
+    for (i = 0; i < CGROUP_LIMIT_COUNT; i++)
+	if ((value = var_get(cgroup_limits[i].variable)) != NULL &&
+	    cgroup_write(job_dir, cgroup_limits[i].file, value) == -1) {
+	    fprintf(stderr, "%s: %s: cannot set %s: ", exe_name,
+		    cgroup_limits[i].variable, cgroup_limits[i].file);
+	    perror(NULL);
+	    limit_job_end();
+	    return -1;
+	}
+
+    /* Children enter the cgroup through this descriptor */
+    path = cgroup_path(job_dir, "cgroup.procs");
+    job_procs = open(path, O_WRONLY | O_CLOEXEC);
+    free(path);
+    if (job_procs == -1) {
+	lish_perror("cgroup.procs");
+	limit_job_end();
+	return -1;
+    }
+
+    return 0;
+}
+
+/*
+ * Put the calling process (a job's child, before exec) under the limits:
+ * restore the file size signal, ignored by the shell, and move it to the
+ * job cgroup; it is not run if the limits cannot be enforced
+ */
+void limit_job_enter(void)
+{
+    signal(SIGXFSZ, SIG_DFL);
+    job_inside = 1;
+    if (job_procs != -1 && write(job_procs, "0", 1) == -1) {
+	lish_perror("cannot enter the job cgroup");
+	lish_exit(RET_ERROR);
+    }
+}
+
+/*
+ * Report the cause of the death of a job's process killed by a signal
+ * (status is the one given by waitpid())
+ */
+void limit_job_report(pid_t pid, int status)
+{
+    const char *cause; /* Cause of death */
+
+    switch (WTERMSIG(status)) {
+    case SIGXCPU:
+	cause = "CPU time limit exceeded";
+	break;
+    case SIGXFSZ:
+	cause = "file size limit exceeded";
+	break;
+    case SIGKILL:
+	if (job_dir != NULL && cgroup_event("memory.events", "oom_kill") > 0)
+	    cause = "memory limit exceeded (memory.max)";
+	else
+	    cause = "killed";
+	break;
+    default:
+	return;
+    }
+
+    fprintf(stderr, "%s: [%ld] %s\n", exe_name, (long) pid, cause);
+}
+
+/*
+ * Report limits reached by the job which did not kill it, then remove its
+ * cgroup (which fails if some of its processes still run)
+ */
+void limit_job_end(void)
+{
+    unsigned long count; /* Event count */
+
+    if (job_dir == NULL || job_inside)
+	return;
+
+    if ((count = cgroup_event("pids.events", "max")) > 0)
+	fprintf(stderr, "%s: process limit reached (pids.max), %lu fork%s "
+		"failed\n", exe_name, count, count > 1 ? "s" : "");
+
+    if (job_procs != -1) {
+	close(job_procs);
+	job_procs = -1;
+    }
+    rmdir(job_dir);
+    free(job_dir);
+    job_dir = NULL;
+}
+
+/* End of file */
@@ -0,0 +1,54 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/limit.h
+ *
+ * Description: Resource Limits of Jobs
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _LIMIT_H_
+#define _LIMIT_H_
+
+/* Headers */
+#include <sys/types.h> /* pid_t */
+
+/* Which limits `limit_set()' changes */
+#define LIMIT_SOFT 1
+#define LIMIT_HARD 2
+
+/* Prototypes */
+int  limit_show(int option, int which);
+int  limit_set(int option, const char *value, int which);
+int  limit_job_start(void);
+void limit_job_enter(void);
+void limit_job_report(pid_t pid, int status);
+void limit_job_end(void);
+int  limit_job_wanted(void);
+
+#endif /* !_LIMIT_H_ */
+
+/* End of file */
@@ -0,0 +1,982 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/lineedit.c
+ *
+ * Description: Line Editor
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#define _POSIX_SOURCE /* For termios   */
+#define _BSD_SOURCE   /* For strdup()  */
+
+/* Standard C headers */
+#include <stdio.h>  /* stdin, fgets(), sprintf()                     */
+#include <stdlib.h> /* NULL, realloc(), free(), qsort()              */
+#include <string.h> /* strlen(), strcmp(), strstr(), memmove(), ...  */
+#include <errno.h>  /* errno                                         */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/stat.h> /* stat()                                    */
+#include <sys/ioctl.h> /* ioctl(), TIOCGWINSZ, struct winsize      */
+#include <unistd.h>   /* read(), write(), isatty()                 */
+#include <termios.h>  /* struct termios, tcgetattr(), tcsetattr()  */
+#include <signal.h>   /* signal(), SIGWINCH, sig_atomic_t          */
+#include <dirent.h>   /* opendir(), readdir(), closedir()          */
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "history.h"
+#include "prompt.h"
+#include "internal.h"
+#include "pathindex.h"
+#include "variable.h"
+#include "jobqueue.h"
+#include "lineedit.h"
+
+
+/*****************************************************************************
+ *
+ * Constants and Variables
+ *
+ */
+
+/* Control key codes */
+#define KEY_CTRL(key) ((key) & 0x1F)
+#define KEY_ESC   0x1B
+#define KEY_DEL   0x7F
+
+/* Special keys, decoded from escape sequences */
+#define KEY_UP    0x100
+#define KEY_DOWN  0x101
+#define KEY_RIGHT 0x102
+#define KEY_LEFT  0x103
+#define KEY_HOME  0x104
+#define KEY_END   0x105
+#define KEY_DELETE 0x106
+#define KEY_WORD_LEFT  0x107
+#define KEY_WORD_RIGHT 0x108
+
+/* Maximum length of an edited line (room is left for '\n' and '\0') */
+#define LINE_MAX_LEN (MAX_COMMAND_LENGTH - 2)
+
+/* Search prompts */
+static const char search_prompt[] = "(reverse-i-search)`";
+static const char failed_prompt[] = "(failed reverse-i-search)`";
+
+/* Input read instead of the standard input, never edited (NULL: none) */
+static FILE *input = NULL;
+
+/* Terminal settings to restore, are they changed? */
+static struct termios saved_termios;
+static int            raw = 0;
+
+/* Edited line and cursor position */
+static char   line[LINE_MAX_LEN + 1];
+static size_t line_len, cursor;
+
+/* Text displayed after the prompt, cursor position in it */
+static char   shown[2 * MAX_COMMAND_LENGTH];
+static size_t shown_len, shown_cursor;
+
+/* Killed text, inserted back by Ctrl-Y */
+static char kill_buffer[LINE_MAX_LEN + 1];
+
+/* History navigation: recalled command number, line being entered */
+static unsigned long recalled;
+static char          saved_line[LINE_MAX_LEN + 1];
+
+/* Incremental search: active?, pattern, match, number, line to restore */
+static int           searching = 0, search_failed;
+static char          pattern[LINE_MAX_LEN + 1];
+static size_t        pattern_len;
+static unsigned long match;
+
+/* Completions of the word being completed */
+static char  **completions = NULL;
+static size_t  completion_count = 0, completion_size = 0;
+
+/* Terminal width used to list completions */
+#define LIST_WIDTH 80
+
+/* Terminal width, read again after SIGWINCH */
+static size_t                columns;
+static volatile sig_atomic_t resized = 1;
+
+
+/*****************************************************************************
+ *
+ * Terminal Handling
+ *
+ */
+
+/*
+ * Called upon SIGWINCH (the terminal was resized)
+ */
+static void lineedit_winch(int sig UNUSED)
+{
+    signal(SIGWINCH, lineedit_winch);
+    resized = 1;
+}
+
+/*
+ * Put the terminal into raw mode; return 0 if it cannot be done
+ */
+static int lineedit_raw(void)
+{
+    struct termios term; /* New settings */
+
+    if (tcgetattr(STDIN_FILENO, &saved_termios) == -1)
+	return 0;
+
+    /* No echo, line buffering nor signal keys; output is still processed
+       (line breaks) */
+    term = saved_termios;
+    term.c_iflag &= ~(BRKINT | ICRNL | INPCK | ISTRIP | IXON);
+    term.c_cflag |= CS8;
+    term.c_lflag &= ~(ECHO | ICANON | IEXTEN | ISIG);
+    term.c_cc[VMIN] = 1;
+    term.c_cc[VTIME] = 0;
+    if (tcsetattr(STDIN_FILENO, TCSADRAIN, &term) == -1)
+	return 0;
+    raw = 1;
+    signal(SIGWINCH, lineedit_winch);
+    return 1;
+}
+
+/*
+ * Read command lines from `file' instead of the standard input
+ */
+void lineedit_input(FILE *file)
+{
+    input = file;
+}
+
+/*
+ * Restore terminal settings
+ */
+void lineedit_restore(void)
+{
+    if (raw) {
+	tcsetattr(STDIN_FILENO, TCSADRAIN, &saved_termios);
+	raw = 0;
+    }
+}
+
+/*
+ * Write a buffer entirely
+ */
+static void lineedit_write(const char *buffer, size_t len)
+{
+    ssize_t ret; /* Bytes written */
+
+    while (len > 0 && ((ret = write(STDOUT_FILENO, buffer, len)) > 0 ||
+		       (ret == -1 && errno == EINTR)))
+	if (ret > 0) {
+	    buffer += ret;
+	    len -= ret;
+	}
+}
+
+/*
+ * Get the terminal width
+ */
+static size_t lineedit_columns(void)
+{
+    struct winsize size; /* Terminal size */
+
+    if (resized) {
+	resized = 0;
+	columns = ioctl(STDOUT_FILENO, TIOCGWINSZ, &size) == -1 ||
+	    size.ws_col == 0 ? LIST_WIDTH : size.ws_col;
+    }
+    return columns;
+}
+
+/*
+ * Tell on which row after the one of the prompt is the position `pos' of
+ * the displayed text
+ */
+static int lineedit_row(size_t pos)
+{
+    return raw ? (prompt_width() + pos) / lineedit_columns() : 0;
+}
+
+/*
+ * Read a key, decoding escape sequences; return -1 at end of input
+ */
+static int lineedit_key(void)
+{
+    unsigned char chr, seq[3]; /* Character, escape sequence */
+    ssize_t       ret;         /* Bytes read                 */
+
+    /* Redraw the line if the prompt was redrawn while waiting, or after
+       queued jobs were launched (printing their PID) */
+    if (prompt_wait(STDIN_FILENO, lineedit_row(shown_cursor)))
+	lineedit_redraw();
+    while (jobqueue_wait(STDIN_FILENO)) {
+	display_prompt();
+	lineedit_redraw();
+    }
+
+    while ((ret = read(STDIN_FILENO, &chr, 1)) == -1 && errno == EINTR)
+	;
+    if (ret != 1)
+	return -1;
+    if (chr != KEY_ESC)
+	return chr;
+
+    /* Escape sequences: ESC [ x, ESC [ n ~, ESC O x, or Alt-x */
+    if (read(STDIN_FILENO, &seq[0], 1) != 1)
+	return KEY_ESC;
+    if (seq[0] == 'b')
+	return KEY_WORD_LEFT;
+    if (seq[0] == 'f')
+	return KEY_WORD_RIGHT;
+    if ((seq[0] != '[' && seq[0] != 'O') || read(STDIN_FILENO, &seq[1], 1)
+	!= 1)
+	return KEY_ESC;
+
+    if (seq[1] >= '0' && seq[1] <= '9') {
+	if (read(STDIN_FILENO, &seq[2], 1) != 1 || seq[2] != '~')
+	    return KEY_ESC;
+	switch (seq[1]) {
+	case '1':
+	case '7':
+	    return KEY_HOME;
+	case '3':
+	    return KEY_DELETE;
+	case '4':
+	case '8':
+	    return KEY_END;
+	}
+	return KEY_ESC;
+    }
+
+    switch (seq[1]) {
+    case 'A':
+	return KEY_UP;
+    case 'B':
+	return KEY_DOWN;
+    case 'C':
+	return KEY_RIGHT;
+    case 'D':
+	return KEY_LEFT;
+    case 'H':
+	return KEY_HOME;
+    case 'F':
+	return KEY_END;
+    }
+    return KEY_ESC;
+}
+
+
+/*****************************************************************************
+ *
+ * Display
+ *
+ */
+
+/*
+ * Write into `out' the cursor movement from the position `from' of the
+ * displayed text to `to', which can be on other rows once the line wraps;
+ * return its length
+ */
+static size_t lineedit_move(char *out, size_t from, size_t to)
+{
+    size_t len = 0;                        /* Movement length     */
+    size_t width = lineedit_columns();     /* Terminal width      */
+    size_t start = prompt_width() % width; /* Column of the text  */
+    size_t from_col = (start + from) % width, to_col = (start + to) % width;
+    int    rows = lineedit_row(to) - lineedit_row(from);
+
+    if (rows < 0)
+	len += sprintf(out + len, "\033[%dA", -rows);
+    else if (rows > 0)
+	len += sprintf(out + len, "\033[%dB", rows);
+    if (from_col > to_col)
+	len += sprintf(out + len, "\033[%luD",
+		       (unsigned long) (from_col - to_col));
+    else if (from_col < to_col)
+	len += sprintf(out + len, "\033[%luC",
+		       (unsigned long) (to_col - from_col));
+    return len;
+}
+
+/*
+ * Tell whether the cursor at the end of the displayed text is alone at the
+ * start of a row (the text filling the previous ones)
+ */
+static int lineedit_wrapped(void)
+{
+    return shown_len > 0 &&
+	(prompt_width() + shown_len) % lineedit_columns() == 0;
+}
+
+/*
+ * Update the text displayed after the prompt to `text', with the cursor at
+ * `pos': only the part after the common prefix of both is written again
+ */
+static void lineedit_update(const char *text, size_t len, size_t pos)
+{
+    size_t common, out_len = 0;         /* Common prefix, output length */
+    char   out[3 * MAX_COMMAND_LENGTH]; /* Output buffer                */
+
+    for (common = 0; common < len && common < shown_len &&
+	     text[common] == shown[common]; common++)
+	;
+
+    /* Move to the first difference, write the new text and clear what
+       remains of the previous one */
+    if (common < len || common < shown_len) {
+	out_len += lineedit_move(out + out_len, shown_cursor, common);
+	memcpy(out + out_len, text + common, len - common);
+	out_len += len - common;
+
+	/* The terminal only goes to the next row when it gets more text */
+	if (len > common && len > 0 &&
+	    (prompt_width() + len) % lineedit_columns() == 0) {
+	    memcpy(out + out_len, "\r\n", 2);
+	    out_len += 2;
+	}
+	if (len < shown_len)
+	    out_len += sprintf(out + out_len, "\033[J");
+	shown_cursor = len;
+    }
+
+    /* Place the cursor */
+    out_len += lineedit_move(out + out_len, shown_cursor, pos);
+
+    lineedit_write(out, out_len);
+    memcpy(shown, text, len);
+    shown_len = len;
+    shown_cursor = pos;
+}
+
+/*
+ * Display the edited line, or the search state
+ */
+static void lineedit_refresh(void)
+{
+    size_t len, prefix, pos;        /* Lengths, cursor position */
+    char   text[sizeof shown];      /* Text to display          */
+    const char *found;              /* Pattern in the match     */
+
+    if (!searching) {
+	lineedit_update(line, line_len, cursor);
+	return;
+    }
+
+    /* (reverse-i-search)`pattern': match, the cursor on the pattern */
+    strcpy(text, search_failed ? failed_prompt : search_prompt);
+    len = strlen(text);
+    memcpy(text + len, pattern, pattern_len);
+    len += pattern_len;
+    memcpy(text + len, "': ", 3);
+    prefix = (len += 3);
+    memcpy(text + len, line, line_len);
+    len += line_len;
+    line[line_len] = '\0';
+    pos = pattern_len > 0 && (found = strstr(line, pattern)) != NULL ?
+	prefix + (found - line) : prefix + cursor;
+    lineedit_update(text, len, pos);
+}
+
+/*
+ * Display the line again, after the prompt was displayed again
+ */
+void lineedit_redraw(void)
+{
+    if (!raw)
+	return;
+    shown_len = shown_cursor = 0;
+    lineedit_refresh();
+}
+
+/*
+ * Move the cursor after the displayed line, before other output
+ */
+void lineedit_leave(void)
+{
+    char   out[64]; /* Cursor movement */
+
+    if (!raw)
+	return;
+    lineedit_write(out, lineedit_move(out, shown_cursor, shown_len));
+    shown_cursor = shown_len;
+}
+
+
+/*****************************************************************************
+ *
+ * Editing
+ *
+ */
+
+/*
+ * Replace the line by `text' (a command, its line break being ignored)
+ */
+static void lineedit_set(const char *text)
+{
+    line_len = strcspn(text, "\n");
+    if (line_len > LINE_MAX_LEN)
+	line_len = LINE_MAX_LEN;
+    memcpy(line, text, line_len);
+    cursor = line_len;
+}
+
+/*
+ * Insert `len' characters at the cursor
+ */
+static void lineedit_insert(const char *text, size_t len)
+{
+    if (len > LINE_MAX_LEN - line_len)
+	len = LINE_MAX_LEN - line_len;
+    memmove(line + cursor + len, line + cursor, line_len - cursor);
+    memcpy(line + cursor, text, len);
+    line_len += len;
+    cursor += len;
+}
+
+/*
+ * Delete the characters from `from' to `to' (excluded), saving them into
+ * the kill buffer if `kill' is set
+ */
+static void lineedit_delete(size_t from, size_t to, int kill)
+{
+    if (from >= to)
+	return;
+    if (kill) {
+	memcpy(kill_buffer, line + from, to - from);
+	kill_buffer[to - from] = '\0';
+    }
+    memmove(line + from, line + to, line_len - to);
+    line_len -= to - from;
+    cursor = from;
+}
+
+/*
+ * Find the start of the word before the cursor
+ */
+static size_t lineedit_word_left(void)
+{
+    size_t pos = cursor; /* Result */
+
+    while (pos > 0 && line[pos - 1] == ' ')
+	pos--;
+    while (pos > 0 && line[pos - 1] != ' ')
+	pos--;
+    return pos;
+}
+
+/*
+ * Find the end of the word after the cursor
+ */
+static size_t lineedit_word_right(void)
+{
+    size_t pos = cursor; /* Result */
+
+    while (pos < line_len && line[pos] == ' ')
+	pos++;
+    while (pos < line_len && line[pos] != ' ')
+	pos++;
+    return pos;
+}
+
+/*
+ * Recall command number `n', or the line being entered if it is the next
+ * one; return 0 if it is not available
+ */
+static int lineedit_recall(unsigned long n)
+{
+    char buffer[MAX_COMMAND_LENGTH]; /* Command buffer */
+
+    if (n == history_next())
+	lineedit_set(saved_line);
+    else if (!history_get(n, buffer))
+	return 0;
+    else {
+	if (recalled == history_next()) {
+	    memcpy(saved_line, line, line_len);
+	    saved_line[line_len] = '\0';
+	}
+	lineedit_set(buffer);
+    }
+    recalled = n;
+    return 1;
+}
+
+
+/*****************************************************************************
+ *
+ * Incremental Search
+ *
+ */
+
+/*
+ * Look for the pattern in commands older than `before' (skipping ones which
+ * are identical to the current match if `skip' is set), showing the match
+ */
+static void lineedit_search(unsigned long before, int skip)
+{
+    unsigned long n = before;        /* Command number */
+    char  buffer[MAX_COMMAND_LENGTH]; /* Found command  */
+
+    pattern[pattern_len] = '\0';
+    line[line_len] = '\0';
+    while (history_rfind(pattern, &n, buffer)) {
+	buffer[strcspn(buffer, "\n")] = '\0';
+	if (skip && !strcmp(buffer, line))
+	    continue;
+	match = n;
+	search_failed = 0;
+	lineedit_set(buffer);
+	return;
+    }
+    search_failed = 1;
+}
+
+/*
+ * Handle a key while searching; return 0 if the search ends and the key
+ * must be handled as when editing
+ */
+static int lineedit_search_key(int key)
+{
+    char chr = key; /* Typed character */
+
+    switch (key) {
+    case KEY_CTRL('R'):
+	/* Older match */
+	if (pattern_len > 0)
+	    lineedit_search(match, 1);
+	break;
+
+    case KEY_CTRL('H'):
+    case KEY_DEL:
+	/* Shorter pattern: search again from the most recent command */
+	if (pattern_len > 0) {
+	    pattern_len--;
+	    lineedit_search(history_next(), 0);
+	}
+	break;
+
+    case KEY_CTRL('G'):
+    case KEY_CTRL('C'):
+	/* Cancel: restore the line being entered */
+	searching = 0;
+	lineedit_set(saved_line);
+	break;
+
+    default:
+	if (key >= ' ' && key < KEY_DEL) {
+	    /* Longer pattern: the current match may still be one */
+	    if (pattern_len < LINE_MAX_LEN) {
+		pattern[pattern_len++] = chr;
+		lineedit_search(match + 1, 0);
+	    }
+	    break;
+	}
+
+	/* Any other key accepts the match */
+	searching = 0;
+	recalled = history_next();
+	return 0;
+    }
+
+    lineedit_refresh();
+    return 1;
+}
+
+
+/*****************************************************************************
+ *
+ * Completion
+ *
+ */
+
+/*
+ * Add a possible completion
+ */
+static void lineedit_found(const char *name)
+{
+    if (completion_count == completion_size) {
+	completion_size = completion_size ? completion_size * 2 : 64;
+	if ((completions = realloc(completions, completion_size *
+				   sizeof *completions)) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+    }
+    if ((completions[completion_count++] = strdup(name)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+}
+
+/*
+ * Compare completions
+ */
+static int lineedit_cmp(const void *a, const void *b)
+{
+    return strcmp(*(char *const *) a, *(char *const *) b);
+}
+
+/*
+ * Add the files of directory `dir' beginning by `prefix', directories
+ * being followed by `/'
+ */
+static void lineedit_files(const char *dir, const char *prefix)
+{
+    DIR           *dirp;                  /* Directory stream   */
+    struct dirent *ent;                   /* Directory entry    */
+    struct stat    st;                    /* File information   */
+    size_t         len = strlen(prefix);  /* Prefix length      */
+    char           name[2 * MAX_COMMAND_LENGTH + 2]; /* File name */
+    const char    *home;                  /* Home directory     */
+    char          *tail;                  /* File name part     */
+
+    /* Expand `~/' */
+    if (dir[0] == '~' && dir[1] == '/' && (home = var_get("HOME")) != NULL &&
+	strlen(home) + strlen(dir) < MAX_COMMAND_LENGTH) {
+	sprintf(name, "%s%s", home, dir + 1);
+	dir = name;
+    }
+    if ((dirp = opendir(*dir != '\0' ? dir : ".")) == NULL)
+	return;
+    if (dir != name)
+	strcpy(name, dir);
+    tail = name + strlen(name);
+
+    while ((ent = readdir(dirp)) != NULL) {
+	/* Hidden files only if asked for, never `.' and `..' */
+	if (strncmp(ent->d_name, prefix, len) ||
+	    (ent->d_name[0] == '.' && (prefix[0] != '.' ||
+				       !strcmp(ent->d_name, ".") ||
+				       !strcmp(ent->d_name, ".."))) ||
+	    strlen(ent->d_name) > MAX_COMMAND_LENGTH)
+	    continue;
+	strcpy(tail, ent->d_name);
+	if (stat(name, &st) == 0 && S_ISDIR(st.st_mode))
+	    strcat(tail, "/");
+	lineedit_found(tail);
+    }
+    closedir(dirp);
+}
+
+/*
+ * Print completions in columns, then the prompt and line again
+ */
+static void lineedit_list(void)
+{
+    size_t i, len, width = 0, columns; /* Counters, column width */
+    char   out[LIST_WIDTH + 2];         /* Output line            */
+
+    for (i = 0; i < completion_count; i++)
+	if ((len = strlen(completions[i]) + 2) > width)
+	    width = len;
+    if ((columns = LIST_WIDTH / width) == 0)
+	columns = 1;
+
+    lineedit_leave();
+    lineedit_write("\n", 1);
+    for (i = 0; i < completion_count; i++) {
+	len = strlen(completions[i]);
+	if (len > LIST_WIDTH)
+	    len = LIST_WIDTH;
+	memcpy(out, completions[i], len);
+	if ((i + 1) % columns == 0 || i + 1 == completion_count)
+	    out[len++] = '\n';
+	else
+	    while (len < width)
+		out[len++] = ' ';
+	lineedit_write(out, len);
+    }
+    display_prompt();
+    lineedit_redraw();
+}
+
+/*
+ * Complete the word before the cursor: a command name in command position,
+ * else a file name; list completions if `list' is set and the word cannot
+ * be extended
+ */
+static void lineedit_complete(int list)
+{
+    size_t i, j, start, len, common; /* Counters, word, prefix lengths */
+    const char *word, *base;         /* Word, its file name part       */
+    char   dir[MAX_COMMAND_LENGTH];  /* Its directory part             */
+    char   prefix[MAX_COMMAND_LENGTH];
+
+    /* Word before the cursor, and its position */
+    for (start = cursor; start > 0 && line[start - 1] != ' '; start--)
+	;
+    len = cursor - start;
+    memcpy(prefix, line + start, len);
+    prefix[len] = '\0';
+    word = prefix;
+    for (j = start; j > 0 && line[j - 1] == ' '; j--)
+	;
+
+    /* Gather completions */
+    completion_count = 0;
+    if ((j == 0 || strchr("|;&(", line[j - 1]) != NULL) &&
+	strchr(word, '/') == NULL) {
+	internal_complete(word, lineedit_found);
+	pathindex_complete(word, lineedit_found);
+	base = word;
+    } else {
+	base = strrchr(word, '/');
+	base = base != NULL ? base + 1 : word;
+	memcpy(dir, word, base - word);
+	dir[base - word] = '\0';
+	lineedit_files(dir, base);
+    }
+
+    /* Sort them, removing duplicates */
+    qsort(completions, completion_count, sizeof *completions, lineedit_cmp);
+    for (i = j = 0; i < completion_count; i++)
+	if (j > 0 && !strcmp(completions[i], completions[j - 1]))
+	    free(completions[i]);
+	else
+	    completions[j++] = completions[i];
+    completion_count = j;
+
+    /* Insert their common prefix, and a space after a single complete
+       word */
+    if (completion_count == 0)
+	lineedit_write("\a", 1);
+    else {
+	len = strlen(base);
+	common = strlen(completions[0]);
+	for (i = 1; i < completion_count; i++)
+	    for (j = 0; j < common; j++)
+		if (completions[i][j] != completions[0][j]) {
+		    common = j;
+		    break;
+		}
+	if (common > len)
+	    lineedit_insert(completions[0] + len, common - len);
+	if (completion_count == 1 && completions[0][common - 1] != '/')
+	    lineedit_insert(" ", 1);
+	else if (common == len) {
+	    if (list)
+		lineedit_list();
+	    else
+		lineedit_write("\a", 1);
+	}
+    }
+
+    for (i = 0; i < completion_count; i++)
+	free(completions[i]);
+}
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Read a command line into `buffer' (`size' bytes), editing it on a
+ * terminal; return NULL at end of input
+ */
+char *lineedit_gets(char *buffer, int size)
+{
+    int   key = 0;        /* Typed key                 */
+    int   done = 0;       /* Line complete?            */
+    int   last_key = 0;   /* Previous key              */
+    const char *term;     /* Terminal type             */
+    char  chr;            /* Typed character           */
+
+    /* Read a plain line when not on a terminal */
+    if (input != NULL)
+	return fgets(buffer, size, input);
+    if (!isatty(STDIN_FILENO) || !isatty(STDOUT_FILENO) ||
+	((term = var_get("TERM")) != NULL && !strcmp(term, "dumb")) ||
+	!lineedit_raw()) {
+	prompt_wait(STDIN_FILENO, 0);
+	return fgets(buffer, size, stdin);
+    }
+
+    line_len = cursor = 0;
+    shown_len = shown_cursor = 0;
+    saved_line[0] = '\0';
+    recalled = history_next();
+    searching = 0;
+
+    while (!done) {
+	last_key = key;
+	if ((key = lineedit_key()) == -1)
+	    break;
+	if (searching && lineedit_search_key(key))
+	    continue;
+
+	switch (key) {
+	case '\t':
+	    /* Complete, listing completions at the second Tab */
+	    lineedit_complete(last_key == '\t');
+	    break;
+
+	case '\r':
+	case '\n':
+	    done = 1;
+	    break;
+
+	case KEY_CTRL('A'):
+	case KEY_HOME:
+	    cursor = 0;
+	    break;
+
+	case KEY_CTRL('B'):
+	case KEY_LEFT:
+	    if (cursor > 0)
+		cursor--;
+	    break;
+
+	case KEY_CTRL('C'):
+	    /* Cancel the line */
+	    lineedit_leave();
+	    lineedit_write("^C\n", 3);
+	    line_len = cursor = 0;
+	    shown_len = shown_cursor = 0;
+	    recalled = history_next();
+	    display_prompt();
+	    break;
+
+	case KEY_CTRL('D'):
+	    /* End of input on an empty line */
+	    if (line_len == 0) {
+		lineedit_restore();
+		return NULL;
+	    }
+	    /* Fall through */
+	case KEY_DELETE:
+	    if (cursor < line_len)
+		lineedit_delete(cursor, cursor + 1, 0);
+	    break;
+
+	case KEY_CTRL('E'):
+	case KEY_END:
+	    cursor = line_len;
+	    break;
+
+	case KEY_CTRL('F'):
+	case KEY_RIGHT:
+	    if (cursor < line_len)
+		cursor++;
+	    break;
+
+	case KEY_CTRL('H'):
+	case KEY_DEL:
+	    if (cursor > 0)
+		lineedit_delete(cursor - 1, cursor, 0);
+	    break;
+
+	case KEY_CTRL('K'):
+	    lineedit_delete(cursor, line_len, 1);
+	    break;
+
+	case KEY_CTRL('L'):
+	    /* Clear the screen */
+	    lineedit_write("\033[H\033[2J", 7);
+	    display_prompt();
+	    shown_len = shown_cursor = 0;
+	    break;
+
+	case KEY_CTRL('N'):
+	case KEY_DOWN:
+	    if (recalled < history_next())
+		lineedit_recall(recalled + 1);
+	    break;
+
+	case KEY_CTRL('P'):
+	case KEY_UP:
+	    if (recalled > history_oldest())
+		lineedit_recall(recalled - 1);
+	    break;
+
+	case KEY_CTRL('R'):
+	    /* Start an incremental search */
+	    memcpy(saved_line, line, line_len);
+	    saved_line[line_len] = '\0';
+	    searching = 1;
+	    search_failed = 0;
+	    pattern_len = 0;
+	    match = history_next();
+	    break;
+
+	case KEY_CTRL('U'):
+	    lineedit_delete(0, cursor, 1);
+	    break;
+
+	case KEY_CTRL('W'):
+	    lineedit_delete(lineedit_word_left(), cursor, 1);
+	    break;
+
+	case KEY_CTRL('Y'):
+	    lineedit_insert(kill_buffer, strlen(kill_buffer));
+	    break;
+
+	case KEY_WORD_LEFT:
+	    cursor = lineedit_word_left();
+	    break;
+
+	case KEY_WORD_RIGHT:
+	    cursor = lineedit_word_right();
+	    break;
+
+	default:
+	    if (key >= ' ' && key < KEY_DEL) {
+		chr = key;
+		lineedit_insert(&chr, 1);
+	    }
+	}
+	lineedit_refresh();
+    }
+
+    /* Leave the cursor after the line */
+    searching = 0;
+    cursor = line_len;
+    lineedit_refresh();
+    if (!lineedit_wrapped())
+	lineedit_write("\n", 1);
+    lineedit_restore();
+    if (key == -1 && line_len == 0)
+	return NULL;
+
+    if ((size_t) size < line_len + 2)
+	line_len = size - 2;
+    memcpy(buffer, line, line_len);
+    buffer[line_len] = '\n';
+    buffer[line_len + 1] = '\0';
+    return buffer;
+}
+
+/* End of file */
@@ -0,0 +1,48 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/lineedit.h
+ *
+ * Description: Line Editor
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _LINEEDIT_H_
+#define _LINEEDIT_H_
+
+/* Headers */
+#include <stdio.h> /* FILE */
+
+/* Prototypes */
+char *lineedit_gets(char *buffer, int size);
+void  lineedit_redraw(void);
+void  lineedit_leave(void);
+void  lineedit_restore(void);
+void  lineedit_input(FILE *file);
+
+#endif /* !_LINEEDIT_H_ */
+
+/* End of file */
@@ -0,0 +1,271 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/lish.c
+ *
+ * Description: Embedding API (liblish)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#define _POSIX_SOURCE /* For fdopen(), fileno() */
+
+/* Standard C headers */
+#include <stdio.h>  /* FILE, fdopen(), fflush()                     */
+#include <stdlib.h> /* NULL, malloc(), free()                       */
+#include <string.h> /* strlen()                                     */
+#include <setjmp.h> /* jmp_buf, setjmp()                            */
+#include <errno.h>  /* errno                                        */
+
+/* Standard UN*X headers */
+#include <sys/types.h>
+#include <unistd.h> /* dup(), dup2(), close(), read(), lseek(), getpid() */
+
+/* Project headers */
+#include <command.h>
+#include <common.h>
+#include "execcmd.h"
+#include "optimize.h"
+#include "heredoc.h"
+#include "lineedit.h"
+#include "prompt.h"
+#include "variable.h"
+#include "shell.h"
+#include "lish.h"
+
+
+/*****************************************************************************
+ *
+ * Types and Global Variables
+ *
+ */
+
+/* Evaluation context */
+struct lish_ctx {
+    exec_context_t *exec;    /* Execution context                   */
+    lish_output_t  *hook[2]; /* Hooks of standard and error outputs */
+    void           *arg[2];  /* Their arguments                     */
+};
+
+/* Whether the shell state shared by contexts is initialized */
+static int initialized = 0;
+
+
+/*****************************************************************************
+ *
+ * Output Capture Functions
+ *
+ */
+
+/*
+ * Redirect the output `fd' (1 or 2) to an anonymous file (in memory on
+ * Linux); return its descriptor, or -1 if it could not be created
+ */
+static int capture_start(int fd, int *save_fd)
+{
+    int file; /* Anonymous file */
+
+    fflush(fd == STDOUT_FILENO ? stdout : stderr);
+    if ((file = heredoc_file()) == -1)
+	return -1;
+    if ((*save_fd = dup(fd)) == -1 || dup2(file, fd) == -1) {
+	if (*save_fd != -1)
+	    close(*save_fd);
+	close(file);
+	return -1;
+    }
+    return file;
+}
+
+/*
+ * Restore the output `fd' redirected by capture_start()
+ */
+static void capture_end(int fd, int save_fd)
+{
+    fflush(fd == STDOUT_FILENO ? stdout : stderr);
+    dup2(save_fd, fd);
+    close(save_fd);
+}
+
+/*
+ * Give what was written to an anonymous file to the hook, and close it
+ */
+static void capture_give(int file, lish_output_t *hook, void *arg)
+{
+    char    buffer[4096]; /* Read buffer     */
+    ssize_t len;          /* Read characters */
+
+    lseek(file, 0, SEEK_SET);
+    while ((len = read(file, buffer, sizeof buffer)) > 0 ||
+	   (len == -1 && errno == EINTR))
+	if (len > 0)
+	    hook(buffer, len, arg);
+    close(file);
+}
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Create an evaluation context; return NULL if memory is lacking
+ */
+lish_ctx_t *lish_ctx_new(void)
+{
+    lish_ctx_t *ctx; /* Created context */
+
+    /* The first context imports the environment, as the shell does */
+    if (!initialized) {
+	var_init();
+	change_cwd();
+	prompt_disable();
+	initialized = 1;
+    }
+
+    if ((ctx = malloc(sizeof (lish_ctx_t))) == NULL)
+	return NULL;
+    if ((ctx->exec = exec_context_new()) == NULL) {
+	free(ctx);
+	return NULL;
+    }
+    ctx->hook[0] = ctx->hook[1] = NULL;
+    ctx->arg[0] = ctx->arg[1] = NULL;
+    return ctx;
+}
+
+/*
+ * Set the hook given the standard (`fd' is 1) or error (2) output of the
+ * commands evaluated in `ctx' once they ran, or none if `hook' is NULL;
+ * return 0, or -1 if `fd' is invalid
+ */
+int lish_ctx_output(lish_ctx_t *ctx, int fd, lish_output_t *hook, void *arg)
+{
+    if (fd != STDOUT_FILENO && fd != STDERR_FILENO)
+	return -1;
+    ctx->hook[fd - 1] = hook;
+    ctx->arg[fd - 1] = arg;
+    return 0;
+}
+
+/*
+ * Evaluate a command line (or several, with here-documents) in `ctx',
+ * storing the exit status of the last command in `*status' (if not NULL);
+ * return 0, or -1 on syntax error or if the commands could not be run
+ */
+int lish_eval(lish_ctx_t *ctx, const char *line, int *status)
+{
+    exec_context_t     *previous;     /* Context of the caller           */
+    FILE               *input;        /* Command lines                   */
+    int                 output[2];    /* Captured outputs                */
+    int                 save_fd[2];   /* Replaced outputs                */
+    int                 i, fd;        /* Counter, input descriptor       */
+    char                chr;          /* Current line character          */
+    char                buffer[MAX_COMMAND_LENGTH]; /* Input buffer      */
+    jmp_buf             leave;        /* Where `exit' returns to         */
+    command_t *volatile cmd = NULL;   /* Current command                 */
+    volatile int        ret = 0;      /* Return code                     */
+
+    /* Lines are read from a file as by `lish -c', so that here-documents
+       follow their command */
+    if ((fd = heredoc_open(line, strlen(line), 1)) == -1)
+	return -1;
+    if ((input = fdopen(fd, "r")) == NULL) {
+	close(fd);
+	return -1;
+    }
+
+    /* Redirect hooked outputs */
+    for (i = 0; i < 2; i++)
+	if (ctx->hook[i] == NULL)
+	    output[i] = -1;
+	else if ((output[i] = capture_start(i + 1, &save_fd[i])) == -1) {
+	    while (--i >= 0)
+		if (output[i] != -1) {
+		    capture_end(i + 1, save_fd[i]);
+		    close(output[i]);
+		}
+	    fclose(input);
+	    return -1;
+	}
+
+    /* Parse and execute each command in the context */
+    previous = exec_context_switch(ctx->exec);
+    lineedit_input(input);
+    ctx->exec->leave = &leave;
+    ctx->exec->leave_pid = getpid();
+    if (setjmp(leave) == 0)
+	while (lineedit_gets(buffer, sizeof buffer) != NULL) {
+	    for (i = 0; (chr = buffer[i]) != '\0'; i++)
+		if (chr != ' ' && chr != '\t' && chr != '\n')
+		    break;
+	    if (chr == '\0')
+		continue;
+	    if ((cmd = exec_parse(buffer)) == NULL) {
+		ret = -1;
+		break;
+	    }
+	    heredoc_read(cmd);
+	    optimize_command(cmd, NULL);
+	    exec_command(cmd);
+	    free_command(cmd);
+	    cmd = NULL;
+	}
+    else {
+	/* `exit' (or a fatal error) ended the evaluation */
+	exec_restore();
+	if (cmd != NULL)
+	    free_command(cmd);
+    }
+    ctx->exec->leave = NULL;
+    lineedit_input(NULL);
+    exec_context_switch(previous);
+    fclose(input);
+
+    /* Give the outputs to their hooks, which may write to them */
+    for (i = 0; i < 2; i++)
+	if (output[i] != -1)
+	    capture_end(i + 1, save_fd[i]);
+    for (i = 0; i < 2; i++)
+	if (output[i] != -1)
+	    capture_give(output[i], ctx->hook[i], ctx->arg[i]);
+
+    if (status != NULL)
+	*status = ctx->exec->exit_status;
+    return ret;
+}
+
+/*
+ * Free an evaluation context
+ */
+void lish_ctx_free(lish_ctx_t *ctx)
+{
+    exec_context_free(ctx->exec);
+    free(ctx);
+}
+
+/* End of file */
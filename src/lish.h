@@ -0,0 +1,67 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/lish.h
+ *
+ * Description: Embedding API (liblish)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _LISH_H_
+#define _LISH_H_
+
+/* Headers */
+#include <stddef.h> /* size_t */
+
+/*
+ * This header, with liblish.a and libchelle.a, lets a program run shell
+ * command lines without starting a shell for each of them: pipelines are
+ * parsed and executed in the calling process, which forks once per stage.
+ *
+ * Shell variables (imported from the environment when the first context is
+ * created), the working directory and the effects of internal commands are
+ * those of the calling process, shared by all contexts.  While lish_eval()
+ * runs, SIGCHLD must not be handled by a function reaping any child.
+ */
+
+/* Evaluation context: execution state of commands, exit status */
+typedef struct lish_ctx lish_ctx_t;
+
+/* Output hook, given `len' bytes of output at `data' and its argument; the
+   output of a line is kept (in memory on Linux) while lish_eval() runs it,
+   and given to the hooks after, in pieces, standard output first */
+typedef void lish_output_t(const char *data, size_t len, void *arg);
+
+/* Prototypes */
+lish_ctx_t *lish_ctx_new(void);
+int         lish_ctx_output(lish_ctx_t *ctx, int fd, lish_output_t *hook,
+			    void *arg);
+int         lish_eval(lish_ctx_t *ctx, const char *line, int *status);
+void        lish_ctx_free(lish_ctx_t *ctx);
+
+#endif /* !_LISH_H_ */
+
+/* End of file */
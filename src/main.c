@@ -30,60 +30,42 @@
  */
 
 
-#define _POSIX_SOURCE          /* For kill()                      */
-#define _BSD_SOURCE            /* For gethostname() and setenv()  */
-#define _POSIX_C_SOURCE 200112 /* For gethostname() under FreeBSD */
+#define _POSIX_SOURCE /* For kill()                                  */
+#define _BSD_SOURCE   /* For signal() restarting interrupted system calls */
 
 /* Standard C headers */
-#include <limits.h> /* PATH_MAX, HOST_NAME_MAX                        */
 #include <stdio.h>  /* printf(), *puts(), fgets(), putchar() perror() */
-#include <stdlib.h> /* NULL, malloc(), free()                         */
-#include <string.h> /* strlen(), strcmp(), strncmp(), strrchr()       */
-#include <errno.h>  /* errno                                          */
+#include <stdlib.h> /* NULL, malloc(), free(), atoi()                 */
+#include <string.h> /* strlen(), strcmp(), strncmp(), strncpy(), ...  */
 
 /* Standard Unix headers */
 #include <sys/types.h>
 #include <sys/wait.h> /* waitpid()                                    */
-#include <unistd.h>   /* getuid(), geteuid(), gethostname(), getcwd() */
+#include <sys/time.h> /* gettimeofday()                               */
+#include <unistd.h>   /* getcwd()                                     */
 #include <signal.h>   /* sighandler_t, signal(), kill()               */
-#include <pwd.h>      /* struct passwd, getpwuid()                    */
-#include <libgen.h>   /* basename()                                   */
-
-#ifdef HAS_MALLOC_MTRACE
-# include <mcheck.h>  /* mtrace() */
-#endif
+#include <fcntl.h>    /* open()                                       */
 
 /* Project headers */
 #include <command.h>
 #include <common.h>
 #include "version.h"
 #include "execcmd.h"
+#include "jobqueue.h"
+#include "optimize.h"
+#include "server.h"
 #include "history.h"
-#include "main.h"
-
-#ifndef PATH_MAX
-# define PATH_MAX 4096
-#endif /* !PATH_MAX */
-#ifndef HOST_NAME_MAX
-# define HOST_NAME_MAX 255
-#endif /* !HOST_NAME_MAX */
-
-
-/*****************************************************************************
- *
- * Global Variables
- *
- */
-
-/* Program name, from executable filename */
-const char *exe_name;
-
-/* Current working directory */
-char *cwd = NULL;
-static int cwd_len = PATH_MAX;
-
-/* Number of killed children by signal handler */
-int killed = 0;
+#include "prompt.h"
+#include "lineedit.h"
+#include "pathindex.h"
+#include "variable.h"
+#include "expand.h"
+#include "heredoc.h"
+#include "internal.h"
+#include "plugin.h"
+#include "metrics.h"
+#include "alloc.h"
+#include "shell.h"
 
 
 /*****************************************************************************
@@ -92,13 +74,13 @@ int killed = 0;
  *
  */
 
-static void display_prompt(void);
 static void sig_int_quit_tstp(int sig);
+static void bench_startup(char *argv0, int runs);
 
 
 /*****************************************************************************
  *
- * Initialization and Finalization Functions
+ * Initialization Functions
  *
  */
 
@@ -108,9 +90,17 @@ static void sig_int_quit_tstp(int sig);
 int main(int argc, char *argv[])
 {
     int i, ret = 0, debug = 0;       /* Counter, return code, debugging? */
+    int interactive;                 /* Is input a terminal?             */
+    const char *command = NULL;      /* Command given by -c              */
+    const char *server = NULL;       /* Socket given by --server         */
+    FILE *input;                     /* Input of this command            */
+    int fd;                          /* Its descriptor                   */
     char chr;                        /* Current string character         */
     char buffer[MAX_COMMAND_LENGTH]; /* Input buffer                     */
+    char dir[MAX_COMMAND_LENGTH];    /* Directory the command runs in    */
     command_t *cmd;                  /* Current command                  */
+    struct timeval start, end;       /* Command start and end times      */
+    struct history_info info;        /* Command execution details        */
 
     /* Default name if it cannot be retrieved from argv[0] */
     static const char default_exe_name[] = "lish";
@@ -119,18 +109,20 @@ int main(int argc, char *argv[])
     static const char sexy_prompt[] = "\\e[33;1m[\\e[32;1m\\u\\e[33;1m@"
 	"\\e[35;1m\\h\\e[33;1m:\\e[34;1m\\w\\e[33;1m]\\e[31;1m\\$\\e[0m ";
 
-    /* Memory allocation tracing */
-#ifdef HAS_MALLOC_MTRACE
-    setenv("MALLOC_TRACE", "lish.mtrace", 0);
-    mtrace();
-#endif
+    /* Import environment variables */
+    shell_pid = getpid();
+    var_init();
+
+    /* Find executable name */
+    if (argc == 0 || (exe_name = strrchr(argv[0], '/')) == NULL ||
+	(++exe_name)[0] == '\0')
+	exe_name = default_exe_name;
 
     /* Examine arguments */
     for (i = 1; i < argc; i++) {
 	/* Use a very sexy prompt :) */
 	if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--sexy")) {
-	    if (setenv("PS1", sexy_prompt, 1) == -1)
-		lish_perror("prompt");
+	    var_set("PS1", sexy_prompt, VAR_EXPORT);
 	    continue;
 	}
 
@@ -140,69 +132,149 @@ int main(int argc, char *argv[])
 	    continue;
 	}
 
+	/* Execute a command and exit, like sh -c */
+	if (!strcmp(argv[i], "-c")) {
+	    if (++i == argc) {
+		fprintf(stderr, "%s: -c: command expected\n", argv[0]);
+		return RET_ERROR;
+	    }
+	    command = argv[i];
+	    continue;
+	}
+
+	/* Execute commands received over a UNIX socket */
+	if (!strcmp(argv[i], "--server")) {
+	    if (++i == argc) {
+		fprintf(stderr, "%s: --server: socket name expected\n",
+			argv[0]);
+		return RET_ERROR;
+	    }
+	    server = argv[i];
+	    continue;
+	}
+
+	/* Run the history contention benchmark and exit */
+	if (!strcmp(argv[i], "--bench-history")) {
+	    if (++i == argc || atoi(argv[i]) <= 0) {
+		fprintf(stderr, "%s: --bench-history: number of writers "
+			"expected\n", argv[0]);
+		return RET_ERROR;
+	    }
+	    history_bench(atoi(argv[i]));
+	    return 0;
+	}
+
+	/* Run the startup benchmark and exit */
+	if (!strcmp(argv[i], "--bench-startup")) {
+	    if (++i == argc || atoi(argv[i]) <= 0) {
+		fprintf(stderr, "%s: --bench-startup: number of runs "
+			"expected\n", argv[0]);
+		return RET_ERROR;
+	    }
+	    bench_startup(argv[0], atoi(argv[i]));
+	    return 0;
+	}
+
 	/* Display version and exit */
 	if (!strcmp(argv[i], "-v") || !strcmp(argv[i], "--version")) {
 	    printf("%s %s\n"
 		   "Copyright (C) 2005 Benjamin Gaillard\n"
 		   "\n"
 		   "This is a basic bash-like shell.\n"
-		   "Integrated commands: cd, echo, exec, exit, export, "
-		   "history, kill.\n"
+		   "Integrated commands: ", lish_name, lish_version);
+	    internal_names();
+	    printf(".\n"
 		   "\n"
-		   "Have fun with %s!\n", lish_name, lish_version, lish_name);
+		   "Have fun with %s!\n", lish_name);
 	    return 0;
 	}
 
 	/* Display help and exit */
 	if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
 	    printf("Usage: %s [-s | --sexy] [-d | --debug] [-v | --version] "
-		   "[-h | --help]\n"
+		   "[-h | --help] [-c COMMAND] [--server SOCKET] "
+		   "[--bench-history N] [--bench-startup N]\n"
 		   "    -s: use an improved predefined prompt\n"
 		   "    -d: display command parsing debug informations\n"
-		   "    -v: display version information\n"
+		   "    -c: execute COMMAND (lines) and exit\n"
+		   "    --server: execute commands sent to the UNIX socket "
+		   "SOCKET by lishc\n", argv[0]);
+	    printf("    -v: display version information\n"
 		   "    -h: display this help\n"
-		   "\n", argv[0]);
+		   "    --bench-history: measure history appends by N "
+		   "concurrent writers\n"
+		   "    --bench-startup: measure time to first prompt and to "
+		   "exit over N runs\n"
+		   "\n");
 	    printf("The prompt is based on $PS1, some bash $PS1 escape codes "
 		   "are supported:\n"
 		   "    \\$: `$' if normal user, `#' if root\n"
 		   "    \\\\: `\\'\n"
 		   "    \\[ and \\]: ignored\n"
 		   "    \\e: escape code (\\033)\n"
-		   "    \\h: hostname up to the first `.'\n"
-		   "    \\H: full hostname\n"
+		   "    \\g: VCS branch (git or Mercurial), computed in "
+		   "background\n"
+		   "    \\h: hostname up to the first `.'\n");
+	    printf("    \\H: full hostname\n"
+		   "    \\j: number of background jobs\n"
+		   "    \\L: load average, computed in background\n"
 		   "    \\n: line break\n"
 		   "    \\s: shell name\n"
 		   "    \\u: user name\n"
 		   "    \\v and \\V: current shell version\n"
 		   "    \\w: current working directory (full path)\n"
 		   "    \\W: current working directory (name only)\n"
+		   "    \\?: exit status of the last command\n"
 		   "The prompt used with -s/--sexy is:\n"
 		   "    %s\n", sexy_prompt);
 	    return 0;
 	}
     }
 
-    /* Find executable name */
-    if (argc == 0 || (exe_name = strrchr(argv[0], '/')) == NULL ||
-	(++exe_name)[0] == '\0')
-	exe_name = default_exe_name;
+    /* A server only returns in the shell forked to execute a request,
+       with its command */
+    if (server != NULL) {
+	if ((command = server_run(server)) == NULL)
+	    return RET_ERROR;
+	shell_pid = getpid();
+    }
+
+    /* A command given as argument is read as input, without prompt */
+    if (command != NULL) {
+	if ((fd = heredoc_open(command, strlen(command), 1)) == -1 ||
+	    (input = fdopen(fd, "r")) == NULL) {
+	    lish_perror("fatal error");
+	    return RET_ERROR;
+	}
+	lineedit_input(input);
+	prompt_disable();
+    }
 
     /* Install signal handlers */
-    signal(SIGTERM, SIG_IGN); /* Ignore SIGTERM, as bash does */
+    if (command == NULL)
+	signal(SIGTERM, SIG_IGN); /* Ignore SIGTERM, as bash does */
     signal(SIGCHLD, sig_chld);
     signal(SIGINT,  sig_int_quit_tstp);
     signal(SIGQUIT, sig_int_quit_tstp);
     signal(SIGTSTP, sig_int_quit_tstp);
+#ifdef SIGXFSZ
+    signal(SIGXFSZ, SIG_IGN); /* Writes beyond `ulimit -f' fail instead */
+#endif
 
     /* Update current directory and display first prompt */
     change_cwd();
     display_prompt();
 
-    /* Initialize history */
-    history_init();
+    /* History is attached at its first use; commands are only recorded
+       when they are typed, so that scripts do not need it */
+    interactive = command == NULL && isatty(STDIN_FILENO);
+
+    /* Input (edit on a terminal) and process command lines; queued
+       background jobs may be launched while waiting for them */
+    jobqueue_idle(1);
+    while (lineedit_gets(buffer, sizeof buffer) != NULL) {
+	jobqueue_idle(0);
 
-    /* Input and process command lines */
-    while (fgets(buffer, sizeof buffer, stdin) != NULL) {
 	/* Check for empty line */
 	for (i = 0; (chr = buffer[i]) != '\0'; i++)
 	    if (chr != ' ' && chr != '\t' && chr != '\n')
@@ -210,260 +282,141 @@ int main(int argc, char *argv[])
 
 	/* Parse and execute command */
 	was_old_command = 0;
-        if (chr != '\0' && (cmd = parse_command(buffer)) != NULL) {
-	    /* Execute command */
+        if (chr != '\0' && (cmd = exec_parse(buffer)) != NULL) {
+	    /* Read here-documents from the following lines (a command whose
+	       here-document is cut by the end of input is run anyway) */
+	    heredoc_read(cmd);
+
+	    /* Rewrite it not to launch needless processes, and execute it */
+	    optimize_command(cmd, debug ? stderr : NULL);
 	    if (debug)
 		dump_command(cmd, stderr);
+	    strncpy(dir, cwd, sizeof dir - 1);
+	    dir[sizeof dir - 1] = '\0';
+	    gettimeofday(&start, NULL);
             ret = exec_command(cmd);
+	    gettimeofday(&end, NULL);
             free_command(cmd);
 
-	    /* Add command to history (only if it's valid) */
-	    if (!was_old_command)
-		history_add(buffer);
+	    /* Add command to history (only if it's valid), with its
+	       execution details */
+	    if (!was_old_command && interactive) {
+		info.start = start.tv_sec;
+		info.duration = (end.tv_sec - start.tv_sec) * 1000L +
+		    (end.tv_usec - start.tv_usec) / 1000;
+		info.status = ret;
+		info.cwd = dir;
+		history_add(buffer, &info);
+	    }
         }
 
+	/* Export metrics from time to time */
+	metrics_dump(0);
+
 	/* Re-display prompt */
+	jobqueue_idle(1);
 	display_prompt();
     }
+    jobqueue_idle(0);
+
+    /* Queued background jobs still have to run */
+    jobqueue_drain();
+    metrics_dump(1);
 
     history_exit();
+    pathindex_free();
+    expand_free();
+    exec_free();
+    jobqueue_free();
+    plugin_free();
+    var_free();
 
     /* Like bash */
-    puts("exit");
+    if (command == NULL)
+	puts("exit");
 
-#ifdef HAS_MALLOC_MTRACE
-    muntrace();
+    /* Allocations still there are leaks */
+#ifdef HAS_ALLOC_PROFILE
+    alloc_report(stderr);
 #endif
 
     return ret;
 }
 
 /*
- * Free memory and exit Lish
- */
-void NORETURN lish_exit(int error_code)
-{
-    close_fds();
-    if (current_command)
-	free_command(current_command);
-    history_exit();
-
-    exit(error_code);
-}
-
-/*
- * Free memory and cause abnormal program termination
+ * Measure the time to the first prompt and to exit of `runs' shells given
+ * an empty input, as when started by a script or cron
  */
-void NORETURN lish_abort(void)
+static void bench_startup(char *argv0, int runs)
 {
-    close_fds();
-    if (current_command)
-	free_command(current_command);
-    history_exit();
-
-    abort();
-}
-
-
-/*****************************************************************************
- *
- * Utility Functions
- *
- */
-
-/*
- * Display the prompt
- */
-static void display_prompt(void)
-{
-    int         i, j, home_len; /* Counters, home directory length */
-    char        chr;            /* Current character               */
-    char       *home;           /* Home directory name             */
-    const char *prompt;         /* Prompt string                   */
-
-    /* Information used to create the prompt */
-    static int uid = -1, euid = -1;
-    static struct passwd *username = NULL;
-    static char hostname[HOST_NAME_MAX + 1];
-    static const char default_prompt[] = "\\s\\$ ";
-
-    /* Use default prompt if not present in the $PS1 environment variable */
-    if ((prompt = getenv("PS1")) == NULL)
-	prompt = default_prompt;
-
-    /* Find informations if not already done */
-    if (uid == -1)
-	uid = getuid();
-    if (euid == -1)
-	euid = geteuid();
-    if (username == NULL)
-	username = getpwuid((uid = getuid()));
-
-    /* Informations that may change throuth execution, (re)get them */
-    gethostname(hostname, sizeof hostname);
-    home = getenv("HOME");
-
-    /* Replace escape sequences */
-    for (i = 0; (chr = prompt[i]) != '\0'; i++) {
-	if (chr != '\\')
-	    putchar(chr);
-	else
-	    switch ((chr = prompt[++i])) {
-	    case '$':
-		putchar(euid != 0 ? '$' : '#');
-		break;
-
-	    case 'H':
-		fputs(hostname, stdout);
-		break;
-
-	    case 'W':
-		if (!strcmp(cwd, home))
-		    putchar('~');
-		else
-		    fputs(basename(cwd), stdout);
-		break;
-
-	    case '\\':
-		putchar('\\');
-		break;
-
-	    case '[':
-	    case ']':
-		break;
-
-	    case 'e':
-		putchar('\033');
-		break;
-
-	    case 'h':
-		for (j = 0; hostname[j] != '\0'; j++)
-		    if (hostname[j] == '.') {
-			hostname[j] = '\0';
-			break;
-		    }
-		fputs(hostname, stdout);
-		break;
-
-	    case 'n':
-		putchar('\n');
-		break;
-
-	    case 's':
-		fputs(exe_name, stdout);
-		break;
-
-	    case 'u':
-		if (username)
-		    fputs(username->pw_name, stdout);
-		else
-		    printf("%d", uid);
-		break;
-
-	    case 'v':
-	    case 'V':
-		fputs(lish_version, stdout);
-		break;
-
-	    case 'w':
-		if (home) {
-		    if ((home_len = strlen(home)) > 1) {
-			if (home[home_len - 1] == '/')
-			    home_len--;
-
-			if (home_len > 1 && !strncmp(cwd, home, home_len)) {
-			    putchar('~');
-			    fputs(cwd + home_len, stdout);
-			} else
-			    fputs(cwd, stdout);
-		    } else
-			fputs(cwd, stdout);
-		} else
-		    fputs(cwd, stdout);
-		break;
-
-	    default:
-		putchar('\\');
-		if (chr != '\0')
-		    putchar(chr);
-		else
-		    i--;
-	    }
-    }
-
-    fflush(stdout);
-}
-
-/*
- * Update $PWD and directory used in prompt
- */
-void change_cwd(void)
-{
-    /* Allocate memory if not already done */
-    if (cwd == NULL && (cwd = malloc(PATH_MAX)) == NULL) {
-	lish_perror("fatal error");
-	lish_exit(RET_ERROR);
-    }
-
-    /* Get working directory and allocate more memory if necessary */
-    while (getcwd(cwd, cwd_len) == NULL) {
-	if (errno == ERANGE) {
-	    free(cwd);
-	    if ((cwd = malloc((cwd_len += PATH_MAX))) == NULL) {
-		lish_perror("fatal error");
-		lish_exit(RET_ERROR);
-	    }
-	} else {
-	    lish_perror("fatal error");
+    int            i, fd[2];            /* Counter, output pipe         */
+    pid_t          pid;                 /* Created process PID          */
+    char           buffer[256];         /* Output buffer                */
+    struct timeval start, prompt, end;  /* Start, first output and exit */
+    double         first, total;        /* Durations, in ms             */
+    double         first_min = 0, total_min = 0, first_sum = 0,
+		   total_sum = 0;       /* Results                      */
+    char          *args[2];             /* Program arguments            */
+
+    args[0] = argv0;
+    args[1] = NULL;
+    for (i = 0; i < runs; i++) {
+	if (pipe(fd) == -1) {
+	    lish_perror("cannot create pipe");
 	    lish_exit(RET_ERROR);
 	}
-    }
+	gettimeofday(&start, NULL);
+	if ((pid = fork()) == 0) {
+	    close(fd[0]);
+	    dup2(fd[1], STDOUT_FILENO);
+	    close(fd[1]);
+	    close(STDIN_FILENO);
+	    open("/dev/null", O_RDONLY);
+	    execvp(argv0, args);
+	    lish_perror(argv0);
+	    _exit(RET_ERROR);
+	} else if (pid == -1) {
+	    lish_perror("could not fork");
+	    lish_exit(RET_ERROR);
+	}
+	close(fd[1]);
 
-    /* Set environment variable $PWD */
-    setenv("PWD", cwd, 1);
-}
+	/* The prompt is the first output, then read until exit */
+	if (read(fd[0], buffer, sizeof buffer) > 0)
+	    gettimeofday(&prompt, NULL);
+	else
+	    prompt = start;
+	while (read(fd[0], buffer, sizeof buffer) > 0)
+	    ;
+	close(fd[0]);
+	waitpid(pid, NULL, 0);
+	gettimeofday(&end, NULL);
+
+	first = (prompt.tv_sec - start.tv_sec) * 1000.0 +
+	    (prompt.tv_usec - start.tv_usec) / 1000.0;
+	total = (end.tv_sec - start.tv_sec) * 1000.0 +
+	    (end.tv_usec - start.tv_usec) / 1000.0;
+	if (i == 0 || first < first_min)
+	    first_min = first;
+	if (i == 0 || total < total_min)
+	    total_min = total;
+	first_sum += first;
+	total_sum += total;
+    }
 
-/*
- * Print an error message, preceded by shell name and followed by the standard
- * error string
- */
-void lish_perror(const char *str)
-{
-    fprintf(stderr, "%s: ", exe_name);
-    perror(str);
+    /* Print results */
+    printf("startup: %d runs, first prompt in %.3f ms (min %.3f), "
+	   "exit in %.3f ms (min %.3f)\n", runs, first_sum / runs, first_min,
+	   total_sum / runs, total_min);
 }
 
 
 /*****************************************************************************
  *
- * Signal Handlers
+ * Signal Handler
  *
  */
 
-/*
- * Called upon SIGCHLD (a child terminated)
- */
-void sig_chld(int sig UNUSED)
-{
-    int   status; /* Return code            */
-    pid_t pid;    /* Terminated process PID */
-
-    /* Re-install handler */
-    signal(SIGCHLD, sig_chld);
-
-    /* Wait for all pending children (non-blocking) */
-    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
-	if (WIFSTOPPED(status)) {
-	    kill(pid, SIGCONT);
-	    printf("\n[%d] in background\n", pid);
-	} else
-	    printf("\n[%d] %d\n", pid,
-		   WIFEXITED(status) ? WEXITSTATUS(status) : RET_ERROR);
-	/* Handler only active when no command is executing */
-	display_prompt();
-    }
-}
-
 /*
  * Called upon SIGINT (interrupted: Ctrl-C), SIGQUIT (Ctrl-\) or
  * SIGTSTP (Ctrl-Z)
@@ -476,49 +429,18 @@ static void sig_int_quit_tstp(int sig)
     signal(sig, sig_int_quit_tstp);
 
     /* Transmit signal to currently executing processes */
-    for (i = 0; i < proc_count; i++) {
+    for (i = 0; i < exec_ctx->proc_count; i++) {
 	/* Signal is normally automatically sent to children, but ensure it is
 	   by doing so ourselves */
-	kill(processes[i], sig);
+	kill(exec_ctx->processes[i], sig);
 	killed++;
     }
 
     /* Imitate the behaviour of bash */
-    if (sig == SIGINT && !current_command) {
+    if (sig == SIGINT && !exec_ctx->current_command) {
 	putchar('\n');
 	display_prompt();
     }
 }
 
-
-/*****************************************************************************
- *
- * Interface with History Functions
- *
- */
-
-/*
- * historique_precedente -> history_last
- */
-char *historique_precedente(void)
-{
-    return history_last();
-}
-
-/*
- * historique_numero -> history_number
- */
-char *historique_numero(int i)
-{
-    return history_number(i);
-}
-
-/*
- * historique_chaine -> history_string
- */
-char *historique_chaine(const char *c)
-{
-    return history_string(c);
-}
-
 /* End of file */
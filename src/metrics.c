@@ -0,0 +1,284 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/metrics.c
+ *
+ * Description: Runtime Counters and Latency Histograms
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#define _POSIX_C_SOURCE 199309L /* For clock_gettime() */
+
+/* Standard C headers */
+#include <stdio.h>  /* printf(), sprintf(), fopen(), rename() */
+#include <stdlib.h> /* NULL, malloc(), free(), atol()         */
+#include <string.h> /* strlen()                               */
+#include <time.h>   /* clock_gettime(), time()                */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <unistd.h> /* getpid() */
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "variable.h"
+#include "metrics.h"
+
+
+/*****************************************************************************
+ *
+ * Global Variables
+ *
+ */
+
+/* Number of histogram buckets: bucket i counts latencies up to 2^i us, the
+   last one those beyond */
+#define BUCKETS 22
+
+/* Default interval between dumps to $LISH_METRICS, in seconds */
+#define DUMP_INTERVAL 60
+
+/* Counter values */
+unsigned long metric_counters[METRIC_COUNTERS];
+
+/* Names and descriptions of counters and histograms */
+struct metric_name {
+    const char *name;
+    const char *help;
+};
+static const struct metric_name counters[METRIC_COUNTERS] = {
+    { "forks",         "Processes forked by the shell"            },
+    { "execs",         "Programs launched"                        },
+    { "path_misses",   "Commands not found in the $PATH index"    },
+    { "parses",        "Command lines parsed"                     },
+    { "parse_errors",  "Command lines which could not be parsed"  },
+    { "history_waits", "Waits for another session using history"  },
+    { "stages",        "Pipeline stages launched"                 },
+    { "builtins",      "Internal commands run"                    }
+};
+
+static const struct metric_name histogram_names[METRIC_HISTOGRAMS] = {
+    { "parse", "Command line parsing latency" },
+    { "spawn", "Process creation latency"     }
+};
+
+/* Latency histograms, in microseconds */
+static struct histogram {
+    unsigned long buckets[BUCKETS]; /* Observations, by bucket */
+    unsigned long count;            /* Number of observations  */
+    unsigned long sum;              /* Sum of latencies        */
+} histograms[METRIC_HISTOGRAMS];
+
+/* Time of the last dump to $LISH_METRICS */
+static time_t dumped = 0;
+
+
+/*****************************************************************************
+ *
+ * Measures
+ *
+ */
+
+/*
+ * Get a monotonic time, in microseconds
+ */
+unsigned long metrics_clock(void)
+{
+    struct timespec now; /* Current time */
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (unsigned long) now.tv_sec * 1000000UL + now.tv_nsec / 1000;
+}
+
+/*
+ * Add the latency of an operation started at `start' (from metrics_clock())
+ * to a histogram
+ */
+void metrics_observe(enum metric_histogram histogram, unsigned long start)
+{
+    struct histogram *h = &histograms[histogram]; /* Histogram */
+    unsigned long     latency, bound;             /* Latency   */
+    int               i;                          /* Bucket    */
+
+    latency = metrics_clock() - start;
+    for (i = 0, bound = 1; i < BUCKETS - 1 && latency > bound; i++)
+	bound <<= 1;
+    h->buckets[i]++;
+    h->count++;
+    h->sum += latency;
+}
+
+
+/*****************************************************************************
+ *
+ * Output
+ *
+ */
+
+/*
+ * Get the upper bound of the bucket holding quantile `q' of a histogram,
+ * in microseconds (0 if beyond the last bound)
+ */
+static unsigned long metrics_quantile(const struct histogram *h, double q)
+{
+    unsigned long seen = 0; /* Observations in lower buckets */
+    int           i;        /* Bucket                        */
+
+    for (i = 0; i < BUCKETS - 1; i++)
+	if ((seen += h->buckets[i]) >= q * h->count)
+	    return 1UL << i;
+    return 0;
+}
+
+/*
+ * Write metrics in the OpenMetrics text format
+ */
+static void metrics_write(FILE *file)
+{
+    const struct histogram *h;    /* Current histogram */
+    const char             *name; /* Its name          */
+    unsigned long           seen; /* Cumulative count  */
+    long                    pid;  /* Shell PID         */
+    int                     i, j; /* Counters          */
+
+    pid = (long) getpid();
+    for (i = 0; i < METRIC_COUNTERS; i++)
+	fprintf(file, "# TYPE lish_%s counter\n# HELP lish_%s %s.\n"
+		"lish_%s_total{pid=\"%ld\"} %lu\n", counters[i].name,
+		counters[i].name, counters[i].help, counters[i].name, pid,
+		metric_counters[i]);
+
+    for (i = 0; i < METRIC_HISTOGRAMS; i++) {
+	h = &histograms[i];
+	name = histogram_names[i].name;
+	fprintf(file, "# TYPE lish_%s_seconds histogram\n"
+		"# HELP lish_%s_seconds %s.\n", name, name,
+		histogram_names[i].help);
+	for (seen = 0, j = 0; j < BUCKETS - 1; j++) {
+	    seen += h->buckets[j];
+	    fprintf(file, "lish_%s_seconds_bucket{pid=\"%ld\",le=\"%g\"} "
+		    "%lu\n", name, pid, (1UL << j) / 1e6, seen);
+	}
+	fprintf(file, "lish_%s_seconds_bucket{pid=\"%ld\",le=\"+Inf\"} %lu\n"
+		"lish_%s_seconds_sum{pid=\"%ld\"} %g\n"
+		"lish_%s_seconds_count{pid=\"%ld\"} %lu\n", name, pid,
+		h->count, name, pid, h->sum / 1e6, name, pid, h->count);
+    }
+    fputs("# EOF\n", file);
+}
+
+/*
+ * Print metrics on the standard output, readable or in the OpenMetrics
+ * format
+ */
+void metrics_print(int openmetrics)
+{
+    const struct histogram *h; /* Current histogram */
+    int                     i; /* Counter           */
+
+    if (openmetrics) {
+	metrics_write(stdout);
+	return;
+    }
+
+    for (i = 0; i < METRIC_COUNTERS; i++)
+	printf("%-14s %10lu\n", counters[i].name, metric_counters[i]);
+    for (i = 0; i < METRIC_HISTOGRAMS; i++) {
+	h = &histograms[i];
+	printf("%-14s %10lu calls", histogram_names[i].name, h->count);
+	if (h->count > 0)
+	    printf(", mean %lu us, p50 <= %lu us, p99 <= %lu us",
+		   h->sum / h->count, metrics_quantile(h, .5),
+		   metrics_quantile(h, .99));
+	putchar('\n');
+    }
+}
+
+/*
+ * Write metrics to the file named by $LISH_METRICS (for a textfile
+ * collector) if it is set and $LISH_METRICS_INTERVAL seconds (or 60) have
+ * elapsed since the last dump, or if `force' is set; the file is replaced
+ * atomically, so that it is never read half-written
+ * The file holds the metrics of this shell only (labelled with its PID): a
+ * `%p' in its name is replaced by the PID to get one file per shell, as
+ * shells writing the same file replace the metrics of one another.
+ */
+void metrics_dump(int force)
+{
+    const char *pattern;      /* $LISH_METRICS           */
+    const char *value;        /* Interval                */
+    char       *name, *temp;  /* File names              */
+    size_t      len;          /* Length of a file name   */
+    FILE       *file;         /* Temporary file          */
+    time_t      now;          /* Current time            */
+    long        interval;     /* Dump interval           */
+    int         i;            /* Counter                 */
+
+    if ((pattern = var_get("LISH_METRICS")) == NULL || *pattern == '\0')
+	return;
+    now = time(NULL);
+    if ((value = var_get("LISH_METRICS_INTERVAL")) == NULL ||
+	(interval = atol(value)) <= 0)
+	interval = DUMP_INTERVAL;
+    if (!force && now - dumped < interval)
+	return;
+    dumped = now;
+
+    /* File name, `%p' being replaced by the PID, and temporary file name,
+       per process as well */
+    for (len = strlen(pattern), i = 0; pattern[i] != '\0'; i++)
+	if (pattern[i] == '%' && pattern[i + 1] == 'p')
+	    len += 20;
+    if ((name = malloc(len + 1)) == NULL ||
+	(temp = malloc(len + 26)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    for (len = 0; *pattern != '\0'; pattern++)
+	if (pattern[0] == '%' && pattern[1] == 'p') {
+	    len += sprintf(name + len, "%ld", (long) getpid());
+	    pattern++;
+	} else
+	    name[len++] = *pattern;
+    name[len] = '\0';
+    sprintf(temp, "%s.%ld.tmp", name, (long) getpid());
+
+    if ((file = fopen(temp, "w")) == NULL)
+	lish_perror(temp);
+    else {
+	metrics_write(file);
+	if (fclose(file) == EOF || rename(temp, name) == -1) {
+	    lish_perror(name);
+	    remove(temp);
+	}
+    }
+    free(temp);
+    free(name);
+}
+
+/* End of file */
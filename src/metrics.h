@@ -0,0 +1,71 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/metrics.h
+ *
+ * Description: Runtime Counters and Latency Histograms
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _METRICS_H_
+#define _METRICS_H_
+
+/* Counters */
+enum metric_counter {
+    METRIC_FORKS,         /* Processes forked                        */
+    METRIC_EXECS,         /* Programs launched                       */
+    METRIC_PATH_MISSES,   /* Commands not found in the $PATH index   */
+    METRIC_PARSES,        /* Command lines parsed                    */
+    METRIC_PARSE_ERRORS,  /* Command lines which could not be parsed */
+    METRIC_HISTORY_WAITS, /* Waits for another session's history     */
+    METRIC_STAGES,        /* Pipeline stages launched                */
+    METRIC_BUILTINS,      /* Internal commands run                   */
+    METRIC_COUNTERS
+};
+
+/* Latency histograms */
+enum metric_histogram {
+    METRIC_PARSE, /* Parsing of a command line        */
+    METRIC_SPAWN, /* Creation of a process by fork()  */
+    METRIC_HISTOGRAMS
+};
+
+/* Counter values */
+extern unsigned long metric_counters[METRIC_COUNTERS];
+
+/* Count an event */
+#define METRIC_COUNT(counter) (metric_counters[counter]++)
+
+/* Prototypes */
+unsigned long metrics_clock(void);
+void          metrics_observe(enum metric_histogram histogram,
+			      unsigned long start);
+void          metrics_print(int openmetrics);
+void          metrics_dump(int force);
+
+#endif /* !_METRICS_H_ */
+
+/* End of file */
@@ -0,0 +1,355 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/optimize.c
+ *
+ * Description: Command Optimizer
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+
+/* Standard C headers */
+#include <stdio.h>  /* fprintf(), printf(), fputs()           */
+#include <stdlib.h> /* NULL, malloc(), free()                  */
+#include <string.h> /* strcmp(), strncmp(), strchr(), strcspn() */
+
+/* Project headers */
+#include <command.h>
+#include <common.h>
+#include "shell.h"
+#include "variable.h"
+#include "internal.h"
+#include "optimize.h"
+
+
+/*****************************************************************************
+ *
+ * Global Variables
+ *
+ */
+
+/* Rewrites */
+#define OPTIMIZE_CATFILE  1 /* `cat FILE | cmd' -> `cmd < FILE'       */
+#define OPTIMIZE_CATPIPE  2 /* `a | cat | b' -> `a | b'               */
+#define OPTIMIZE_SUBSHELL 4 /* `(cmd)' -> `cmd'                       */
+#define OPTIMIZE_ALL      7
+
+/* Their names, for `set optimize=...' */
+static const struct {
+    const char *name;
+    int         flag;
+} rewrites[] = {
+    { "catfile",  OPTIMIZE_CATFILE  },
+    { "catpipe",  OPTIMIZE_CATPIPE  },
+    { "subshell", OPTIMIZE_SUBSHELL }
+};
+
+#define REWRITE_COUNT ((int) (sizeof rewrites / sizeof rewrites[0]))
+
+/* Enabled rewrites */
+static int enabled = OPTIMIZE_ALL;
+
+/* Where applied rewrites are traced (NULL: nowhere) */
+static FILE *trace;
+
+
+/*****************************************************************************
+ *
+ * Word Checks
+ *
+ */
+
+/*
+ * Tell whether a word is expanded to itself (no quoting, parameter,
+ * command substitution, tilde or pattern)
+ */
+static int optimize_literal(const char *word)
+{
+    for (; *word != '\0'; word++)
+	if ((unsigned char) *word < ' ' || strchr("$`*?[]{}~\\\"'", *word))
+	    return 0;
+    return 1;
+}
+
+/*
+ * Tell whether a stage is a bare `cat' with the given number of arguments
+ * and no redirections
+ */
+static int optimize_cat(redirected_t *redirected, int args)
+{
+    words_t *word; /* Current word */
+
+    if (redirected->redirection != NULL ||
+	redirected->simple->type != SIMPLE ||
+	(word = redirected->simple->u.words) == NULL ||
+	strcmp(word->word, "cat") || internal_flags("cat") != -1)
+	return 0;
+
+    for (word = word->next; word != NULL; word = word->next, args--)
+	if (args == 0 || !optimize_literal(word->word) ||
+	    word->word[0] == '-' || word->word[0] == '\0')
+	    return 0;
+    return args == 0;
+}
+
+/*
+ * Tell whether a stage redirects its standard input
+ */
+static int optimize_has_input(redirected_t *redirected)
+{
+    redirection_t *redir; /* Current redirection */
+
+    for (redir = redirected->redirection; redir; redir = redir->next)
+	if (redir->type == RFILE ? redir->u.redir_file->desc == 0 :
+	    redir->u.redir_desc->src == 0 || redir->u.redir_desc->dst == 0)
+	    return 1;
+    return 0;
+}
+
+/*
+ * Tell whether running a stage outside of a subshell leaves the shell
+ * state alone: its words and redirections must not be expanded either, as
+ * `${v:=d}' or `$(cmd)' would then act on the shell itself
+ */
+static int optimize_stateless(redirected_t *redirected)
+{
+    words_t       *word;  /* Current word           */
+    redirection_t *redir; /* Current redirection    */
+    int            flags; /* Internal command flags */
+
+    if (redirected->simple->type == SUBSHELL)
+	return 1;
+    if ((word = redirected->simple->u.words) == NULL ||
+	var_assignment(word->word) ||
+	((flags = internal_flags(word->word)) != -1 &&
+	 !(flags & INTERNAL_PURE)))
+	return 0;
+
+    for (; word != NULL; word = word->next)
+	if (!optimize_literal(word->word))
+	    return 0;
+    for (redir = redirected->redirection; redir; redir = redir->next)
+	if (redir->type == RFILE &&
+	    (redir->u.redir_file->type == HEREDOC ||
+	     redir->u.redir_file->type == HEREDOCTAB ||
+	     !optimize_literal(redir->u.redir_file->file)))
+	    return 0;
+    return 1;
+}
+
+
+/*****************************************************************************
+ *
+ * Rewrites
+ *
+ */
+
+/*
+ * Free a stage made of a simple command without redirections, keeping its
+ * words from the `keep'th one (none if negative)
+ */
+static void optimize_free_stage(pipeline_t *stage, int keep)
+{
+    words_t *word, *next; /* Current and next words */
+    int      i = 0;       /* Word number            */
+
+    for (word = stage->redirected->simple->u.words; word; word = next, i++) {
+	next = word->next;
+	if (keep < 0 || i < keep)
+	    free(word->word);
+	free(word);
+    }
+    free(stage->redirected->simple);
+    free(stage->redirected);
+    free(stage);
+}
+
+/*
+ * `(cmd)' -> `cmd', for a subshell without redirections made of a single
+ * command which leaves the shell state alone
+ */
+static void optimize_subshell(pipeline_t *stage)
+{
+    redirected_t *outer = stage->redirected;    /* Subshell stage  */
+    command_t    *command;                      /* Subshell        */
+    pipeline_t   *inner;                        /* Its only stage  */
+
+    while (outer->simple->type == SUBSHELL && outer->redirection == NULL) {
+	command = outer->simple->u.command;
+	if (command->sequence->next != NULL ||
+	    command->sequence->seq_op != SEQ ||
+	    command->sequence->conditional->next != NULL ||
+	    (inner = command->sequence->conditional->pipeline)->next != NULL ||
+	    !optimize_stateless(inner->redirected))
+	    return;
+
+	/* Take the command out of the subshell */
+	stage->redirected = inner->redirected;
+	free(command->sequence->conditional);
+	free(command->sequence);
+	free(command);
+	free(inner);
+	free(outer->simple);
+	free(outer);
+	outer = stage->redirected;
+	if (trace != NULL)
+	    fputs("optimize: subshell: (cmd) -> cmd\n", trace);
+    }
+}
+
+/*
+ * Rewrite a pipeline; return its new first stage
+ */
+static pipeline_t *optimize_pipeline(pipeline_t *pipeline)
+{
+    pipeline_t    *stage, *next; /* Current and next stages */
+    redirection_t *redir;        /* Input redirection       */
+    words_t       *file;         /* `cat' argument          */
+    int            i;            /* Stage number            */
+
+    /* Subshells first, which may be made of the commands rewritten next */
+    for (stage = pipeline; stage; stage = stage->next) {
+	if (stage->redirected->simple->type == SUBSHELL)
+	    optimize_command(stage->redirected->simple->u.command, trace);
+	if (enabled & OPTIMIZE_SUBSHELL)
+	    optimize_subshell(stage);
+    }
+
+    /* `a | cat | b' -> `a | b': between two stages, `cat' copies a pipe to
+       another one */
+    if (enabled & OPTIMIZE_CATPIPE) {
+	for (stage = pipeline, i = 1; (next = stage->next) != NULL; i++)
+	    if (next->next != NULL && optimize_cat(next->redirected, 0)) {
+		stage->next = next->next;
+		optimize_free_stage(next, -1);
+		if (trace != NULL)
+		    fprintf(trace, "optimize: catpipe: stage %d dropped\n",
+			    i + 1);
+	    } else
+		stage = next;
+    }
+
+    /* `cat FILE | cmd' -> `cmd < FILE', a file which cannot be read being
+       reported as cat would (see exec_redirected()) */
+    if ((enabled & OPTIMIZE_CATFILE) && (next = pipeline->next) != NULL &&
+	optimize_cat(pipeline->redirected, 1) &&
+	!optimize_has_input(next->redirected)) {
+	file = pipeline->redirected->simple->u.words->next;
+	if ((redir = malloc(sizeof (redirection_t))) == NULL ||
+	    (redir->u.redir_file = malloc(sizeof (redir_file_t))) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+	redir->type = RFILE;
+	redir->u.redir_file->type = CATIN;
+	redir->u.redir_file->desc = 0;
+	redir->u.redir_file->file = file->word;
+	redir->u.redir_file->document = NULL;
+	redir->next = next->redirected->redirection;
+	next->redirected->redirection = redir;
+	if (trace != NULL)
+	    fprintf(trace, "optimize: catfile: cat %s | cmd -> cmd < %s\n",
+		    file->word, file->word);
+	optimize_free_stage(pipeline, 1);
+	pipeline = next;
+    }
+
+    return pipeline;
+}
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Rewrite a parsed command to launch fewer processes, tracing the applied
+ * rewrites to `file' if not NULL
+ */
+void optimize_command(command_t *command, FILE *file)
+{
+    sequence_t    *sequence;    /* Current sequence    */
+    conditional_t *conditional; /* Current conditional */
+
+    if (enabled == 0)
+	return;
+    trace = file;
+    for (sequence = command->sequence; sequence; sequence = sequence->next)
+	for (conditional = sequence->conditional; conditional;
+	     conditional = conditional->next)
+	    conditional->pipeline = optimize_pipeline(conditional->pipeline);
+}
+
+/*
+ * Enable rewrites given as `optimize=catfile,subshell' (or `all', or
+ * `none'), or print them given as `optimize'; return 0 on success, 1 on
+ * error, or -1 if it is not an optimizer setting
+ */
+int optimize_set(const char *setting)
+{
+    const char *name; /* Current rewrite name */
+    size_t      len;  /* Its length           */
+    int         flags = 0, i;
+
+    if (strncmp(setting, "optimize", 8) ||
+	(setting[8] != '\0' && setting[8] != '='))
+	return -1;
+
+    if (setting[8] == '\0') {
+	fputs("optimize=", stdout);
+	for (i = 0; i < REWRITE_COUNT; i++)
+	    if (enabled & rewrites[i].flag)
+		printf("%s%s", (enabled & ((1 << i) - 1)) ? "," : "",
+		       rewrites[i].name);
+	puts(enabled == 0 ? "none" : "");
+	return 0;
+    }
+
+    for (name = setting + 9; *name != '\0'; name += len + (name[len] == ',')) {
+	len = strcspn(name, ",");
+	if (len == 3 && !strncmp(name, "all", 3))
+	    flags |= OPTIMIZE_ALL;
+	else if (len != 4 || strncmp(name, "none", 4)) {
+	    for (i = 0; i < REWRITE_COUNT; i++)
+		if (strlen(rewrites[i].name) == len &&
+		    !strncmp(name, rewrites[i].name, len))
+		    break;
+	    if (i == REWRITE_COUNT) {
+		fprintf(stderr, "%s: set: %.*s: unknown rewrite\n", exe_name,
+			(int) len, name);
+		return 1;
+	    }
+	    flags |= rewrites[i].flag;
+	}
+    }
+    enabled = flags;
+    return 0;
+}
+
+/* End of file */
@@ -0,0 +1,643 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/pathglob.c
+ *
+ * Description: Pathname Expansion
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#define _GNU_SOURCE /* For syscall() and DT_* */
+
+/* Standard C headers */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free(), qsort() */
+#include <string.h> /* strlen(), strcmp(), memcmp(), memcpy()     */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/stat.h> /* stat(), lstat()                        */
+#include <fcntl.h>    /* open()                                 */
+#include <unistd.h>   /* close()                                */
+#include <dirent.h>   /* opendir(), readdir(), closedir(), DT_* */
+#ifdef __linux__
+# include <sys/syscall.h> /* syscall(), SYS_getdents64 */
+#endif
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "pathglob.h"
+
+
+/*****************************************************************************
+ *
+ * Data Types and Variables
+ *
+ */
+
+/* Compiled pattern operation */
+struct glob_op {
+    enum { OP_CHAR, OP_ANY, OP_STAR, OP_CLASS } type;
+    unsigned char chr;       /* OP_CHAR: character          */
+    unsigned char class[32]; /* OP_CLASS: bitmap of members */
+};
+
+/* Compiled pathname component */
+struct glob_segment {
+    enum { SEG_LITERAL, SEG_MATCH, SEG_RECURSE } type;
+    const char     *name;     /* SEG_LITERAL: unescaped name        */
+    size_t          len;      /* Its length                         */
+    struct glob_op *ops;      /* SEG_MATCH: operations              */
+    size_t          first;    /* Index of the first one             */
+    size_t          op_count; /* Operation count                    */
+    size_t          min_len;  /* Minimum length of a matching name  */
+    const char     *suffix;   /* Literal suffix after the last star */
+    size_t          suffix_len;
+    int             dot;      /* Matches names starting with a dot  */
+};
+
+/* Compiled pattern */
+static struct glob_segment *segments = NULL;
+static size_t               segment_count = 0, segment_size = 0;
+static struct glob_op      *ops = NULL;
+static size_t               op_count = 0, op_size = 0;
+static char                *literals = NULL; /* Unescaped names */
+static int                  want_dir;        /* Trailing slash  */
+
+/* Path being walked */
+static char  *path = NULL;
+static size_t path_size = 0;
+
+/* Matched paths, packed in an arena and sorted through their offsets */
+static char   *results = NULL;
+static size_t  results_len = 0, results_size = 0;
+static size_t *matches = NULL;
+static size_t  match_count = 0, match_size = 0;
+
+/* Directory read buffer */
+static char dir_buffer[32768];
+
+/* Directory entry types */
+#define ENT_UNKNOWN 0
+#define ENT_DIR     1
+#define ENT_LINK    2
+#define ENT_OTHER   3
+
+/* Directory entry callback */
+typedef void (*entry_func)(const char *name, size_t len, int type,
+			   void *data);
+
+/* Set of subdirectories to walk after reading a directory */
+struct subdirs {
+    char   *names; /* Names, separated by '\0' */
+    size_t  len, size;
+    int     seg;   /* Segment of their entries */
+};
+
+
+/*****************************************************************************
+ *
+ * Memory Helpers
+ *
+ */
+
+/*
+ * Grow `*buffer' (of `*size' elements of `elem' bytes) to hold `need' ones
+ */
+static void *glob_grow(void *buffer, size_t *size, size_t need, size_t elem)
+{
+    size_t new_size; /* New element count */
+
+    if (need <= *size)
+	return buffer;
+    for (new_size = *size ? *size : 64; new_size < need; new_size *= 2)
+	;
+    if ((buffer = realloc(buffer, new_size * elem)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    *size = new_size;
+    return buffer;
+}
+
+/*
+ * Record the matched path made of `path' and `len' characters of `name'
+ */
+static void glob_record(size_t path_len, const char *name, size_t len)
+{
+    size_t total = path_len + len + (want_dir ? 1 : 0); /* Path length */
+
+    results = glob_grow(results, &results_size, results_len + total + 1, 1);
+    matches = glob_grow(matches, &match_size, match_count + 1,
+			sizeof *matches);
+    matches[match_count++] = results_len;
+    memcpy(results + results_len, path, path_len);
+    memcpy(results + results_len + path_len, name, len);
+    results_len += path_len + len;
+    if (want_dir)
+	results[results_len++] = '/';
+    results[results_len++] = '\0';
+}
+
+
+/*****************************************************************************
+ *
+ * Pattern Compilation and Matching
+ *
+ */
+
+/*
+ * Compile a bracket expression starting at `pattern' (after `['), return
+ * its end or NULL if it is not closed
+ */
+static const char *glob_class(const char *pattern, struct glob_op *op)
+{
+    int           negate = 0; /* Complemented class      */
+    unsigned char first, last; /* Range                  */
+    int           i;          /* Counter                 */
+
+    memset(op->class, 0, sizeof op->class);
+    if (*pattern == '!' || *pattern == '^') {
+	negate = 1;
+	pattern++;
+    }
+
+    /* A leading `]' is a member */
+    do {
+	if (*pattern == '\\' && pattern[1] != '\0')
+	    pattern++;
+	if (*pattern == '\0' || *pattern == '/')
+	    return NULL;
+	first = last = (unsigned char) *pattern++;
+	if (*pattern == '-' && pattern[1] != ']' && pattern[1] != '\0') {
+	    if (*++pattern == '\\' && pattern[1] != '\0')
+		pattern++;
+	    last = (unsigned char) *pattern++;
+	}
+	for (i = first; i <= last; i++)
+	    op->class[i / 8] |= 1 << i % 8;
+    } while (*pattern != ']');
+
+    if (negate)
+	for (i = 0; i < 32; i++)
+	    op->class[i] = ~op->class[i];
+    op->class[0] &= ~1;
+    op->type = OP_CLASS;
+    return pattern + 1;
+}
+
+/*
+ * Compile the `len' characters of a pathname component into `seg'
+ */
+static void glob_compile_segment(const char *pattern, size_t len,
+				 struct glob_segment *seg, char *literal)
+{
+    const char     *end = pattern + len; /* End of component */
+    const char     *next;                /* After a class    */
+    struct glob_op  op;                  /* Compiled op      */
+    size_t          first = op_count;    /* First op         */
+    size_t          lit_len = 0;         /* Literal length   */
+    int             magic = 0;           /* Has wildcards    */
+    size_t          i;                   /* Counter          */
+
+    if (len == 2 && pattern[0] == '*' && pattern[1] == '*') {
+	seg->type = SEG_RECURSE;
+	return;
+    }
+
+    while (pattern < end) {
+	switch (*pattern) {
+	case '*':
+	    op.type = OP_STAR;
+	    magic = 1;
+	    pattern++;
+	    break;
+	case '?':
+	    op.type = OP_ANY;
+	    magic = 1;
+	    pattern++;
+	    break;
+	case '[':
+	    /* A bracket expression, or a literal `[' if it is not closed */
+	    if ((next = glob_class(pattern + 1, &op)) != NULL && next <= end) {
+		magic = 1;
+		pattern = next;
+		break;
+	    }
+	    /* Fall through */
+	default:
+	    if (*pattern == '\\' && pattern + 1 < end)
+		pattern++;
+	    op.type = OP_CHAR;
+	    op.chr = (unsigned char) *pattern++;
+	    literal[lit_len++] = (char) op.chr;
+	}
+
+	/* Successive stars are the same as one */
+	if (op.type == OP_STAR && op_count > first &&
+	    ops[op_count - 1].type == OP_STAR)
+	    continue;
+	ops = glob_grow(ops, &op_size, op_count + 1, sizeof *ops);
+	ops[op_count++] = op;
+    }
+    literal[lit_len] = '\0';
+
+    /* A component without wildcards is simply appended to the path */
+    if (!magic) {
+	op_count = first;
+	seg->type = SEG_LITERAL;
+	seg->name = literal;
+	seg->len = lit_len;
+	return;
+    }
+
+    /* Keep the operations as an index until the compilation is over (the
+       array may move), and the data used to reject names quickly */
+    seg->type = SEG_MATCH;
+    seg->first = first;
+    seg->op_count = op_count - first;
+    seg->min_len = 0;
+    for (i = first; i < op_count; i++)
+	if (ops[i].type != OP_STAR)
+	    seg->min_len++;
+    for (i = op_count; i > first && ops[i - 1].type == OP_CHAR; i--)
+	;
+    seg->suffix_len = i > first ? op_count - i : 0;
+    seg->suffix = literal + lit_len - seg->suffix_len;
+    seg->dot = ops[first].type == OP_CHAR && ops[first].chr == '.';
+}
+
+/*
+ * Compile a pattern into pathname components
+ */
+static void glob_compile(const char *pattern)
+{
+    const char *slash;   /* End of component        */
+    char       *literal; /* Current unescaped name  */
+    size_t      i;       /* Counter                 */
+
+    segment_count = op_count = 0;
+    free(literals);
+    if ((literal = literals = malloc(strlen(pattern) * 2 + 2)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+
+    want_dir = 0;
+    for (;;) {
+	while (*pattern == '/')
+	    pattern++;
+	if (*pattern == '\0')
+	    break;
+	for (slash = pattern; *slash != '\0' && *slash != '/'; slash++)
+	    if (*slash == '\\' && slash[1] != '\0')
+		slash++;
+	segments = glob_grow(segments, &segment_size, segment_count + 1,
+			     sizeof *segments);
+	glob_compile_segment(pattern, slash - pattern,
+			     &segments[segment_count++], literal);
+	literal += slash - pattern + 1;
+	want_dir = *slash == '/';
+	pattern = slash;
+    }
+
+    /* Operations do not move anymore */
+    for (i = 0; i < segment_count; i++)
+	if (segments[i].type == SEG_MATCH)
+	    segments[i].ops = ops + segments[i].first;
+}
+
+/*
+ * Match a name against the operations of a component, backtracking to the
+ * last star only
+ */
+static int glob_match(const struct glob_segment *seg, const char *name,
+		      size_t len)
+{
+    const struct glob_op *op = seg->ops, *end = op + seg->op_count;
+    const struct glob_op *star_op = NULL;  /* After the last star */
+    const char           *star_name = NULL;
+    const char           *name_end = name + len;
+    unsigned char         chr;
+
+    /* Fast rejections */
+    if (len < seg->min_len || (*name == '.' && !seg->dot) ||
+	memcmp(name_end - seg->suffix_len, seg->suffix, seg->suffix_len))
+	return 0;
+
+    while (name < name_end) {
+	chr = (unsigned char) *name;
+	if (op < end)
+	    switch (op->type) {
+	    case OP_STAR:
+		star_op = ++op;
+		star_name = name;
+		continue;
+	    case OP_ANY:
+		op++;
+		name++;
+		continue;
+	    case OP_CHAR:
+		if (op->chr == chr) {
+		    op++;
+		    name++;
+		    continue;
+		}
+		break;
+	    case OP_CLASS:
+		if (op->class[chr / 8] & 1 << chr % 8) {
+		    op++;
+		    name++;
+		    continue;
+		}
+	    }
+	if (star_op == NULL)
+	    return 0;
+	op = star_op;
+	name = ++star_name;
+    }
+
+    while (op < end && op->type == OP_STAR)
+	op++;
+    return op == end;
+}
+
+
+/*****************************************************************************
+ *
+ * Directory Walking
+ *
+ */
+
+/*
+ * Call `entry' for every entry of the directory `dir' but `.' and `..'
+ * Entries are read in large batches with getdents64() on Linux, so that a
+ * huge directory costs a few system calls, and have their type when the
+ * file system provides it.
+ */
+static void glob_read_dir(const char *dir, entry_func entry, void *data)
+{
+#ifdef __linux__
+    int             fd;     /* Directory descriptor */
+    long            n, pos; /* Batch size, position */
+    unsigned short  reclen; /* Record length        */
+    const char     *name;   /* Entry name           */
+    int             type;   /* Entry type           */
+
+    if ((fd = open(dir, O_RDONLY | O_DIRECTORY)) == -1)
+	return;
+
+    /* Records are: 64-bit inode, 64-bit offset, 16-bit length, 8-bit type,
+       then the name */
+    while ((n = syscall(SYS_getdents64, fd, dir_buffer, sizeof dir_buffer))
+	   > 0)
+	for (pos = 0; pos < n; pos += reclen) {
+	    memcpy(&reclen, dir_buffer + pos + 16, sizeof reclen);
+	    name = dir_buffer + pos + 19;
+	    if (name[0] == '.' && (name[1] == '\0' ||
+				   (name[1] == '.' && name[2] == '\0')))
+		continue;
+	    switch (dir_buffer[pos + 18]) {
+	    case DT_DIR:
+		type = ENT_DIR;
+		break;
+	    case DT_LNK:
+		type = ENT_LINK;
+		break;
+	    case DT_UNKNOWN:
+		type = ENT_UNKNOWN;
+		break;
+	    default:
+		type = ENT_OTHER;
+	    }
+	    entry(name, strlen(name), type, data);
+	}
+    close(fd);
+#else
+    DIR           *dirp; /* Directory stream */
+    struct dirent *ent;  /* Entry            */
+
+    (void) dir_buffer;
+    if ((dirp = opendir(dir)) == NULL)
+	return;
+    while ((ent = readdir(dirp)) != NULL)
+	if (ent->d_name[0] != '.' || (ent->d_name[1] != '\0' &&
+	    (ent->d_name[1] != '.' || ent->d_name[2] != '\0')))
+	    entry(ent->d_name, strlen(ent->d_name), ENT_UNKNOWN, data);
+    closedir(dirp);
+#endif
+}
+
+/*
+ * Check whether the entry `name' of the current path is a directory
+ * (following symbolic links if `follow' is set)
+ */
+static int glob_is_dir(size_t path_len, const char *name, size_t len,
+		       int type, int follow)
+{
+    struct stat st; /* File status */
+
+    if (type == ENT_DIR)
+	return 1;
+    if (type == ENT_OTHER || (type == ENT_LINK && !follow))
+	return 0;
+
+    path = glob_grow(path, &path_size, path_len + len + 1, 1);
+    memcpy(path + path_len, name, len);
+    path[path_len + len] = '\0';
+    if ((follow ? stat(path, &st) : lstat(path, &st)) == -1)
+	return 0;
+    return S_ISDIR(st.st_mode);
+}
+
+/* Prototype */
+static void glob_walk(size_t path_len, size_t seg);
+
+/* Current path length, shared by the entry callbacks */
+static size_t walk_len;
+
+/*
+ * Directory entry callback: record the entry or remember it for the walk
+ */
+static void glob_entry(const char *name, size_t len, int type, void *data)
+{
+    struct subdirs      *subdirs = data;               /* Remembered  */
+    struct glob_segment *seg = &segments[subdirs->seg]; /* Component   */
+    int                  last;                         /* Last one?   */
+    int                  recurse = seg->type == SEG_RECURSE;
+
+    last = (size_t) subdirs->seg + 1 == segment_count;
+    if (recurse) {
+	/* Hidden entries are skipped by `**' */
+	if (*name == '.')
+	    return;
+	if (last && (!want_dir || glob_is_dir(walk_len, name, len, type, 1)))
+	    glob_record(walk_len, name, len);
+	if (!glob_is_dir(walk_len, name, len, type, 0))
+	    return;
+    } else {
+	if (!glob_match(seg, name, len))
+	    return;
+	if (last) {
+	    if (!want_dir || glob_is_dir(walk_len, name, len, type, 1))
+		glob_record(walk_len, name, len);
+	    return;
+	}
+	if (!glob_is_dir(walk_len, name, len, type, 1))
+	    return;
+    }
+
+    /* Walk it once the directory is read */
+    subdirs->names = glob_grow(subdirs->names, &subdirs->size,
+			       subdirs->len + len + 1, 1);
+    memcpy(subdirs->names + subdirs->len, name, len + 1);
+    subdirs->len += len + 1;
+}
+
+/*
+ * Walk the directory `path' (of `path_len' characters, with a trailing
+ * slash unless empty) to match component `seg' and the following ones
+ */
+static void glob_walk(size_t path_len, size_t seg)
+{
+    struct glob_segment *cur = &segments[seg]; /* Component         */
+    struct subdirs       subdirs;              /* Directories to go */
+    struct stat          st;                   /* File status       */
+    const char          *name;                 /* Subdirectory      */
+    size_t               len;                  /* Its length        */
+
+    /* A literal component is appended without reading the directory; the
+       walk stops early if it does not exist */
+    if (cur->type == SEG_LITERAL) {
+	path = glob_grow(path, &path_size, path_len + cur->len + 2, 1);
+	memcpy(path + path_len, cur->name, cur->len);
+	path_len += cur->len;
+	path[path_len] = '\0';
+	if (stat(path, &st) == -1)
+	    return;
+	if (seg + 1 == segment_count) {
+	    if (!want_dir || S_ISDIR(st.st_mode))
+		glob_record(path_len - cur->len, cur->name, cur->len);
+	} else if (S_ISDIR(st.st_mode)) {
+	    path[path_len++] = '/';
+	    glob_walk(path_len, seg + 1);
+	}
+	return;
+    }
+
+    /* `**' also matches no directory at all */
+    if (cur->type == SEG_RECURSE && seg + 1 < segment_count)
+	glob_walk(path_len, seg + 1);
+
+    /* Read the directory */
+    path = glob_grow(path, &path_size, path_len + 2, 1);
+    if (path_len == 0)
+	strcpy(path, ".");
+    else
+	path[path_len] = '\0';
+    subdirs.names = NULL;
+    subdirs.len = subdirs.size = 0;
+    subdirs.seg = (int) seg;
+    walk_len = path_len;
+    glob_read_dir(path, glob_entry, &subdirs);
+
+    /* Then walk the selected subdirectories */
+    for (name = subdirs.names; name < subdirs.names + subdirs.len;
+	 name += len + 1) {
+	len = strlen(name);
+	path = glob_grow(path, &path_size, path_len + len + 2, 1);
+	memcpy(path + path_len, name, len);
+	path[path_len + len] = '/';
+	glob_walk(path_len + len + 1,
+		  cur->type == SEG_RECURSE ? seg : seg + 1);
+    }
+    free(subdirs.names);
+}
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Compare two matched paths
+ */
+static int glob_compare(const void *a, const void *b)
+{
+    return strcmp(results + *(const size_t *) a,
+		  results + *(const size_t *) b);
+}
+
+/*
+ * Expand a pattern (where `\' quotes the next character) and call `found'
+ * for every matching path, in sorted order; return the number of matches
+ */
+int pathglob(const char *pattern, void (*found)(const char *path))
+{
+    size_t i; /* Counter */
+
+    glob_compile(pattern);
+    results_len = match_count = 0;
+
+    if (segment_count > 0) {
+	path = glob_grow(path, &path_size, 2, 1);
+	if (*pattern == '/') {
+	    path[0] = '/';
+	    glob_walk(1, 0);
+	} else
+	    glob_walk(0, 0);
+    }
+
+    qsort(matches, match_count, sizeof *matches, glob_compare);
+    for (i = 0; i < match_count; i++)
+	found(results + matches[i]);
+    return (int) match_count;
+}
+
+/*
+ * Free the memory used by pattern matching
+ */
+void pathglob_free(void)
+{
+    free(segments);
+    free(ops);
+    free(literals);
+    free(path);
+    free(results);
+    free(matches);
+    segments = NULL;
+    ops = NULL;
+    literals = NULL;
+    path = NULL;
+    results = NULL;
+    matches = NULL;
+    segment_size = op_size = path_size = results_size = match_size = 0;
+}
+
+/* End of file */
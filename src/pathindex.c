@@ -0,0 +1,413 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/pathindex.c
+ *
+ * Description: Executable Index
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#define _BSD_SOURCE /* For strdup() */
+
+/* Standard C headers */
+#include <stdio.h>  /* sprintf()                                   */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free(), qsort() */
+#include <string.h> /* strlen(), strcmp(), strncmp(), strdup(), ... */
+#include <errno.h>  /* errno                                        */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/stat.h> /* stat()                                */
+#include <dirent.h>   /* opendir(), readdir(), closedir()      */
+#include <unistd.h>   /* read(), close()                       */
+#include <fcntl.h>    /* fcntl()                               */
+#ifdef __linux__
+# include <sys/inotify.h> /* inotify_init(), inotify_add_watch() */
+#endif
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "variable.h"
+#include "pathindex.h"
+
+
+/*****************************************************************************
+ *
+ * Data Types and Variables
+ *
+ */
+
+/* Directory of $PATH, with the names of the executables it contains packed
+   in a single arena (separated by '\0') */
+struct path_dir {
+    char   *name;     /* Directory name                       */
+    int     dirty;    /* Must it be scanned again?            */
+    int     wd;       /* Inotify watch, -1 if none            */
+    time_t  mtime;    /* Modification time when scanned       */
+    char   *arena;    /* Executable names                     */
+    size_t  arena_len, arena_size;
+    size_t  count;    /* Number of executables                */
+};
+
+/* Executable, sorted by name, then by directory order in $PATH */
+struct path_entry {
+    const char *name; /* Executable name           */
+    int         dir;  /* Index of its directory    */
+};
+
+/* $PATH the index was built for, its directories */
+static char            *path = NULL;
+static struct path_dir *dirs = NULL;
+static int              dir_count = 0;
+
+/* Sorted executables of every directory */
+static struct path_entry *entries = NULL;
+static size_t             entry_count = 0;
+static int                stale = 1; /* Must entries be sorted again? */
+
+/* Inotify descriptor watching directories, -1 if none */
+static int notify_fd = -1;
+
+/* Full name of the last executable found by pathindex_lookup() */
+static char  *found = NULL;
+static size_t found_size = 0;
+
+
+/*****************************************************************************
+ *
+ * Index Building
+ *
+ */
+
+/*
+ * Forget every directory
+ */
+static void pathindex_clear(void)
+{
+    int i; /* Counter */
+
+    for (i = 0; i < dir_count; i++) {
+	free(dirs[i].name);
+	free(dirs[i].arena);
+    }
+    free(dirs);
+    free(entries);
+    free(path);
+    dirs = NULL;
+    entries = NULL;
+    path = NULL;
+    dir_count = 0;
+    entry_count = 0;
+    stale = 1;
+
+    if (notify_fd != -1) {
+	close(notify_fd);
+	notify_fd = -1;
+    }
+}
+
+/*
+ * Split `value' into directories to index, watching them for changes
+ */
+static void pathindex_split(const char *value)
+{
+    int         i;          /* Counter             */
+    size_t      len;        /* Directory length    */
+    const char *start, *end; /* Directory location */
+
+    if ((path = strdup(value)) == NULL ||
+	(dirs = malloc((strlen(value) + 1) * sizeof *dirs)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+
+#ifdef __linux__
+    if ((notify_fd = inotify_init()) != -1) {
+	fcntl(notify_fd, F_SETFL, O_NONBLOCK);
+	fcntl(notify_fd, F_SETFD, FD_CLOEXEC);
+    }
+#endif
+
+    /* An empty directory is the current one, which is not indexed since
+       it changes (executables are then looked up by execvp()) */
+    for (start = value; ; start = end + 1) {
+	if ((end = strchr(start, ':')) == NULL)
+	    end = start + strlen(start);
+	if ((len = end - start) > 0 && !(len == 1 && *start == '.')) {
+	    i = dir_count++;
+	    if ((dirs[i].name = malloc(len + 1)) == NULL) {
+		lish_perror("fatal error");
+		lish_exit(RET_ERROR);
+	    }
+	    memcpy(dirs[i].name, start, len);
+	    dirs[i].name[len] = '\0';
+	    dirs[i].dirty = 1;
+	    dirs[i].wd = -1;
+	    dirs[i].mtime = 0;
+	    dirs[i].arena = NULL;
+	    dirs[i].arena_len = dirs[i].arena_size = dirs[i].count = 0;
+#ifdef __linux__
+	    if (notify_fd != -1)
+		dirs[i].wd = inotify_add_watch(notify_fd, dirs[i].name,
+					       IN_CREATE | IN_DELETE |
+					       IN_MOVED_FROM | IN_MOVED_TO |
+					       IN_ATTRIB | IN_DELETE_SELF |
+					       IN_MOVE_SELF | IN_ONLYDIR);
+#endif
+	}
+	if (*end == '\0')
+	    break;
+    }
+}
+
+/*
+ * Scan a directory for executables
+ */
+static void pathindex_scan(struct path_dir *dir)
+{
+    DIR           *dirp;         /* Directory stream    */
+    struct dirent *ent;          /* Directory entry     */
+    struct stat    st;           /* File information    */
+    size_t         len;          /* Name length         */
+    char          *name = NULL;  /* Full file name      */
+    size_t         name_size = 0;
+
+    dir->dirty = 0;
+    dir->arena_len = dir->count = 0;
+    stale = 1;
+    if (stat(dir->name, &st) == -1 || (dirp = opendir(dir->name)) == NULL)
+	return;
+    dir->mtime = st.st_mtime;
+
+    while ((ent = readdir(dirp)) != NULL) {
+	if (ent->d_name[0] == '.' && (ent->d_name[1] == '\0' ||
+				      (ent->d_name[1] == '.' &&
+				       ent->d_name[2] == '\0')))
+	    continue;
+
+	/* Keep regular files (or links to them) which can be executed */
+	len = strlen(ent->d_name);
+	if (strlen(dir->name) + len + 2 > name_size) {
+	    name_size = strlen(dir->name) + len + 2;
+	    if ((name = realloc(name, name_size)) == NULL) {
+		lish_perror("fatal error");
+		lish_exit(RET_ERROR);
+	    }
+	}
+	sprintf(name, "%s/%s", dir->name, ent->d_name);
+	if (stat(name, &st) == -1 || !S_ISREG(st.st_mode) ||
+	    !(st.st_mode & (S_IXUSR | S_IXGRP | S_IXOTH)))
+	    continue;
+
+	/* Append its name */
+	if (dir->arena_len + len + 1 > dir->arena_size) {
+	    dir->arena_size = (dir->arena_len + len + 1) * 2;
+	    if ((dir->arena = realloc(dir->arena, dir->arena_size)) == NULL) {
+		lish_perror("fatal error");
+		lish_exit(RET_ERROR);
+	    }
+	}
+	memcpy(dir->arena + dir->arena_len, ent->d_name, len + 1);
+	dir->arena_len += len + 1;
+	dir->count++;
+    }
+
+    closedir(dirp);
+    free(name);
+}
+
+/*
+ * Compare executables by name, then by directory order
+ */
+static int pathindex_cmp(const void *a, const void *b)
+{
+    const struct path_entry *x = a, *y = b; /* Compared entries */
+    int                      cmp;           /* Name comparison  */
+
+    if ((cmp = strcmp(x->name, y->name)) != 0)
+	return cmp;
+    return x->dir - y->dir;
+}
+
+/*
+ * Sort the executables of every directory
+ */
+static void pathindex_sort(void)
+{
+    int         i;     /* Counter       */
+    size_t      j, n;  /* Counters      */
+    const char *name;  /* Current name  */
+
+    for (n = 0, i = 0; i < dir_count; i++)
+	n += dirs[i].count;
+    free(entries);
+    if ((entries = malloc((n + 1) * sizeof *entries)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+
+    entry_count = 0;
+    for (i = 0; i < dir_count; i++)
+	for (name = dirs[i].arena, j = 0; j < dirs[i].count; j++) {
+	    entries[entry_count].name = name;
+	    entries[entry_count++].dir = i;
+	    name += strlen(name) + 1;
+	}
+    qsort(entries, entry_count, sizeof *entries, pathindex_cmp);
+    stale = 0;
+}
+
+/*
+ * Bring the index up to date: build it for a new $PATH, and scan again
+ * directories which changed
+ */
+static void pathindex_update(void)
+{
+    int         i;     /* Counter         */
+    const char *value; /* $PATH value     */
+    struct stat st;    /* Directory information */
+#ifdef __linux__
+    union {
+	struct inotify_event event;
+	char                 buffer[4096];
+    } events;          /* Change events   */
+    const struct inotify_event *event;
+    ssize_t     len, pos;  /* Events length, position */
+#endif
+
+    if ((value = var_get("PATH")) == NULL)
+	value = "";
+    if (path == NULL || strcmp(path, value)) {
+	pathindex_clear();
+	pathindex_split(value);
+    }
+
+#ifdef __linux__
+    /* Mark directories which changed (or all if events were lost) */
+    if (notify_fd != -1)
+	while ((len = read(notify_fd, &events, sizeof events)) > 0)
+	    for (pos = 0; pos < len;
+		 pos += sizeof *event + event->len) {
+		event = (const struct inotify_event *) (events.buffer + pos);
+		for (i = 0; i < dir_count; i++)
+		    if (dirs[i].wd == event->wd ||
+			(event->mask & IN_Q_OVERFLOW))
+			dirs[i].dirty = 1;
+	    }
+#endif
+
+    /* Directories which are not watched are checked by their modification
+       time */
+    for (i = 0; i < dir_count; i++) {
+	if (!dirs[i].dirty && dirs[i].wd == -1 &&
+	    (stat(dirs[i].name, &st) == -1 ? dirs[i].mtime != 0 :
+	     st.st_mtime != dirs[i].mtime))
+	    dirs[i].dirty = 1;
+	if (dirs[i].dirty)
+	    pathindex_scan(&dirs[i]);
+    }
+
+    if (stale)
+	pathindex_sort();
+}
+
+/*
+ * Find the first executable whose name is at least `name'
+ */
+static size_t pathindex_find(const char *name)
+{
+    size_t lo = 0, hi = entry_count, mid; /* Search bounds */
+
+    while (lo < hi) {
+	mid = lo + (hi - lo) / 2;
+	if (strcmp(entries[mid].name, name) < 0)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return lo;
+}
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Find the full name of executable `name' in $PATH (valid until the next
+ * call), or return NULL if it is unknown
+ */
+const char *pathindex_lookup(const char *name)
+{
+    size_t i, len; /* Entry, name length */
+
+    pathindex_update();
+    if ((i = pathindex_find(name)) == entry_count ||
+	strcmp(entries[i].name, name))
+	return NULL;
+
+    len = strlen(dirs[entries[i].dir].name) + strlen(name) + 2;
+    if (len > found_size) {
+	if ((found = realloc(found, (found_size = len))) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+    }
+    sprintf(found, "%s/%s", dirs[entries[i].dir].name, name);
+    return found;
+}
+
+/*
+ * Call `found' for each executable of $PATH beginning by `prefix', in
+ * alphabetical order (each name once)
+ */
+void pathindex_complete(const char *prefix, void (*found)(const char *name))
+{
+    size_t i, len = strlen(prefix); /* Entry, prefix length */
+
+    pathindex_update();
+    for (i = pathindex_find(prefix); i < entry_count &&
+	     !strncmp(entries[i].name, prefix, len); i++)
+	if (i == 0 || strcmp(entries[i].name, entries[i - 1].name))
+	    found(entries[i].name);
+}
+
+/*
+ * Free the index
+ */
+void pathindex_free(void)
+{
+    pathindex_clear();
+    free(found);
+    found = NULL;
+    found_size = 0;
+}
+
+/* End of file */
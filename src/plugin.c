@@ -0,0 +1,219 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/plugin.c
+ *
+ * Description: Builtin Plugin Loading
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/* Standard C headers */
+#include <stdio.h>  /* fprintf()                           */
+#include <stdlib.h> /* NULL, malloc(), free()              */
+#include <string.h> /* strcmp(), strlen(), memcpy()        */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <dlfcn.h> /* dlopen(), dlsym(), dlclose(), dlerror() */
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "variable.h"
+#include "execcmd.h"
+#include "internal.h"
+#include "plugin.h"
+
+
+/*****************************************************************************
+ *
+ * Data Types and Variables
+ *
+ */
+
+/* Loaded shared object */
+struct plugin {
+    struct plugin *next;   /* Next loaded one */
+    char          *file;   /* File name       */
+    void          *handle; /* dlopen() handle */
+};
+
+/* Loaded shared objects */
+static struct plugin *plugins = NULL;
+
+/* Builtins requested while a plugin is initialized, and whether each was
+   registered */
+static int    wanted_count;
+static char **wanted;
+static char  *registered;
+
+
+/*****************************************************************************
+ *
+ * Services Offered to Plugins
+ *
+ */
+
+/*
+ * Register a builtin if it was requested (or if all were)
+ */
+static int api_add_builtin(const char *name, lish_builtin_t *function)
+{
+    int i; /* Counter */
+
+    if (wanted_count == 0)
+	return internal_add(name, function, 0);
+    for (i = 0; i < wanted_count; i++)
+	if (!strcmp(name, wanted[i])) {
+	    registered[i] = 1;
+	    return internal_add(name, function, 0);
+	}
+    return 0;
+}
+
+/*
+ * Set a variable
+ */
+static void api_var_set(const char *name, const char *value, int flags)
+{
+    var_set(name, value, flags & LISH_VAR_EXPORT ? VAR_EXPORT : 0);
+}
+
+/*
+ * Get the exit status of the last command
+ */
+static int api_last_status(void)
+{
+    return exec_ctx->exit_status;
+}
+
+/* Services given to plugins */
+static const struct lish_api api = {
+    LISH_API_VERSION,
+    api_add_builtin,
+    var_get,
+    api_var_set,
+    var_unset,
+    api_last_status,
+    lish_perror
+};
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Load the shared object `file' (once) and register the `count' builtins
+ * named by `names' (all of them if `count' is 0); return 0 on success
+ */
+int plugin_load(const char *file, int count, char *names[])
+{
+    struct plugin      *plugin;    /* Loaded shared object */
+    lish_plugin_init_t *init;      /* Its entry point      */
+    void               *handle;    /* dlopen() handle      */
+    int                 i, ret;    /* Counter, result      */
+
+    /* The same file is not loaded twice */
+    for (plugin = plugins; plugin != NULL; plugin = plugin->next)
+	if (!strcmp(plugin->file, file))
+	    break;
+    if (plugin != NULL)
+	handle = plugin->handle;
+    else if ((handle = dlopen(file, RTLD_NOW | RTLD_LOCAL)) == NULL) {
+	fprintf(stderr, "%s: enable: %s\n", exe_name, dlerror());
+	return 1;
+    }
+
+    /* Converting a data pointer to a function pointer is not allowed by
+       ISO C, but required by dlsym() */
+    *(void **) &init = dlsym(handle, "lish_plugin_init");
+    if (init == NULL) {
+	fprintf(stderr, "%s: enable: %s: no lish_plugin_init()\n", exe_name,
+		file);
+	if (plugin == NULL)
+	    dlclose(handle);
+	return 1;
+    }
+
+    /* Let the plugin register its builtins */
+    if ((registered = calloc(count + 1, 1)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    wanted_count = count;
+    wanted = names;
+    ret = init(&api) != 0;
+    if (ret)
+	fprintf(stderr, "%s: enable: %s: initialization failed\n", exe_name,
+		file);
+    else
+	for (i = 0; i < count; i++)
+	    if (!registered[i]) {
+		fprintf(stderr, "%s: enable: %s: not found in %s\n", exe_name,
+			names[i], file);
+		ret = 1;
+	    }
+    free(registered);
+    wanted_count = 0;
+
+    /* Remember the shared object (even if some builtins were missing, since
+       others may have been registered) */
+    if (plugin == NULL) {
+	if ((plugin = malloc(sizeof *plugin)) == NULL ||
+	    (plugin->file = malloc(strlen(file) + 1)) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+	strcpy(plugin->file, file);
+	plugin->handle = handle;
+	plugin->next = plugins;
+	plugins = plugin;
+    }
+
+    return ret;
+}
+
+/*
+ * Unload every shared object
+ */
+void plugin_free(void)
+{
+    struct plugin *plugin; /* Loaded shared object */
+
+    internal_free();
+    while ((plugin = plugins) != NULL) {
+	plugins = plugin->next;
+	dlclose(plugin->handle);
+	free(plugin->file);
+	free(plugin);
+    }
+}
+
+/* End of file */
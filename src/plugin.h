@@ -0,0 +1,90 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/plugin.h
+ *
+ * Description: Builtin Plugin Interface
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _PLUGIN_H_
+#define _PLUGIN_H_
+
+/*
+ * Interface between Lish and the shared objects loaded by `enable -f'; it
+ * only grows (new members are added at the end of struct lish_api, and
+ * LISH_API_VERSION is incremented), so that plugins keep working.
+ *
+ * A plugin exports:
+ *
+ *     int lish_plugin_init(const struct lish_api *api);
+ *
+ * which registers its builtins with api->add_builtin() and returns 0 (or
+ * nonzero to refuse to load, when api->version is too old for instance).
+ * A builtin is called with the expanded words of the command; its standard
+ * input, output and error (descriptors 0, 1 and 2, and stdin, stdout and
+ * stderr) are those of the command, redirections applied, and it returns
+ * its exit status.  It runs in the shell process: it must not exit().
+ */
+
+/* Interface version */
+#define LISH_API_VERSION 1
+
+/* Variable flags */
+#define LISH_VAR_EXPORT 1 /* Given to executed programs */
+
+/* Builtin function */
+typedef int lish_builtin_t(int argc, char *argv[]);
+
+/* Services offered to plugins */
+struct lish_api {
+    int          version;     /* LISH_API_VERSION of the shell */
+
+    /* Register builtin `name' (copied); return 0 on success */
+    int        (*add_builtin)(const char *name, lish_builtin_t *function);
+
+    /* Variables */
+    const char *(*var_get)(const char *name);
+    void       (*var_set)(const char *name, const char *value, int flags);
+    void       (*var_unset)(const char *name);
+
+    /* Exit status of the last command */
+    int        (*last_status)(void);
+
+    /* Print an error message prefixed by the shell name, like perror() */
+    void       (*perror)(const char *str);
+};
+
+/* Plugin entry point */
+typedef int lish_plugin_init_t(const struct lish_api *api);
+
+/* Prototypes (shell side) */
+int  plugin_load(const char *file, int count, char *names[]);
+void plugin_free(void);
+
+#endif /* !_PLUGIN_H_ */
+
+/* End of file */
@@ -0,0 +1,898 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/prompt.c
+ *
+ * Description: Prompt Display
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#define _BSD_SOURCE            /* For gethostname()               */
+#define _POSIX_C_SOURCE 200112 /* For gethostname() under FreeBSD */
+
+/* Standard C headers */
+#include <limits.h> /* HOST_NAME_MAX, PATH_MAX                          */
+#include <stdio.h>  /* stdout, fputs(), fflush(), sprintf()               */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free(), getloadavg()  */
+#include <string.h> /* strlen(), strcmp(), strchr(), strdup(), memcpy() */
+#include <errno.h>  /* errno                                            */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/time.h> /* gettimeofday(), setitimer()                   */
+#include <sys/stat.h> /* stat()                                        */
+#include <sys/wait.h> /* waitpid()                                     */
+#include <sys/uio.h>  /* writev()                                      */
+#include <sys/select.h> /* select()                                    */
+#include <unistd.h>   /* getuid(), geteuid(), gethostname(), write()   */
+#include <fcntl.h>    /* open(), fcntl()                               */
+#include <signal.h>   /* sigprocmask()                                 */
+#include <pwd.h>      /* struct passwd, getpwuid()                     */
+
+/* Project headers */
+#include <common.h>
+#include "version.h"
+#include "shell.h"
+#include "execcmd.h"
+#include "history.h"
+#include "variable.h"
+#include "metrics.h"
+#include "prompt.h"
+
+#ifndef HOST_NAME_MAX
+# define HOST_NAME_MAX 255
+#endif /* !HOST_NAME_MAX */
+#ifndef PATH_MAX
+# define PATH_MAX 4096
+#endif /* !PATH_MAX */
+
+
+/*****************************************************************************
+ *
+ * Constants and Variables
+ *
+ */
+
+/* Segment types: literal text, or information which may change */
+#define SEG_TEXT       0 /* Literal text (escapes already replaced) */
+#define SEG_HOST       1 /* \H: full hostname                       */
+#define SEG_HOST_SHORT 2 /* \h: hostname up to the first `.'        */
+#define SEG_CWD        3 /* \w: home-relative working directory     */
+#define SEG_CWD_NAME   4 /* \W: name of the working directory       */
+#define SEG_STATUS     5 /* \?: exit status of the last command     */
+#define SEG_JOBS       6 /* \j: number of background jobs           */
+#define SEG_BRANCH     7 /* \g: VCS branch of the working directory */
+#define SEG_LOAD       8 /* \L: load average                        */
+
+/* Asynchronous information, computed by background workers */
+#define ASYNC_BRANCH 0 /* VCS branch   */
+#define ASYNC_LOAD   1 /* Load average */
+#define ASYNC_COUNT  2
+
+/* Maximum length of asynchronous information, number of cached values */
+#define VALUE_MAX  64
+#define CACHE_SIZE 16
+
+/* Prompt segment: type, and text location for literals */
+struct prompt_segment {
+    int    type;   /* Segment type (see above)        */
+    size_t offset; /* Offset of the text in `literals' */
+    size_t len;    /* Length of the text              */
+};
+
+/* Prototypes */
+static void prompt_branch(char *value);
+static void prompt_load(char *value);
+
+/* Asynchronous information: worker deadline, time before computing it
+   again, whether it depends on the working directory, computing function */
+static const struct prompt_async {
+    long deadline;              /* Worker deadline, in ms       */
+    long max_age;               /* Refresh delay, in ms         */
+    int  by_cwd;                /* Cached by working directory? */
+    void (*compute)(char *value);
+} asyncs[ASYNC_COUNT] = {
+    { 200, 1000, 1, prompt_branch },
+    { 100, 2000, 0, prompt_load   }
+};
+
+/* Cached asynchronous information */
+static struct prompt_cache {
+    int            type;             /* Information type (ASYNC_*) */
+    char          *key;              /* Working directory, or ""   */
+    struct timeval time;             /* When it was computed       */
+    char           value[VALUE_MAX]; /* Computed value             */
+} cache[CACHE_SIZE];
+static int cache_next = 0;
+
+/* Running workers, by information type */
+static struct prompt_worker {
+    int            fd;               /* Result pipe, -1 if none    */
+    char          *key;              /* Key of the computed value  */
+    struct timeval deadline;         /* When to give up            */
+    size_t         len;              /* Length of the value read   */
+    char           value[VALUE_MAX]; /* Value being read           */
+} workers[ASYNC_COUNT] = { { -1, NULL, { 0, 0 }, 0, "" },
+			   { -1, NULL, { 0, 0 }, 0, "" } };
+
+/* Default prompt */
+static const char default_prompt[] = "\\s\\$ ";
+
+/* Compiled prompt: source $PS1, segment program and literal texts */
+static char                  *source = NULL;
+static struct prompt_segment *program = NULL;
+static size_t                 seg_count = 0;
+static char                  *literals = NULL;
+static int                    dynamic = 0; /* Rendered at each prompt? */
+
+/* Cached information used by segments */
+static char hostname[HOST_NAME_MAX + 1];
+static int  host_len = 0, host_short_len = 0;
+static const char *home = NULL;
+static size_t home_len = 0;
+
+/* Rendered prompt */
+static char  *rendered = NULL;
+static size_t rendered_len = 0, rendered_size = 0;
+static int    rendered_lines = 0; /* Line breaks in the displayed one */
+static int    rendered_width = 0; /* Columns of its last line         */
+
+/* Information to get again before the next prompt */
+static int stale = PROMPT_CWD | PROMPT_ENV;
+
+/* No prompt is displayed when commands are not typed (`-c', server) */
+static int disabled = 0;
+
+
+/*****************************************************************************
+ *
+ * Prompt Compilation
+ *
+ */
+
+/*
+ * Add a segment to the program, merging literal text with a previous one
+ */
+static void prompt_segment(int type, size_t offset, size_t len)
+{
+    struct prompt_segment *seg; /* Added segment */
+
+    if (type == SEG_TEXT) {
+	if (len == 0)
+	    return;
+	if (seg_count > 0 && program[seg_count - 1].type == SEG_TEXT) {
+	    program[seg_count - 1].len += len;
+	    return;
+	}
+    }
+
+    seg = &program[seg_count++];
+    seg->type = type;
+    seg->offset = offset;
+    seg->len = len;
+}
+
+/*
+ * Compile `prompt' into a segment program: escapes whose value cannot change
+ * are replaced by their text once and for all
+ */
+static void prompt_compile(const char *prompt)
+{
+    size_t         i, pos, len;  /* Counters, literal position/length */
+    char           chr;          /* Current character                 */
+    const char    *text;         /* Text of a constant escape         */
+    struct passwd *user;         /* User information                  */
+    char           uid_str[24];  /* User ID, if no name is known      */
+
+    /* Constant information */
+    static const char dollar[] = "$", hash[] = "#", backslash[] = "\\";
+    static const char escape[] = "\033", newline[] = "\n";
+
+    /* Room for every possible segment and literal text */
+    free(source);
+    free(program);
+    free(literals);
+    user = getpwuid(getuid());
+    sprintf(uid_str, "%d", (int) getuid());
+    len = strlen(prompt);
+    if ((source = malloc(len + 1)) == NULL ||
+	(program = malloc((len + 1) * sizeof *program)) == NULL ||
+	(literals = malloc(len * (strlen(lish_version) + strlen(exe_name) +
+				  (user ? strlen(user->pw_name) : 0) +
+				  sizeof uid_str) + 1)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    strcpy(source, prompt);
+    seg_count = 0;
+    dynamic = 0;
+
+    /* Replace escape sequences */
+    for (i = pos = 0; (chr = prompt[i]) != '\0'; i++) {
+	text = NULL;
+	if (chr != '\\')
+	    literals[pos] = chr, len = 1;
+	else
+	    switch ((chr = prompt[++i])) {
+	    case '$':
+		text = geteuid() != 0 ? dollar : hash;
+		break;
+
+	    case 'H':
+		prompt_segment(SEG_HOST, 0, 0);
+		continue;
+
+	    case 'W':
+		prompt_segment(SEG_CWD_NAME, 0, 0);
+		continue;
+
+	    case '\\':
+		text = backslash;
+		break;
+
+	    case '[':
+	    case ']':
+		continue;
+
+	    case 'e':
+		text = escape;
+		break;
+
+	    case 'h':
+		prompt_segment(SEG_HOST_SHORT, 0, 0);
+		continue;
+
+	    case 'n':
+		text = newline;
+		break;
+
+	    case 's':
+		text = exe_name;
+		break;
+
+	    case 'u':
+		text = user ? user->pw_name : uid_str;
+		break;
+
+	    case 'v':
+	    case 'V':
+		text = lish_version;
+		break;
+
+	    case 'w':
+		prompt_segment(SEG_CWD, 0, 0);
+		continue;
+
+	    case '?':
+		prompt_segment(SEG_STATUS, 0, 0);
+		dynamic = 1;
+		continue;
+
+	    case 'j':
+		prompt_segment(SEG_JOBS, 0, 0);
+		dynamic = 1;
+		continue;
+
+	    case 'g':
+		prompt_segment(SEG_BRANCH, 0, 0);
+		dynamic = 1;
+		continue;
+
+	    case 'L':
+		prompt_segment(SEG_LOAD, 0, 0);
+		dynamic = 1;
+		continue;
+
+	    default:
+		literals[pos] = '\\';
+		len = 1;
+		if (chr != '\0')
+		    literals[pos + len++] = chr;
+		else
+		    i--;
+	    }
+
+	if (text != NULL)
+	    memcpy(literals + pos, text, (len = strlen(text)));
+	prompt_segment(SEG_TEXT, pos, len);
+	pos += len;
+    }
+}
+
+
+/*****************************************************************************
+ *
+ * Asynchronous Information
+ *
+ */
+
+/*
+ * Read a small file into `buffer' without its trailing line break; return
+ * its length, or -1 on error
+ */
+static int prompt_read_file(const char *name, char *buffer, size_t size)
+{
+    int fd, len; /* File descriptor, length read */
+
+    if ((fd = open(name, O_RDONLY)) == -1)
+	return -1;
+    len = read(fd, buffer, size - 1);
+    close(fd);
+    if (len < 0)
+	return -1;
+    while (len > 0 && (buffer[len - 1] == '\n' || buffer[len - 1] == '\r'))
+	len--;
+    buffer[len] = '\0';
+    return len;
+}
+
+/*
+ * Worker: find the VCS branch of the working directory (git or Mercurial)
+ */
+static void prompt_branch(char *value)
+{
+    struct stat st;                /* File information      */
+    char       *slash, *git;       /* Last `/', git dir.    */
+    char        dir[PATH_MAX], name[2 * PATH_MAX + 16], head[PATH_MAX];
+
+    if (strlen(cwd) >= sizeof dir)
+	return;
+    strcpy(dir, cwd);
+
+    /* Look for a repository in each parent directory */
+    for (;;) {
+	sprintf(name, "%s/.git", dir);
+	if (stat(name, &st) == 0) {
+	    /* Linked work trees have a `.git' file naming the repository */
+	    if (S_ISREG(st.st_mode)) {
+		if (prompt_read_file(name, head, sizeof head) <= 8 ||
+		    strncmp(head, "gitdir: ", 8))
+		    return;
+		git = head + 8;
+		if (*git != '/')
+		    sprintf(name, "%s/%s", dir, git);
+		else
+		    strcpy(name, git);
+	    }
+	    strcat(name, "/HEAD");
+	    if (prompt_read_file(name, head, sizeof head) <= 0)
+		return;
+
+	    /* Branch name, or abbreviated commit if detached */
+	    if (!strncmp(head, "ref: refs/heads/", 16))
+		sprintf(value, "%.*s", VALUE_MAX - 2, head + 16);
+	    else if (!strncmp(head, "ref: ", 5))
+		sprintf(value, "%.*s", VALUE_MAX - 2, head + 5);
+	    else
+		sprintf(value, "%.7s", head);
+	    return;
+	}
+
+	sprintf(name, "%s/.hg", dir);
+	if (stat(name, &st) == 0) {
+	    strcat(name, "/branch");
+	    if (prompt_read_file(name, head, sizeof head) <= 0)
+		strcpy(head, "default");
+	    sprintf(value, "%.*s", VALUE_MAX - 2, head);
+	    return;
+	}
+
+	/* Go to the parent directory */
+	if ((slash = strrchr(dir, '/')) == NULL || dir[1] == '\0')
+	    return;
+	slash[slash == dir ? 1 : 0] = '\0';
+    }
+}
+
+/*
+ * Worker: get the load average of the last minute
+ */
+static void prompt_load(char *value)
+{
+    double load[1]; /* Load average */
+
+    if (getloadavg(load, 1) == 1)
+	sprintf(value, "%.2f", load[0]);
+}
+
+/*
+ * Get the time in milliseconds from `from' to `to'
+ */
+static long prompt_elapsed(const struct timeval *from,
+			   const struct timeval *to)
+{
+    return (to->tv_sec - from->tv_sec) * 1000L +
+	(to->tv_usec - from->tv_usec) / 1000;
+}
+
+/*
+ * Get the cached value of information `type', or NULL if unknown
+ */
+static struct prompt_cache *prompt_cached(int type, const char *key)
+{
+    int i; /* Counter */
+
+    for (i = 0; i < CACHE_SIZE; i++)
+	if (cache[i].key != NULL && cache[i].type == type &&
+	    !strcmp(cache[i].key, key))
+	    return &cache[i];
+    return NULL;
+}
+
+/*
+ * Start a worker computing information `type' if it is unknown or old; the
+ * worker is detached (its parent exits at once) so that it is never
+ * reported as a job, and it is killed by SIGALRM at its deadline
+ */
+static void prompt_start(int type)
+{
+    int            fd[2];     /* Result pipe         */
+    pid_t          pid;       /* Intermediate child  */
+    const char    *key;       /* Cache key           */
+    sigset_t       set, old;  /* Blocked signals     */
+    struct timeval now;       /* Current time        */
+    struct itimerval timer;   /* Worker deadline     */
+    struct prompt_cache  *entry;
+    struct prompt_worker *worker = &workers[type];
+    char           value[VALUE_MAX]; /* Computed value */
+
+    key = asyncs[type].by_cwd ? cwd : "";
+    gettimeofday(&now, NULL);
+    if (worker->fd != -1 || ((entry = prompt_cached(type, key)) != NULL &&
+			     prompt_elapsed(&entry->time, &now) <
+			     asyncs[type].max_age))
+	return;
+    if ((worker->key = strdup(key)) == NULL || pipe(fd) == -1) {
+	free(worker->key);
+	worker->key = NULL;
+	return;
+    }
+
+    /* Do not let the SIGCHLD handler see the intermediate child */
+    sigemptyset(&set);
+    sigaddset(&set, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &set, &old);
+    METRIC_COUNT(METRIC_FORKS);
+    if ((pid = fork()) == 0) {
+	close(fd[0]);
+	if (fork() == 0) {
+	    history_detach();
+	    timer.it_interval.tv_sec = timer.it_interval.tv_usec = 0;
+	    timer.it_value.tv_sec = asyncs[type].deadline / 1000;
+	    timer.it_value.tv_usec = asyncs[type].deadline % 1000 * 1000;
+	    signal(SIGALRM, SIG_DFL);
+	    setitimer(ITIMER_REAL, &timer, NULL);
+
+	    /* The line break tells the value is complete */
+	    value[0] = '\0';
+	    asyncs[type].compute(value);
+	    value[VALUE_MAX - 2] = '\0';
+	    strcat(value, "\n");
+	    write(fd[1], value, strlen(value));
+	}
+	_exit(0);
+    }
+    if (pid != -1)
+	waitpid(pid, NULL, 0);
+    sigprocmask(SIG_SETMASK, &old, NULL);
+    close(fd[1]);
+
+    if (pid == -1) {
+	close(fd[0]);
+	free(worker->key);
+	worker->key = NULL;
+	return;
+    }
+    fcntl(fd[0], F_SETFL, O_NONBLOCK);
+    fcntl(fd[0], F_SETFD, FD_CLOEXEC);
+    worker->fd = fd[0];
+    worker->len = 0;
+    worker->deadline = now;
+    worker->deadline.tv_usec += asyncs[type].deadline * 1000;
+    worker->deadline.tv_sec += worker->deadline.tv_usec / 1000000;
+    worker->deadline.tv_usec %= 1000000;
+}
+
+/*
+ * Forget about a worker
+ */
+static void prompt_stop(struct prompt_worker *worker)
+{
+    close(worker->fd);
+    worker->fd = -1;
+    free(worker->key);
+    worker->key = NULL;
+}
+
+/*
+ * Read the result of the worker computing information `type', if
+ * available; return 1 if the cached value changed
+ */
+static int prompt_result(int type)
+{
+    int   len;                            /* Length read     */
+    struct prompt_worker *worker = &workers[type];
+    struct prompt_cache  *entry;          /* Cached value    */
+
+    if (worker->fd == -1)
+	return 0;
+    while ((len = read(worker->fd, worker->value + worker->len,
+		       VALUE_MAX - 1 - worker->len)) > 0)
+	worker->len += len;
+    if (len == -1) {
+	if (errno != EAGAIN && errno != EINTR)
+	    prompt_stop(worker);
+	return 0;
+    }
+
+    /* Worker done: cache a complete value, replacing the oldest one if
+       needed */
+    if (worker->len == 0 || worker->value[worker->len - 1] != '\n') {
+	prompt_stop(worker);
+	return 0;
+    }
+    worker->value[worker->len - 1] = '\0';
+    if ((entry = prompt_cached(type, worker->key)) == NULL) {
+	entry = &cache[cache_next];
+	cache_next = (cache_next + 1) % CACHE_SIZE;
+	free(entry->key);
+	entry->key = worker->key;
+	entry->type = type;
+	entry->value[0] = '\0';
+	worker->key = NULL;
+    }
+    gettimeofday(&entry->time, NULL);
+    len = strcmp(entry->value, worker->value);
+    strcpy(entry->value, worker->value);
+    prompt_stop(worker);
+    return len != 0;
+}
+
+/*
+ * Give up workers which missed their deadline
+ */
+static void prompt_expire(const struct timeval *now)
+{
+    int i; /* Counter */
+
+    for (i = 0; i < ASYNC_COUNT; i++)
+	if (workers[i].fd != -1 && prompt_elapsed(now,
+						  &workers[i].deadline) <= 0)
+	    prompt_stop(&workers[i]);
+}
+
+
+/*****************************************************************************
+ *
+ * Prompt Rendering
+ *
+ */
+
+/*
+ * Append `len' bytes of `text' to the rendered prompt
+ */
+static void prompt_append(const char *text, size_t len)
+{
+    char *tmp; /* Reallocated buffer */
+
+    if (rendered_len + len > rendered_size) {
+	rendered_size = (rendered_len + len) * 2;
+	if ((tmp = realloc(rendered, rendered_size)) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+	rendered = tmp;
+    }
+    memcpy(rendered + rendered_len, text, len);
+    rendered_len += len;
+}
+
+/*
+ * Get again information which may have changed
+ */
+static void prompt_refresh(void)
+{
+    const char *prompt, *dot; /* Prompt string, end of short hostname */
+
+    if (stale & PROMPT_ENV) {
+	/* Recompile the prompt only if $PS1 changed */
+	if ((prompt = var_get("PS1")) == NULL)
+	    prompt = default_prompt;
+	if (source == NULL || strcmp(source, prompt))
+	    prompt_compile(prompt);
+
+	/* Home directory, without its trailing `/' */
+	home = var_get("HOME");
+	home_len = home ? strlen(home) : 0;
+	if (home_len > 1 && home[home_len - 1] == '/')
+	    home_len--;
+
+	/* Hostname, which rarely changes: read again along with variables
+	   rather than at each prompt */
+	gethostname(hostname, sizeof hostname - 1);
+	hostname[sizeof hostname - 1] = '\0';
+	host_len = strlen(hostname);
+	host_short_len = (dot = strchr(hostname, '.')) != NULL ?
+	    dot - hostname : host_len;
+    }
+
+    stale = 0;
+}
+
+/*
+ * Render the prompt from its segment program and cached information
+ */
+static void prompt_render(void)
+{
+    size_t      i;          /* Counter             */
+    int         type;       /* Asynchronous type   */
+    const char *name;       /* Directory name      */
+    char        number[24]; /* Formatted number    */
+    struct prompt_segment *seg;
+    struct prompt_cache   *entry;
+
+    prompt_refresh();
+    rendered_len = 0;
+    for (i = 0; i < seg_count; i++)
+	switch ((seg = &program[i])->type) {
+	case SEG_TEXT:
+	    prompt_append(literals + seg->offset, seg->len);
+	    break;
+
+	case SEG_HOST:
+	    prompt_append(hostname, host_len);
+	    break;
+
+	case SEG_HOST_SHORT:
+	    prompt_append(hostname, host_short_len);
+	    break;
+
+	case SEG_CWD:
+	    if (home_len > 1 && !strncmp(cwd, home, home_len) &&
+		(cwd[home_len] == '\0' || cwd[home_len] == '/')) {
+		prompt_append("~", 1);
+		prompt_append(cwd + home_len, strlen(cwd + home_len));
+	    } else
+		prompt_append(cwd, strlen(cwd));
+	    break;
+
+	case SEG_CWD_NAME:
+	    if (home_len > 0 && !strncmp(cwd, home, home_len) &&
+		cwd[home_len] == '\0')
+		prompt_append("~", 1);
+	    else {
+		name = strrchr(cwd, '/');
+		name = name != NULL && name[1] != '\0' ? name + 1 : cwd;
+		prompt_append(name, strlen(name));
+	    }
+	    break;
+
+	case SEG_STATUS:
+	case SEG_JOBS:
+	    sprintf(number, "%d", seg->type == SEG_STATUS ?
+		    exec_ctx->exit_status : exec_ctx->jobs);
+	    prompt_append(number, strlen(number));
+	    break;
+
+	case SEG_BRANCH:
+	case SEG_LOAD:
+	    type = seg->type == SEG_BRANCH ? ASYNC_BRANCH : ASYNC_LOAD;
+	    if ((entry = prompt_cached(type, asyncs[type].by_cwd ? cwd : ""))
+		!= NULL)
+		prompt_append(entry->value, strlen(entry->value));
+	    break;
+	}
+}
+
+/*
+ * Write the rendered prompt after `prefix' (a cursor movement)
+ */
+static void prompt_write(const char *prefix)
+{
+    size_t       i;      /* Counter         */
+    struct iovec iov[2]; /* Written buffers */
+
+    iov[0].iov_base = (void *) prefix;
+    iov[0].iov_len = strlen(prefix);
+    iov[1].iov_base = rendered;
+    iov[1].iov_len = rendered_len;
+    writev(STDOUT_FILENO, iov, 2);
+
+    /* Count line breaks and the columns of the last line, skipping
+       escape sequences and UTF-8 continuation bytes */
+    rendered_lines = rendered_width = 0;
+    for (i = 0; i < rendered_len; i++)
+	if (rendered[i] == '\n') {
+	    rendered_lines++;
+	    rendered_width = 0;
+	} else if (rendered[i] == '\033' && i + 1 < rendered_len &&
+		   rendered[i + 1] == '[') {
+	    for (i += 2; i < rendered_len &&
+		     (rendered[i] < '@' || rendered[i] > '~'); i++)
+		;
+	} else if (rendered[i] == '\033' && i + 1 < rendered_len &&
+		   rendered[i + 1] == ']') {
+	    for (i += 2; i < rendered_len && rendered[i] != '\a'; i++)
+		;
+	} else if ((unsigned char) rendered[i] >= ' ' &&
+		   ((unsigned char) rendered[i] & 0xC0) != 0x80)
+	    rendered_width++;
+}
+
+
+/*****************************************************************************
+ *
+ * Prompt Interface
+ *
+ */
+
+/*
+ * Mark information used in the prompt as changed: working directory
+ * (PROMPT_CWD) and/or environment variables (PROMPT_ENV)
+ */
+void prompt_invalidate(int what)
+{
+    stale |= what;
+}
+
+/*
+ * Never display the prompt again
+ */
+void prompt_disable(void)
+{
+    disabled = 1;
+}
+
+/*
+ * Display the prompt, rendering it again only if something changed;
+ * asynchronous information is displayed as last known, and workers are
+ * started to get it again
+ */
+void display_prompt(void)
+{
+    size_t i; /* Counter */
+
+    if (disabled)
+	return;
+
+    /* Collect results which arrived meanwhile */
+    for (i = 0; i < ASYNC_COUNT; i++)
+	prompt_result(i);
+    if (stale || dynamic || rendered == NULL)
+	prompt_render();
+
+    /* Previous output must come first */
+    fflush(stdout);
+    prompt_write("");
+
+    for (i = 0; i < seg_count; i++)
+	if (program[i].type == SEG_BRANCH)
+	    prompt_start(ASYNC_BRANCH);
+	else if (program[i].type == SEG_LOAD)
+	    prompt_start(ASYNC_LOAD);
+}
+
+/*
+ * Display the continuation prompt `prompt' (asked for by a command which
+ * is not complete)
+ */
+void display_continuation(const char *prompt)
+{
+    if (disabled)
+	return;
+    fputs(prompt, stdout);
+    fflush(stdout);
+    rendered_width = strlen(prompt);
+}
+
+/*
+ * Display the prompt as last rendered, without rendering it or starting
+ * workers, from the SIGCHLD handler
+ */
+void redisplay_prompt(void)
+{
+    if (disabled || rendered == NULL)
+	return;
+    fflush(stdout);
+    prompt_write("");
+}
+
+/*
+ * Tell the column where the last displayed prompt (or continuation prompt)
+ * leaves the cursor
+ */
+int prompt_width(void)
+{
+    return disabled ? 0 : rendered_width;
+}
+
+/*
+ * Wait for input on `fd', redrawing the prompt in place when workers bring
+ * new information (until their deadline), the cursor being `rows' rows
+ * below its last line; only done on a terminal; return 1 if the prompt was
+ * redrawn (the cursor being just after it)
+ */
+int prompt_wait(int fd, int rows)
+{
+    int            i, max, changed; /* Counter, max. fd, redraw? */
+    int            redrawn = 0;     /* Result                    */
+    fd_set         set;             /* Watched descriptors       */
+    long           delay;           /* Time to the next deadline */
+    struct timeval now, timeout;    /* Current time, timeout     */
+    char           prefix[32];      /* Cursor movement           */
+
+    if (!isatty(fd) || !isatty(STDOUT_FILENO))
+	return 0;
+
+    for (;;) {
+	/* Watch input and running workers, up to the first deadline */
+	FD_ZERO(&set);
+	FD_SET(fd, &set);
+	max = fd;
+	delay = -1;
+	gettimeofday(&now, NULL);
+	prompt_expire(&now);
+	for (i = 0; i < ASYNC_COUNT; i++)
+	    if (workers[i].fd != -1) {
+		FD_SET(workers[i].fd, &set);
+		if (workers[i].fd > max)
+		    max = workers[i].fd;
+		if (delay == -1 ||
+		    prompt_elapsed(&now, &workers[i].deadline) < delay)
+		    delay = prompt_elapsed(&now, &workers[i].deadline);
+	    }
+	if (delay == -1)
+	    return redrawn;
+	timeout.tv_sec = delay / 1000;
+	timeout.tv_usec = delay % 1000 * 1000;
+
+	if (select(max + 1, &set, NULL, NULL, &timeout) == -1) {
+	    if (errno == EINTR)
+		continue;
+	    return redrawn;
+	}
+	if (FD_ISSET(fd, &set))
+	    return redrawn;
+
+	/* Redraw the prompt in place if a value changed */
+	changed = 0;
+	for (i = 0; i < ASYNC_COUNT; i++)
+	    if (workers[i].fd != -1 && FD_ISSET(workers[i].fd, &set))
+		changed |= prompt_result(i);
+	if (changed) {
+	    if (rendered_lines + rows > 0)
+		sprintf(prefix, "\r\033[%dA\033[J", rendered_lines + rows);
+	    else
+		strcpy(prefix, "\r\033[J");
+	    prompt_render();
+	    prompt_write(prefix);
+	    redrawn = 1;
+	}
+    }
+}
+
+/* End of file */
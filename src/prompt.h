@@ -0,0 +1,51 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/prompt.h
+ *
+ * Description: Prompt Display
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _PROMPT_H_
+#define _PROMPT_H_
+
+/* Information used in the prompt, for prompt_invalidate() */
+#define PROMPT_CWD 1 /* Working directory     */
+#define PROMPT_ENV 2 /* Environment variables */
+
+/* Prototypes */
+void prompt_invalidate(int what);
+void prompt_disable(void);
+void display_prompt(void);
+void display_continuation(const char *prompt);
+void redisplay_prompt(void);
+int  prompt_width(void);
+int  prompt_wait(int fd, int rows);
+
+#endif /* !_PROMPT_H_ */
+
+/* End of file */
@@ -0,0 +1,312 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/schedule.c
+ *
+ * Description: Pipeline Scheduling Controls
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+#define _GNU_SOURCE /* For sched_setaffinity(), SCHED_BATCH, syscall() */
+
+/* Standard C headers */
+#include <stdio.h>  /* fprintf()                            */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free()    */
+#include <string.h> /* strcmp(), strchr()                   */
+#include <errno.h>  /* errno                                */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/time.h>
+#include <sys/resource.h> /* getpriority(), setpriority() */
+#include <unistd.h>       /* syscall()                    */
+#include <sched.h>        /* sched_setscheduler(), ...    */
+#ifdef __linux__
+# include <sys/syscall.h> /* SYS_ioprio_set */
+#endif
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "schedule.h"
+
+
+/*****************************************************************************
+ *
+ * Constants
+ *
+ */
+
+/* I/O priority classes and target (see ioprio_set(2)) */
+#define IOPRIO_CLASS_RT     1
+#define IOPRIO_CLASS_BE     2
+#define IOPRIO_CLASS_IDLE   3
+#define IOPRIO_CLASS_SHIFT  13
+#define IOPRIO_WHO_PROCESS  1
+
+/* Usage message */
+#define USAGE "syntax error: sched [--cpus list [--spread]] " \
+    "[--policy name [--priority n]] [--nice n] [--ioprio class[:level]] " \
+    "command"
+
+/* Scheduling policies */
+static const struct {
+    const char *name;
+    int         policy;
+} policies[] = {
+    { "other", SCHED_OTHER },
+#ifdef SCHED_BATCH
+    { "batch", SCHED_BATCH },
+#endif
+#ifdef SCHED_IDLE
+    { "idle",  SCHED_IDLE  },
+#endif
+    { "fifo",  SCHED_FIFO  },
+    { "rr",    SCHED_RR    }
+};
+
+
+/*****************************************************************************
+ *
+ * Option Parsing
+ *
+ */
+
+/*
+ * Parse an integer, entirely; return 0 on success
+ */
+static int schedule_int(const char *text, int *value)
+{
+    char *end; /* End of number */
+    long  n;   /* Number        */
+
+    n = strtol(text, &end, 10);
+    if (*text == '\0' || *end != '\0')
+	return -1;
+    *value = (int) n;
+    return 0;
+}
+
+/*
+ * Parse a CPU list like "0-3,6"; return 0 on success
+ */
+static int schedule_cpus(const char *text, struct schedule *schedule)
+{
+    char *end;        /* End of number */
+    long  first, last; /* Range        */
+
+    schedule->cpu_count = 0;
+    for (;;) {
+	first = last = strtol(text, &end, 10);
+	if (end == text || first < 0)
+	    return -1;
+	if (*end == '-') {
+	    text = end + 1;
+	    last = strtol(text, &end, 10);
+	    if (end == text || last < first)
+		return -1;
+	}
+	if ((schedule->cpus = realloc(schedule->cpus,
+				      (schedule->cpu_count + last - first + 1)
+				      * sizeof *schedule->cpus)) == NULL) {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+	while (first <= last)
+	    schedule->cpus[schedule->cpu_count++] = (int) first++;
+	if (*end == '\0')
+	    return 0;
+	if (*end != ',')
+	    return -1;
+	text = end + 1;
+    }
+}
+
+/*
+ * Parse an I/O priority like "idle", "be:4" or "rt:0"; return 0 on success
+ */
+static int schedule_ioprio(const char *text, struct schedule *schedule)
+{
+    int         class, level = 4; /* Class and level in it */
+    const char *colon;            /* Level separator       */
+
+    if (!strncmp(text, "idle", 4) && (text[4] == '\0' || text[4] == ':'))
+	class = IOPRIO_CLASS_IDLE;
+    else if (!strncmp(text, "be", 2) && (text[2] == '\0' || text[2] == ':'))
+	class = IOPRIO_CLASS_BE;
+    else if (!strncmp(text, "rt", 2) && (text[2] == '\0' || text[2] == ':'))
+	class = IOPRIO_CLASS_RT;
+    else
+	return -1;
+
+    if ((colon = strchr(text, ':')) != NULL &&
+	(schedule_int(colon + 1, &level) || level < 0 || level > 7))
+	return -1;
+    if (class == IOPRIO_CLASS_IDLE)
+	level = 0;
+    schedule->ioprio = class << IOPRIO_CLASS_SHIFT | level;
+    return 0;
+}
+
+/*
+ * Parse the options of a `sched' prefix (argv[0]) into `schedule'; return
+ * the number of words to skip to get the command, or -1 on error
+ */
+int schedule_parse(int argc, char *argv[], struct schedule *schedule)
+{
+    int    i;        /* Counter                         */
+    size_t n;        /* Counter                         */
+    int    priority; /* Priority given for the policy   */
+    int    error;    /* Whether an option is wrong      */
+
+    schedule_clear(schedule);
+    priority = -1;
+    error = 0;
+    for (i = 1; i < argc && !error && !strncmp(argv[i], "--", 2); i++) {
+	if (!strcmp(argv[i], "--")) {
+	    i++;
+	    break;
+	} else if (!strcmp(argv[i], "--spread"))
+	    schedule->set |= SCHEDULE_SPREAD;
+	else if (i + 1 >= argc)
+	    error = 1;
+	else if (!strcmp(argv[i], "--cpus")) {
+	    error = schedule_cpus(argv[++i], schedule);
+	    schedule->set |= SCHEDULE_CPUS;
+	} else if (!strcmp(argv[i], "--policy")) {
+	    i++;
+	    for (n = 0; n < sizeof policies / sizeof *policies; n++)
+		if (!strcmp(argv[i], policies[n].name))
+		    break;
+	    if (n < sizeof policies / sizeof *policies) {
+		schedule->policy = policies[n].policy;
+		schedule->set |= SCHEDULE_POLICY;
+	    } else
+		error = 1;
+	} else if (!strcmp(argv[i], "--priority"))
+	    error = schedule_int(argv[++i], &priority) || priority < 0;
+	else if (!strcmp(argv[i], "--nice")) {
+	    error = schedule_int(argv[++i], &schedule->nice);
+	    schedule->set |= SCHEDULE_NICE;
+	} else if (!strcmp(argv[i], "--ioprio")) {
+	    error = schedule_ioprio(argv[++i], schedule);
+	    schedule->set |= SCHEDULE_IOPRIO;
+	} else
+	    error = 1;
+    }
+
+    /* A command is needed, and spreading needs CPUs */
+    if (error || i >= argc || ((schedule->set & SCHEDULE_SPREAD) &&
+			       !(schedule->set & SCHEDULE_CPUS))) {
+	fprintf(stderr, "%s: sched: %s\n", exe_name, USAGE);
+	schedule_clear(schedule);
+	return -1;
+    }
+
+    /* Real-time policies need a priority, others have 0 */
+    if (schedule->set & SCHEDULE_POLICY)
+	schedule->priority = priority != -1 ? priority :
+	    (schedule->policy == SCHED_FIFO || schedule->policy == SCHED_RR);
+    return i;
+}
+
+
+/*****************************************************************************
+ *
+ * Applying Settings
+ *
+ */
+
+/*
+ * Apply scheduling settings to the calling process, which runs stage
+ * `stage' (from 0) of the pipeline; failures are reported, not fatal
+ */
+void schedule_apply(const struct schedule *schedule, int stage)
+{
+    struct sched_param param; /* Policy parameter */
+    int                i;     /* Counter          */
+#ifdef __linux__
+    cpu_set_t          set;   /* Allowed CPUs     */
+#endif
+
+    if (schedule->set == 0)
+	return;
+
+#ifdef __linux__
+    /* Pin to the CPUs, or to the stage's one when spreading the pipeline
+       over neighbouring CPUs */
+    if (schedule->set & SCHEDULE_CPUS) {
+	CPU_ZERO(&set);
+	if (schedule->set & SCHEDULE_SPREAD)
+	    CPU_SET(schedule->cpus[stage % schedule->cpu_count], &set);
+	else
+	    for (i = 0; i < schedule->cpu_count; i++)
+		if (schedule->cpus[i] < CPU_SETSIZE)
+		    CPU_SET(schedule->cpus[i], &set);
+	if (sched_setaffinity(0, sizeof set, &set) == -1)
+	    lish_perror("sched: cannot set CPU affinity");
+    }
+#else
+    (void) stage;
+    (void) i;
+#endif
+
+    if (schedule->set & SCHEDULE_POLICY) {
+	param.sched_priority = schedule->priority;
+	if (sched_setscheduler(0, schedule->policy, &param) == -1)
+	    lish_perror("sched: cannot set scheduling policy");
+    }
+
+    /* Like nice(1), the niceness is incremented */
+    if (schedule->set & SCHEDULE_NICE) {
+	errno = 0;
+	i = getpriority(PRIO_PROCESS, 0);
+	if (errno != 0 || setpriority(PRIO_PROCESS, 0, i + schedule->nice)
+	    == -1)
+	    lish_perror("sched: cannot set niceness");
+    }
+
+#ifdef SYS_ioprio_set
+    if ((schedule->set & SCHEDULE_IOPRIO) &&
+	syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, schedule->ioprio)
+	== -1)
+	lish_perror("sched: cannot set I/O priority");
+#endif
+}
+
+/*
+ * Forget scheduling settings
+ */
+void schedule_clear(struct schedule *schedule)
+{
+    free(schedule->cpus);
+    schedule->cpus = NULL;
+    schedule->cpu_count = 0;
+    schedule->set = 0;
+}
+
+/* End of file */
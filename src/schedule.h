@@ -0,0 +1,61 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/schedule.h
+ *
+ * Description: Pipeline Scheduling Controls
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _SCHEDULE_H_
+#define _SCHEDULE_H_
+
+/* Scheduling settings given by a `sched' prefix */
+struct schedule {
+    int  set;       /* SCHEDULE_* flags of the given settings         */
+    int *cpus;      /* CPUs allowed, in the given order               */
+    int  cpu_count; /* Their number                                   */
+    int  policy;    /* Scheduling policy and its static priority      */
+    int  priority;
+    int  nice;      /* Niceness increment                             */
+    int  ioprio;    /* I/O priority, as given to ioprio_set()         */
+};
+
+/* Given settings */
+#define SCHEDULE_CPUS   1  /* CPU affinity                              */
+#define SCHEDULE_SPREAD 2  /* Stage N pinned to the Nth CPU of the list */
+#define SCHEDULE_POLICY 4  /* Scheduling policy                         */
+#define SCHEDULE_NICE   8  /* Niceness                                  */
+#define SCHEDULE_IOPRIO 16 /* I/O priority                              */
+
+/* Prototypes */
+int  schedule_parse(int argc, char *argv[], struct schedule *schedule);
+void schedule_apply(const struct schedule *schedule, int stage);
+void schedule_clear(struct schedule *schedule);
+
+#endif /* !_SCHEDULE_H_ */
+
+/* End of file */
@@ -0,0 +1,434 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/server.c
+ *
+ * Description: Server Mode (Commands Received over a UNIX Socket)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+
+#define _GNU_SOURCE /* For struct ucred, SO_PEERCRED */
+
+/* Standard C headers */
+#include <stdio.h>  /* fprintf()                              */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free()      */
+#include <string.h> /* strlen(), strcpy(), memset(), memcpy() */
+#include <errno.h>  /* errno                                  */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/socket.h> /* socket(), bind(), accept(), recvmsg()     */
+#include <sys/un.h>     /* struct sockaddr_un                        */
+#include <sys/stat.h>   /* umask()                                   */
+#include <sys/wait.h>   /* waitpid(), WIFEXITED(), ...               */
+#include <sys/time.h>   /* struct timeval                            */
+#include <sys/select.h> /* select()                                  */
+#include <unistd.h>     /* fork(), dup2(), pipe(), chdir(), unlink() */
+#include <fcntl.h>      /* fcntl()                                   */
+#include <signal.h>     /* signal()                                  */
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "variable.h"
+#include "pathindex.h"
+#include "server.h"
+
+
+/*****************************************************************************
+ *
+ * Global Variables
+ *
+ */
+
+/* Environment of executed programs */
+extern char **environ;
+
+/* Maximum size of a request */
+#define SERVER_MAX_REQUEST (16 * 1024 * 1024)
+
+/* Clients waiting for the exit status of their shell */
+static struct client {
+    pid_t pid;  /* Shell running the request */
+    int   sock; /* Connection                */
+} *clients = NULL;
+static int client_count = 0, client_size = 0;
+
+/* Pipe written by the SIGCHLD handler, to wake the server up */
+static int wakeup[2];
+
+
+/*****************************************************************************
+ *
+ * Socket Input/Output
+ *
+ */
+
+/*
+ * Read exactly `len' bytes; return 0 on success
+ */
+static int server_read(int fd, void *buffer, size_t len)
+{
+    ssize_t ret; /* Bytes read */
+
+    while (len > 0)
+	if ((ret = read(fd, buffer, len)) > 0) {
+	    buffer = (char *) buffer + ret;
+	    len -= ret;
+	} else if (ret == 0 || errno != EINTR)
+	    return -1;
+    return 0;
+}
+
+/*
+ * Write exactly `len' bytes; return 0 on success
+ */
+static int server_write(int fd, const void *buffer, size_t len)
+{
+    ssize_t ret; /* Bytes written */
+
+    while (len > 0)
+	if ((ret = write(fd, buffer, len)) > 0) {
+	    buffer = (const char *) buffer + ret;
+	    len -= ret;
+	} else if (ret == 0 || errno != EINTR)
+	    return -1;
+    return 0;
+}
+
+/*
+ * Close `count' received descriptors stored from `data' (maybe unaligned)
+ */
+static void server_close(const void *data, size_t count)
+{
+    int    fd; /* Descriptor */
+    size_t i;  /* Counter    */
+
+    for (i = 0; i < count; i++) {
+	memcpy(&fd, (const char *) data + i * sizeof fd, sizeof fd);
+	close(fd);
+    }
+}
+
+/*
+ * Receive a request and the descriptors attached to it; return it (ended
+ * by '\0'), or NULL on error, the descriptors being closed then
+ */
+static char *server_receive(int sock, int fds[SERVER_FDS], size_t *len)
+{
+    struct msghdr   msg;  /* Received message  */
+    struct iovec    iov;  /* Its data          */
+    struct cmsghdr *cmsg; /* Its control data  */
+    ssize_t         ret;  /* Bytes received    */
+    char           *request;
+    union {
+	struct cmsghdr align;
+	char           buffer[CMSG_SPACE(SERVER_FDS * sizeof (int))];
+    } control;
+
+    /* Length, with the descriptors */
+    memset(&msg, 0, sizeof msg);
+    iov.iov_base = len;
+    iov.iov_len = sizeof *len;
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buffer;
+    msg.msg_controllen = sizeof control.buffer;
+    while ((ret = recvmsg(sock, &msg, 0)) == -1 && errno == EINTR)
+	;
+    if (ret <= 0 || (cmsg = CMSG_FIRSTHDR(&msg)) == NULL)
+	return NULL;
+    if (cmsg->cmsg_level != SOL_SOCKET || cmsg->cmsg_type != SCM_RIGHTS)
+	return NULL;
+    if (cmsg->cmsg_len != CMSG_LEN(SERVER_FDS * sizeof (int)) ||
+	(msg.msg_flags & MSG_CTRUNC)) {
+	/* Not all of them came: close the ones which did */
+	server_close(CMSG_DATA(cmsg),
+		     (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof (int));
+	return NULL;
+    }
+    memcpy(fds, CMSG_DATA(cmsg), SERVER_FDS * sizeof (int));
+
+    /* Request */
+    request = NULL;
+    if (((size_t) ret < sizeof *len &&
+	 server_read(sock, (char *) len + ret, sizeof *len - ret) == -1) ||
+	*len < 2 || *len > SERVER_MAX_REQUEST ||
+	(request = malloc(*len)) == NULL ||
+	server_read(sock, request, *len) == -1 || request[*len - 1] != '\0') {
+	free(request);
+	server_close(fds, SERVER_FDS);
+	return NULL;
+    }
+    return request;
+}
+
+
+/*
+ * Remember the client of a shell; return 0 on success
+ */
+static int server_add(pid_t pid, int sock)
+{
+    struct client *new; /* Reallocated array */
+
+    if (client_count == client_size) {
+	client_size = client_size ? client_size * 2 : 16;
+	if ((new = realloc(clients, client_size * sizeof *clients)) == NULL)
+	    return -1;
+	clients = new;
+    }
+    clients[client_count].pid = pid;
+    clients[client_count++].sock = sock;
+    return 0;
+}
+
+
+/*****************************************************************************
+ *
+ * Request Handling
+ *
+ */
+
+/*
+ * Receive a request on `sock' and fork the shell running it; return its
+ * PID in the server (-1 on error), or the command to run in that shell
+ */
+static pid_t server_start(int sock, const char **command)
+{
+    struct ucred   cred;                   /* Client credentials          */
+    socklen_t      cred_len = sizeof cred; /* Their size                  */
+    struct timeval timeout;                /* Receiving timeout           */
+    int            fds[SERVER_FDS];        /* Client standard descriptors */
+    size_t         len, i, count;          /* Request length, counters    */
+    char          *request, *entry;        /* Request, current string     */
+    char         **env;                    /* Its environment             */
+    pid_t          pid;                    /* Shell PID                   */
+
+    /* Only the user running the server is served, and a request is not
+       waited for long */
+    timeout.tv_sec = 1;
+    timeout.tv_usec = 0;
+    if (getsockopt(sock, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 ||
+	cred.uid != getuid() ||
+	setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof timeout)
+	== -1 || (request = server_receive(sock, fds, &len)) == NULL)
+	return -1;
+
+    /* Directory, command and environment entries */
+    for (count = 0, i = 0; i < len; i++)
+	if (request[i] == '\0')
+	    count++;
+    if (count < 2 || (env = malloc((count - 1) * sizeof *env)) == NULL) {
+	server_close(fds, SERVER_FDS);
+	free(request);
+	return -1;
+    }
+    *command = request + strlen(request) + 1;
+    entry = (char *) *command + strlen(*command) + 1;
+    for (i = 0; entry < request + len; i++, entry += strlen(entry) + 1)
+	env[i] = entry;
+    env[i] = NULL;
+
+    if ((pid = fork()) == 0) {
+	/* A process group of its own receives the signals of the client */
+	setpgid(0, 0);
+
+	/* Standard descriptors of the client */
+	for (i = 0; i < SERVER_FDS; i++)
+	    if (dup2(fds[i], i) == -1) {
+		lish_perror("cannot duplicate file descriptor");
+		lish_exit(RET_ERROR);
+	    }
+	for (i = 0; i < SERVER_FDS; i++)
+	    if (fds[i] >= SERVER_FDS)
+		close(fds[i]);
+
+	/* Environment and directory of the client */
+	var_free();
+	environ = env;
+	var_init();
+	if (chdir(request) == -1) {
+	    lish_perror(request);
+	    lish_exit(RET_ERROR);
+	}
+	return 0;
+    }
+
+    if (pid != -1)
+	setpgid(pid, pid);
+    server_close(fds, SERVER_FDS);
+    free(env);
+    free(request);
+    return pid;
+}
+
+/*
+ * Send its exit status to the client of each terminated shell
+ */
+static void server_reap(void)
+{
+    int   status, code; /* Shell status, exit code */
+    pid_t pid;          /* Terminated shell PID    */
+    int   i;            /* Counter                 */
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0)
+	for (i = 0; i < client_count; i++)
+	    if (clients[i].pid == pid) {
+		code = WIFEXITED(status) ? WEXITSTATUS(status) :
+		    WIFSIGNALED(status) ? 128 + WTERMSIG(status) : RET_ERROR;
+		server_write(clients[i].sock, &code, sizeof code);
+		close(clients[i].sock);
+		clients[i] = clients[--client_count];
+		break;
+	    }
+}
+
+/*
+ * Called upon SIGCHLD (a shell terminated) in the server
+ */
+static void server_sig_chld(int sig UNUSED)
+{
+    int saved = errno; /* errno of the interrupted code */
+
+    signal(SIGCHLD, server_sig_chld);
+    write(wakeup[1], "", 1);
+    errno = saved;
+}
+
+
+/*****************************************************************************
+ *
+ * Main Public Function
+ *
+ */
+
+/*
+ * Serve requests received over the UNIX socket `path', each in a shell
+ * forked from this one, whose caches are warm; return NULL on error, or
+ * the command to run in such a shell
+ */
+const char *server_run(const char *path)
+{
+    struct sockaddr_un addr;     /* Socket address                */
+    int                listener; /* Listening socket              */
+    int                sock;     /* Connection, or probing socket */
+    mode_t             mask;     /* Saved file creation mask      */
+    fd_set             set;      /* Watched descriptors           */
+    pid_t              pid;      /* Shell PID                     */
+    const char        *command;  /* Command of a request          */
+    char               drain[64];/* Wake-up bytes                 */
+    int                i;        /* Counter                       */
+
+    if (strlen(path) >= sizeof addr.sun_path) {
+	fprintf(stderr, "%s: %s: socket name too long\n", exe_name, path);
+	return NULL;
+    }
+    memset(&addr, 0, sizeof addr);
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    /* A socket left by a server which is not running anymore is
+       replaced */
+    if ((sock = socket(AF_UNIX, SOCK_STREAM, 0)) == -1 ||
+	(listener = socket(AF_UNIX, SOCK_STREAM, 0)) == -1) {
+	lish_perror("cannot create socket");
+	return NULL;
+    }
+    if (connect(sock, (struct sockaddr *) &addr, sizeof addr) == 0) {
+	fprintf(stderr, "%s: %s: a server is already running\n", exe_name,
+		path);
+	return NULL;
+    }
+    if (errno == ECONNREFUSED)
+	unlink(path);
+    close(sock);
+
+    /* Only the user may connect */
+    mask = umask(077);
+    if (bind(listener, (struct sockaddr *) &addr, sizeof addr) == -1 ||
+	listen(listener, SOMAXCONN) == -1) {
+	umask(mask);
+	lish_perror(path);
+	return NULL;
+    }
+    umask(mask);
+    if (pipe(wakeup) == -1) {
+	lish_perror("cannot create pipe");
+	return NULL;
+    }
+
+    /* Warm up the index of $PATH executables, inherited by each shell;
+       a client may leave before getting its exit status */
+    pathindex_lookup("");
+    signal(SIGCHLD, server_sig_chld);
+    signal(SIGPIPE, SIG_IGN);
+
+    for (;;) {
+	FD_ZERO(&set);
+	FD_SET(listener, &set);
+	FD_SET(wakeup[0], &set);
+	if (select((listener > wakeup[0] ? listener : wakeup[0]) + 1, &set,
+		   NULL, NULL, NULL) == -1) {
+	    if (errno == EINTR)
+		continue;
+	    lish_perror("select");
+	    lish_exit(RET_ERROR);
+	}
+
+	/* Terminated shells */
+	if (FD_ISSET(wakeup[0], &set)) {
+	    read(wakeup[0], drain, sizeof drain);
+	    server_reap();
+	}
+
+	/* New request */
+	if (!FD_ISSET(listener, &set) ||
+	    (sock = accept(listener, NULL, NULL)) == -1)
+	    continue;
+	if ((pid = server_start(sock, &command)) == 0) {
+	    /* In the shell, only its own descriptors are kept */
+	    signal(SIGCHLD, SIG_DFL);
+	    signal(SIGPIPE, SIG_DFL);
+	    close(listener);
+	    close(wakeup[0]);
+	    close(wakeup[1]);
+	    close(sock);
+	    for (i = 0; i < client_count; i++)
+		close(clients[i].sock);
+	    free(clients);
+	    return command;
+	}
+
+	/* The client gets the PID, then the exit status */
+	if (pid == -1 || server_write(sock, &pid, sizeof pid) == -1 ||
+	    server_add(pid, sock) == -1)
+	    close(sock);
+    }
+}
+
+/* End of file */
@@ -0,0 +1,53 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/server.h
+ *
+ * Description: Server Mode (Commands Received over a UNIX Socket)
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _SERVER_H_
+#define _SERVER_H_
+
+/*
+ * Protocol: the client sends the length of its request (a size_t), with
+ * its standard descriptors attached (SCM_RIGHTS), then the request: its
+ * working directory, the command and its environment entries, each ended
+ * by '\0'.  The server answers with the PID of the shell running the
+ * command (a pid_t), whose process group the client forwards its signals
+ * to, and then its exit status (an int).
+ */
+
+/* Number of descriptors attached to a request */
+#define SERVER_FDS 3
+
+/* Prototypes */
+const char *server_run(const char *path);
+
+#endif /* !_SERVER_H_ */
+
+/* End of file */
@@ -0,0 +1,267 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/shell.c
+ *
+ * Description: Shell-Wide Variables and Functions
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#define _POSIX_SOURCE /* For kill()                                  */
+#define _BSD_SOURCE   /* For signal() restarting interrupted system calls */
+
+/* Standard C headers */
+#include <limits.h> /* PATH_MAX                                       */
+#include <stdio.h>  /* printf(), perror()                             */
+#include <stdlib.h> /* NULL, malloc(), free(), exit()                 */
+#include <errno.h>  /* errno                                          */
+#include <setjmp.h> /* longjmp()                                      */
+
+/* Standard Unix headers */
+#include <sys/types.h>
+#include <sys/wait.h> /* waitpid()                                    */
+#include <unistd.h>   /* getcwd(), getpid(), _exit()                  */
+#include <signal.h>   /* signal(), kill()                             */
+
+/* Project headers */
+#include <command.h>
+#include <common.h>
+#include "execcmd.h"
+#include "jobqueue.h"
+#include "history.h"
+#include "prompt.h"
+#include "lineedit.h"
+#include "pathindex.h"
+#include "variable.h"
+#include "expand.h"
+#include "plugin.h"
+#include "metrics.h"
+#include "alloc.h"
+#include "shell.h"
+
+#ifndef PATH_MAX
+# define PATH_MAX 4096
+#endif /* !PATH_MAX */
+
+
+/*****************************************************************************
+ *
+ * Global Variables
+ *
+ */
+
+/* Program name, from executable filename */
+const char *exe_name = "lish";
+
+/* Current working directory */
+char *cwd = NULL;
+static int cwd_len = PATH_MAX;
+
+/* Number of killed children by signal handler */
+int killed = 0;
+
+/* PID of the shell itself (not of a forked subshell) */
+pid_t shell_pid = -1;
+
+
+/*****************************************************************************
+ *
+ * Finalization Functions
+ *
+ */
+
+/*
+ * Free memory and exit Lish
+ */
+void NORETURN lish_exit(int error_code)
+{
+    /* A host program evaluating commands (liblish) is not exited, the
+       evaluation is ended instead */
+    if (exec_ctx->leave != NULL && getpid() == exec_ctx->leave_pid) {
+	exec_ctx->exit_status = error_code;
+	longjmp(*exec_ctx->leave, 1);
+    }
+
+    if (getpid() == shell_pid) {
+	jobqueue_drain();
+	metrics_dump(1);
+    }
+    lineedit_restore();
+    close_fds();
+    if (exec_ctx->current_command)
+	free_command(exec_ctx->current_command);
+    history_exit();
+    pathindex_free();
+    expand_free();
+    exec_free();
+    jobqueue_free();
+    plugin_free();
+    var_free();
+
+    /* A forked subshell must not call exit(): if standard input is a file,
+       it would seek the shared descriptor back to the position of its copy
+       of the stdin buffer, making the shell read the same lines again */
+    if (getpid() != shell_pid) {
+	fflush(stdout);
+	_exit(error_code);
+    }
+#ifdef HAS_ALLOC_PROFILE
+    alloc_report(stderr);
+#endif
+    exit(error_code);
+}
+
+/*
+ * Free memory and cause abnormal program termination
+ */
+void NORETURN lish_abort(void)
+{
+    lineedit_restore();
+    close_fds();
+    if (exec_ctx->current_command)
+	free_command(exec_ctx->current_command);
+    history_exit();
+
+    abort();
+}
+
+
+/*****************************************************************************
+ *
+ * Utility Functions
+ *
+ */
+
+/*
+ * Update $PWD and directory used in prompt
+ */
+void change_cwd(void)
+{
+    /* Allocate memory if not already done */
+    if (cwd == NULL && (cwd = malloc(PATH_MAX)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+
+    /* Get working directory and allocate more memory if necessary */
+    while (getcwd(cwd, cwd_len) == NULL) {
+	if (errno == ERANGE) {
+	    free(cwd);
+	    if ((cwd = malloc((cwd_len += PATH_MAX))) == NULL) {
+		lish_perror("fatal error");
+		lish_exit(RET_ERROR);
+	    }
+	} else {
+	    lish_perror("fatal error");
+	    lish_exit(RET_ERROR);
+	}
+    }
+
+    /* Set environment variable $PWD */
+    var_set("PWD", cwd, VAR_EXPORT);
+    prompt_invalidate(PROMPT_CWD);
+}
+
+/*
+ * Print an error message, preceded by shell name and followed by the standard
+ * error string
+ */
+void lish_perror(const char *str)
+{
+    fprintf(stderr, "%s: ", exe_name);
+    perror(str);
+}
+
+
+/*****************************************************************************
+ *
+ * Signal Handlers
+ *
+ */
+
+/*
+ * Called upon SIGCHLD (a child terminated)
+ */
+void sig_chld(int sig UNUSED)
+{
+    int   status; /* Return code            */
+    pid_t pid;    /* Terminated process PID */
+
+    /* Re-install handler */
+    signal(SIGCHLD, sig_chld);
+
+    /* Wait for all pending children (non-blocking) */
+    while ((pid = waitpid(-1, &status, WNOHANG | WUNTRACED)) > 0) {
+	lineedit_leave();
+	if (WIFSTOPPED(status)) {
+	    kill(pid, SIGCONT);
+	    printf("\n[%d] in background\n", pid);
+	} else {
+	    printf("\n[%d] %d\n", pid,
+		   WIFEXITED(status) ? WEXITSTATUS(status) : RET_ERROR);
+	    /* Queued jobs are launched by the shell once woken up */
+	    jobqueue_done();
+	    jobqueue_poll();
+	}
+	/* Handler only active when no command is executing; the prompt
+	   is drawn again as it was, workers being left to the next one */
+	redisplay_prompt();
+	lineedit_redraw();
+    }
+}
+
+
+/*****************************************************************************
+ *
+ * Interface with History Functions
+ *
+ */
+
+/*
+ * historique_precedente -> history_last
+ */
+char *historique_precedente(void)
+{
+    return history_last();
+}
+
+/*
+ * historique_numero -> history_number
+ */
+char *historique_numero(int i)
+{
+    return history_number(i);
+}
+
+/*
+ * historique_chaine -> history_string
+ */
+char *historique_chaine(const char *c)
+{
+    return history_string(c);
+}
+
+/* End of file */
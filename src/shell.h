@@ -6,9 +6,9 @@
  *
  * ---------------------------------------------------------------------------
  *
- *        File: src/main.h
+ *        File: src/shell.h
  *
- * Description: Main Functions (Header)
+ * Description: Shell-Wide Variables and Functions (Header)
  *
  * ---------------------------------------------------------------------------
  *
@@ -30,25 +30,26 @@
  */
 
 
-#ifndef _MAIN_H_
-#define _MAIN_H_
+#ifndef _SHELL_H_
+#define _SHELL_H_
 
 /* Headers */
+#include <sys/types.h>
 #include <common.h>
 
 /* Variables */
-extern const char *exe_name; /* Program name, from executable filename      */
-extern       char *cwd;      /* Current working directory                   */
-extern       int   killed;   /* Number of killed children by signal handler */
+extern const char *exe_name;  /* Program name, from executable filename      */
+extern       char *cwd;       /* Current working directory                   */
+extern       int   killed;    /* Number of killed children by signal handler */
+extern       pid_t shell_pid; /* PID of the shell, not of a forked subshell  */
 
 /* Prototypes */
-int main(int argc, char *argv[]);
 void lish_perror(const char *str);
 void lish_exit(int error_code) NORETURN;
 void lish_abort(void) NORETURN;
 void change_cwd(void);
 void sig_chld(int sig UNUSED);
 
-#endif /* !_MAIN_H_ */
+#endif /* !_SHELL_H_ */
 
 /* End of file */
@@ -0,0 +1,386 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/variable.c
+ *
+ * Description: Shell Variables
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+
+/* Standard C headers */
+#include <stdio.h>  /* printf()                                  */
+#include <stdlib.h> /* NULL, malloc(), realloc(), free()         */
+#include <string.h> /* strlen(), strncmp(), strchr(), memcpy()   */
+
+/* Project headers */
+#include <common.h>
+#include "shell.h"
+#include "variable.h"
+
+
+/*****************************************************************************
+ *
+ * Data Types and Variables
+ *
+ */
+
+/* Environment given to the shell */
+extern char **environ;
+
+/* Shell variable, stored as a single "NAME=VALUE" string so that it can be
+   given as is to executed programs */
+struct variable {
+    struct variable *next;  /* Next variable in the same bucket */
+    unsigned int     hash;  /* Hash of the name                 */
+    int              flags; /* VAR_* flags                      */
+    size_t           len;   /* Name length                      */
+    char            *entry; /* "NAME=VALUE"                     */
+};
+
+/* Hash table of variables */
+static struct variable **buckets = NULL;
+static size_t            bucket_count = 0;
+static size_t            var_count = 0, exported = 0;
+
+/* Environment of executed programs, rebuilt when an exported variable
+   changes */
+static char **envp = NULL;
+static int    envp_stale = 1;
+
+/* Initial number of buckets */
+#define BUCKETS_MIN 64
+
+
+/*****************************************************************************
+ *
+ * Hash Table
+ *
+ */
+
+/*
+ * Hash `len' characters of a name (FNV-1a)
+ */
+static unsigned int var_hash(const char *name, size_t len)
+{
+    unsigned int hash = 2166136261U; /* Result */
+
+    while (len-- > 0)
+	hash = (hash ^ (unsigned char) *name++) * 16777619U;
+    return hash;
+}
+
+/*
+ * Find the variable named by the `len' first characters of `name'
+ */
+static struct variable *var_find(const char *name, size_t len,
+				 unsigned int hash)
+{
+    struct variable *var; /* Current variable */
+
+    if (bucket_count == 0)
+	return NULL;
+    for (var = buckets[hash % bucket_count]; var != NULL; var = var->next)
+	if (var->hash == hash && var->len == len &&
+	    !strncmp(var->entry, name, len))
+	    return var;
+    return NULL;
+}
+
+/*
+ * Double the number of buckets once there are as many variables
+ */
+static void var_grow(void)
+{
+    size_t            i, count;     /* Counter, new bucket count */
+    struct variable **table, *var;  /* New buckets, variable     */
+
+    if (var_count < bucket_count)
+	return;
+    count = bucket_count ? bucket_count * 2 : BUCKETS_MIN;
+    if ((table = calloc(count, sizeof *table)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+
+    for (i = 0; i < bucket_count; i++)
+	while ((var = buckets[i]) != NULL) {
+	    buckets[i] = var->next;
+	    var->next = table[var->hash % count];
+	    table[var->hash % count] = var;
+	}
+    free(buckets);
+    buckets = table;
+    bucket_count = count;
+}
+
+/*
+ * Set a variable from a "NAME=VALUE" string of `len' characters whose name
+ * has `name_len' ones
+ */
+static void var_store(const char *entry, size_t name_len, size_t len,
+		      int flags)
+{
+    unsigned int     hash = var_hash(entry, name_len); /* Name hash  */
+    struct variable *var;                              /* Variable   */
+    char            *copy;                             /* New string */
+
+    if ((copy = malloc(len + 1)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    memcpy(copy, entry, len);
+    copy[len] = '\0';
+
+    /* Replace the value of a known variable, keeping it exported */
+    if ((var = var_find(entry, name_len, hash)) != NULL) {
+	free(var->entry);
+	var->entry = copy;
+	if ((flags & VAR_EXPORT) && !(var->flags & VAR_EXPORT)) {
+	    var->flags |= VAR_EXPORT;
+	    exported++;
+	}
+	if (var->flags & VAR_EXPORT)
+	    envp_stale = 1;
+	return;
+    }
+
+    /* Add a new one */
+    var_grow();
+    if ((var = malloc(sizeof *var)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    var->hash = hash;
+    var->flags = flags;
+    var->len = name_len;
+    var->entry = copy;
+    var->next = buckets[hash % bucket_count];
+    buckets[hash % bucket_count] = var;
+    var_count++;
+    if (flags & VAR_EXPORT) {
+	exported++;
+	envp_stale = 1;
+    }
+}
+
+
+/*****************************************************************************
+ *
+ * Public Functions
+ *
+ */
+
+/*
+ * Import the environment given to the shell as exported variables
+ */
+void var_init(void)
+{
+    char **env;  /* Current entry   */
+    char  *equal; /* Its equal sign */
+
+    for (env = environ; *env != NULL; env++)
+	if ((equal = strchr(*env, '=')) != NULL && equal != *env)
+	    var_store(*env, equal - *env, strlen(*env), VAR_EXPORT);
+}
+
+/*
+ * Get the value of variable `name', or NULL if it is not set
+ */
+const char *var_get(const char *name)
+{
+    return var_getn(name, strlen(name));
+}
+
+/*
+ * Get the value of the variable named by the `len' first characters of
+ * `name', or NULL if it is not set
+ */
+const char *var_getn(const char *name, size_t len)
+{
+    struct variable *var; /* Variable */
+
+    if ((var = var_find(name, len, var_hash(name, len))) == NULL)
+	return NULL;
+    return var->entry + len + 1;
+}
+
+/*
+ * Set variable `name' to `value' (exporting it if `flags' has VAR_EXPORT,
+ * an exported variable staying so)
+ */
+void var_set(const char *name, const char *value, int flags)
+{
+    size_t len = strlen(name), value_len = strlen(value); /* Lengths */
+    char  *entry;                                         /* String  */
+
+    if ((entry = malloc(len + value_len + 2)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    memcpy(entry, name, len);
+    entry[len] = '=';
+    memcpy(entry + len + 1, value, value_len + 1);
+    var_store(entry, len, len + value_len + 1, flags);
+    free(entry);
+}
+
+/*
+ * Get the name length of a "NAME=VALUE" assignment, or 0 if `word' is not
+ * one (a name is made of letters, digits and `_', not starting by a digit)
+ */
+size_t var_assignment(const char *word)
+{
+    const char *chr; /* Current character */
+
+    for (chr = word; *chr == '_' || (*chr >= 'a' && *chr <= 'z') ||
+	     (*chr >= 'A' && *chr <= 'Z') ||
+	     (chr != word && *chr >= '0' && *chr <= '9'); chr++)
+	;
+    return *chr == '=' ? (size_t) (chr - word) : 0;
+}
+
+/*
+ * Set a variable from a "NAME=VALUE" assignment; return 0 if it is not one
+ */
+int var_assign(const char *assignment, int flags)
+{
+    size_t len; /* Name length */
+
+    if ((len = var_assignment(assignment)) == 0)
+	return 0;
+    var_store(assignment, len, strlen(assignment), flags);
+    return 1;
+}
+
+/*
+ * Export variable `name', setting it to an empty value if it is unknown
+ */
+void var_export(const char *name)
+{
+    size_t           len = strlen(name); /* Name length */
+    struct variable *var;                /* Variable    */
+
+    if ((var = var_find(name, len, var_hash(name, len))) == NULL)
+	var_set(name, "", VAR_EXPORT);
+    else if (!(var->flags & VAR_EXPORT)) {
+	var->flags |= VAR_EXPORT;
+	exported++;
+	envp_stale = 1;
+    }
+}
+
+/*
+ * Remove variable `name'
+ */
+void var_unset(const char *name)
+{
+    size_t            len = strlen(name);           /* Name length */
+    unsigned int      hash = var_hash(name, len);   /* Name hash   */
+    struct variable **link, *var;                   /* Variable    */
+
+    if (bucket_count == 0)
+	return;
+    for (link = &buckets[hash % bucket_count]; (var = *link) != NULL;
+	 link = &var->next)
+	if (var->hash == hash && var->len == len &&
+	    !strncmp(var->entry, name, len)) {
+	    *link = var->next;
+	    if (var->flags & VAR_EXPORT) {
+		exported--;
+		envp_stale = 1;
+	    }
+	    var_count--;
+	    free(var->entry);
+	    free(var);
+	    return;
+	}
+}
+
+/*
+ * Get the environment of executed programs (rebuilt only if an exported
+ * variable changed since the last call)
+ */
+char **var_environ(void)
+{
+    size_t           i, n = 0; /* Counters */
+    struct variable *var;      /* Variable */
+
+    if (!envp_stale)
+	return envp;
+
+    free(envp);
+    if ((envp = malloc((exported + 1) * sizeof *envp)) == NULL) {
+	lish_perror("fatal error");
+	lish_exit(RET_ERROR);
+    }
+    for (i = 0; i < bucket_count; i++)
+	for (var = buckets[i]; var != NULL; var = var->next)
+	    if (var->flags & VAR_EXPORT)
+		envp[n++] = var->entry;
+    envp[n] = NULL;
+    envp_stale = 0;
+    return envp;
+}
+
+/*
+ * Print variables (only exported ones if `flags' has VAR_EXPORT)
+ */
+void var_list(int flags)
+{
+    size_t           i;   /* Counter  */
+    struct variable *var; /* Variable */
+
+    for (i = 0; i < bucket_count; i++)
+	for (var = buckets[i]; var != NULL; var = var->next)
+	    if ((var->flags & flags) == flags)
+		printf("%s%s\n", var->flags & VAR_EXPORT ? "export " : "",
+		       var->entry);
+}
+
+/*
+ * Free every variable
+ */
+void var_free(void)
+{
+    size_t           i;   /* Counter  */
+    struct variable *var; /* Variable */
+
+    for (i = 0; i < bucket_count; i++)
+	while ((var = buckets[i]) != NULL) {
+	    buckets[i] = var->next;
+	    free(var->entry);
+	    free(var);
+	}
+    free(buckets);
+    free(envp);
+    buckets = NULL;
+    envp = NULL;
+    bucket_count = var_count = exported = 0;
+    envp_stale = 1;
+}
+
+/* End of file */
@@ -0,0 +1,57 @@
+/*
+ * ----------------------------------------------------------------------------
+ *
+ * Lish: Lightweight Interactive SHell
+ * Copyright (C) 2005 Benjamin Gaillard
+ *
+ * ---------------------------------------------------------------------------
+ *
+ *        File: src/variable.h
+ *
+ * Description: Shell Variables
+ *
+ * ---------------------------------------------------------------------------
+ *
+ * This program is free software; you can redistribute it and/or modify it
+ * under the terms of the GNU General Public License as published by the Free
+ * Software Foundation; either version 2 of the License, or (at your option)
+ * any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but WITHOUT
+ * ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+ * FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+ * more details.
+ *
+ * You should have received a copy of the GNU General Public License along
+ * with this program; if not, write to the Free Software Foundation, Inc., 59
+ * Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * ---------------------------------------------------------------------------
+ */
+
+
+#ifndef _VARIABLE_H_
+#define _VARIABLE_H_
+
+/* Headers */
+#include <stddef.h> /* size_t */
+
+/* Variable flags */
+#define VAR_EXPORT 1 /* Given to executed programs */
+
+/* Prototypes */
+void        var_init(void);
+const char *var_get(const char *name);
+const char *var_getn(const char *name, size_t len);
+void        var_set(const char *name, const char *value, int flags);
+size_t      var_assignment(const char *word);
+int         var_assign(const char *assignment, int flags);
+void        var_export(const char *name);
+void        var_unset(const char *name);
+char      **var_environ(void);
+void        var_list(int flags);
+void        var_free(void);
+
+#endif /* !_VARIABLE_H_ */
+
+/* End of file */
@@ -0,0 +1,55 @@
+#!/bin/sh
+
+# ----------------------------------------------------------------------------
+#
+# Lish: Lightweight Interactive SHell
+# Copyright (C) 2005 Benjamin Gaillard
+#
+# ----------------------------------------------------------------------------
+#
+#        File: test/check.sh
+#
+# Description: Regression Tests Driver
+#
+#     Comment: Usage: check.sh [LISH], from the test directory.  Each
+#              NAME.lish script is run by `LISH -c' and its output (errors
+#              included) compared to NAME.out; differences are left in
+#              NAME.diff.
+#
+# ----------------------------------------------------------------------------
+#
+# This program is free software; you can redistribute it and/or modify it
+# under the terms of the GNU General Public License as published by the Free
+# Software Foundation; either version 2 of the License, or (at your option)
+# any later version.
+#
+# This program is distributed in the hope that it will be useful, but WITHOUT
+# ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or
+# FITNESS FOR A PARTICULAR PURPOSE.  See the GNU General Public License for
+# more details.
+#
+# You should have received a copy of the GNU General Public License along
+# with this program; if not, write to the Free Software Foundation, Inc., 59
+# Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+#
+# ----------------------------------------------------------------------------
+
+
+LISH=${1:-../src/lish}
+failed=0
+
+for script in *.lish; do
+    name=${script%.lish}
+    if "$LISH" -c "$(cat "$script")" 2>&1 | diff -u "$name.out" - \
+	> "$name.diff"; then
+	rm -f "$name.diff"
+	echo "$name: passed"
+    else
+	echo "$name: FAILED (see $name.diff)"
+	failed=1
+    fi
+done
+
+exit $failed
+
+# End of file